@@ -4,15 +4,21 @@
 #include "SDK/apiPlayer.h"
 #include "Timer.h"
 #include "PlaylistListener.h"
+#include "PlaylistIndex.h"
+#include "SelectionSnapshot.h"
 #include "AddURLDialog.h"
 #include "Tools.h"
 #include "AimpHTTP.h"
+#include "JsonResponse.h"
 #include "YouTubeAPI.h"
 #include "AimpMenu.h"
 #include "resource.h"
 #include "PlayerHook.h"
 #include "FileSystem.h"
 #include "ArtworkProvider.h"
+#include "StreamCache.h"
+#include "Prefetcher.h"
+#include "MonitorScheduler.h"
 #include <set>
 #include <ctime>
 
@@ -41,6 +47,8 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
     if (!AimpMenu::Init(Core)) { Finalize(); return E_FAIL; }
 
     Config::LoadExtendedConfig();
+    StreamCache::Init();
+    Prefetcher::Init(Core);
 
     m_accessToken = Config::GetString(L"AccessToken");
     m_refreshToken = Config::GetString(L"RefreshToken");
@@ -56,13 +64,7 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
     }
 
     auto enableIfValid = [this](IAIMPMenuItem *item) {
-        int valid = 0;
-        ForSelectedTracks([&valid](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-            if (!id.empty()) valid++;
-            return 0;
-        });
-
-        item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+        item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, !SelectionSnapshot::Ids().empty());
     };
 
     if (AimpMenu *contextMenu = AimpMenu::Get(AIMP_MENUID_PLAYER_PLAYLIST_CONTEXT_FUNCTIONS)) {
@@ -72,10 +74,8 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
 
             contextMenu->Add(Lang(L"YouTube.Menu\\OpenInBrowser"), [this](IAIMPMenuItem *) {
                 ForSelectedTracks([this](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-                    if (auto ti = Tools::TrackInfo(id)) {
-                        if (!ti->Permalink.empty())
-                            ShellExecute(GetMainWindowHandle(), L"open", ti->Permalink.c_str(), NULL, NULL, SW_SHOWNORMAL);
-                    }
+                    if (!id.empty())
+                        ShellExecute(GetMainWindowHandle(), L"open", Tools::Permalink(id).c_str(), NULL, NULL, SW_SHOWNORMAL);
                     return 0;
                 });
             }, IDB_ICON, enableIfValid)->Release();
@@ -84,7 +84,7 @@ HRESULT WINAPI Plugin::Initialize(IAIMPCore *Core) {
         contextMenu->Add(Lang(L"YouTube.Menu\\AddToExclusions"), [this](IAIMPMenuItem *) {
             ForSelectedTracks([](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
                 if (!id.empty()) {
-                    Config::TrackExclusions.insert(id);
+                    Config::SetTrackExcluded(id, true);
                     return FLAG_DELETE_ITEM;
                 }
                 return 0;
@@ -168,17 +168,14 @@ void Plugin::KillMonitorTimer() {
 }
 
 void Plugin::MonitorCallback() {
-    if (m_instance->m_monitorPendingUrls.empty()) {
-        for (const auto &x : Config::MonitorUrls) {
-            m_instance->m_monitorPendingUrls.push(x);
-        }
+    if (!MonitorScheduler::Running()) {
         if (m_instance->isConnected()) {
             std::wstring auth = L"\r\nAuthorization: Bearer " + m_instance->m_accessToken;
 
             // Load user playlists
             AimpHTTP::Get(L"https://www.googleapis.com/youtube/v3/playlists?part=snippet&maxResults=50&mine=true&fields=items(id%2Csnippet)" + auth, [](unsigned char *data, int size) {
-                rapidjson::Document d;
-                d.Parse(reinterpret_cast<const char *>(data));
+                JsonResponse response(data, size);
+                rapidjson::Document &d = *response;
 
                 if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0) {
                     for (auto x = d["items"].Begin(), e = d["items"].End(); x != e; x++) {
@@ -187,42 +184,28 @@ void Plugin::MonitorCallback() {
                         auto find = [&](const Config::Playlist &p) -> bool { return p.ID == id; };
                         if (std::find_if(Config::UserPlaylists.begin(), Config::UserPlaylists.end(), find) == Config::UserPlaylists.end()) {
                             Config::UserPlaylists.push_back({ id, Tools::ToWString(item["snippet"]["localized"]["title"]), true });
+                            Config::UserPlaylistsChanged();
                         }
                     }
                 }
                 m_instance->UpdatePlaylistMenu();
             });
         }
-    }
-    if (!m_instance->m_monitorPendingUrls.empty()) {
-        const Config::MonitorUrl &url = m_instance->m_monitorPendingUrls.front();
-        IAIMPPlaylist *pl = m_instance->GetPlaylistById(url.PlaylistID, false);
-        if (!pl) {
-            m_instance->m_monitorPendingUrls.pop();
-            if (!m_instance->m_monitorPendingUrls.empty())
-                MonitorCallback();
-            return;
-        }
-
-        auto state = std::make_shared<YouTubeAPI::LoadingState>();
-        state->ReferenceName = url.GroupName;
-        state->Flags = url.Flags;
-
-        YouTubeAPI::GetExistingTrackIds(pl, state);
-        if (m_instance->m_monitorPendingUrls.size() > 1) {
-            YouTubeAPI::LoadFromUrl(url.URL, pl, state, MonitorCallback);
-        } else {
-            YouTubeAPI::LoadFromUrl(url.URL, pl, state); // last one without callback
-        }
-        m_instance->m_monitorPendingUrls.pop();
+        MonitorScheduler::StartSweep(Config::MonitorUrls);
     }
 }
 
 HRESULT WINAPI Plugin::Finalize() {
     Timer::StopAll();
+    Config::Flush(); // A delayed save may have just been cancelled
 
     AimpMenu::Deinit();
+    Prefetcher::Deinit(); // Its worker may still be inside an HTTP request
     AimpHTTP::Deinit();
+    MonitorScheduler::Deinit();
+    PlaylistIndex::Deinit();
+    SelectionSnapshot::Deinit();
+    StreamCache::Deinit();
     Config::Deinit();
 
     if (m_messageDispatcher) {
@@ -412,10 +395,9 @@ void Plugin::ForEveryItem(IAIMPPlaylist *pl, std::function<int(IAIMPPlaylistItem
             if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILEINFO, IID_IAIMPFileInfo, reinterpret_cast<void **>(&finfo)))) {
                 IAIMPString *custom = nullptr;
                 if (SUCCEEDED(finfo->GetValueAsObject(AIMP_FILEINFO_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&custom)))) {
-                    std::wstring url(custom->GetData());
+                    std::wstring id = Tools::TrackIdFromUrl(custom->GetData());
                     custom->Release();
 
-                    std::wstring id = Tools::TrackIdFromUrl(url);
                     int result = callback(item, finfo, id);
                     if (result & FLAG_DELETE_ITEM) {
                         pl->Delete(item);
@@ -507,13 +489,7 @@ void Plugin::UpdatePlaylistMenu() {
     if (!contextMenu) {
         if (AimpMenu *itemContextMenu = AimpMenu::Get(AIMP_MENUID_PLAYER_PLAYLIST_CONTEXT_FUNCTIONS)) {
             contextMenu = new AimpMenu(itemContextMenu->Add(Lang(L"YouTube.Menu\\AddTo"), nullptr, IDB_ICON, [this](IAIMPMenuItem *item) {
-                int valid = 0;
-                ForSelectedTracks([&valid](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-                    if (!id.empty()) valid++;
-                    return 0;
-                });
-
-                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, !SelectionSnapshot::Ids().empty());
             }, L"ContextMenu"));
             delete itemContextMenu;
         }
@@ -540,22 +516,7 @@ void Plugin::UpdatePlaylistMenu() {
     if (!contextMenu) {
         if (AimpMenu *itemContextMenu = AimpMenu::Get(AIMP_MENUID_PLAYER_PLAYLIST_CONTEXT_FUNCTIONS)) {
             contextMenu = new AimpMenu(itemContextMenu->Add(Lang(L"YouTube.Menu\\RemoveFrom"), nullptr, IDB_ICON, [this](IAIMPMenuItem *item) {
-                int valid = 0;
-                ForSelectedTracks([&valid](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-                    if (!id.empty()) {
-                        for (auto &x : Config::UserPlaylists) {
-                            for (auto &item : x.Items) {
-                                if (id == item) {
-                                    valid++;
-                                    return 0;
-                                }
-                            }
-                        }
-                    }
-                    return 0;
-                });
-
-                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+                item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, SelectionSnapshot::InUserPlaylist());
             }, L"RemoveContextMenu"));
             delete itemContextMenu;
         }
@@ -572,20 +533,7 @@ void Plugin::UpdatePlaylistMenu() {
                         return 0;
                     });
                 }, 0, [this, &x](IAIMPMenuItem *item) {
-                    int valid = 0;
-                    ForSelectedTracks([&valid, &x](IAIMPPlaylist *, IAIMPPlaylistItem *, const std::wstring &id) -> int {
-                        if (!id.empty()) {
-                            for (auto &item : x.Items) {
-                                if (id == item) {
-                                    valid++;
-                                    return 0;
-                                }
-                            }
-                        }
-                        return 0;
-                    });
-
-                    item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, valid > 0);
+                    item->SetValueAsInt32(AIMP_MENUITEM_PROPID_VISIBLE, SelectionSnapshot::In(x));
                 })->Release();
             }
         }
@@ -617,8 +565,8 @@ void Plugin::refreshAccessToken(bool synchrounous) {
     std::string post("client_id=" CLIENT_ID "&client_secret=" CLIENT_SECRET "&grant_type=refresh_token&refresh_token=" + Tools::ToString(m_refreshToken));
 
     AimpHTTP::Post(L"https://accounts.google.com/o/oauth2/token", post, [this](unsigned char *data, unsigned int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<char *>(data));
+        JsonResponse response(data, size);
+        rapidjson::Document &d = *response;
         if (d.IsObject() && d.HasMember("access_token")) {
             m_accessToken = Tools::ToWString(d["access_token"]);
             m_tokenExpireTime = std::time(nullptr) + d["expires_in"].GetUint();
@@ -7,7 +7,6 @@
 #include "OptionsDialog.h"
 #include "Config.h"
 #include "MessageHook.h"
-#include <queue>
 
 #include <gdiplus.h>
 #pragma comment(lib, "gdiplus.lib")
@@ -108,7 +107,6 @@ private:
     IAIMPServiceMUI *m_muiService;
 
     UINT_PTR m_monitorTimer;
-    std::queue<Config::MonitorUrl> m_monitorPendingUrls;
 
     ULONG_PTR m_gdiplusToken;
     std::wstring m_accessToken;
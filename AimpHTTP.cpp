@@ -1,17 +1,129 @@
-#include <WinSock2.h>
-#include <WS2tcpip.h>
-#include <Windows.h>
-
 #include "AimpHTTP.h"
 #include "AIMPYouTube.h"
 #include "AIMPString.h"
+#include "ConnectionPool.h"
 #include "Tools.h"
-#include <process.h>
 #include "SDK/apiFileManager.h"
 
 bool AimpHTTP::m_initialized = false;
 IAIMPServiceHTTPClient *AimpHTTP::m_httpClient = nullptr;
 std::set<AimpHTTP::EventListener *> AimpHTTP::m_handlers;
+HWND AimpHTTP::m_completionWindow = NULL;
+DWORD AimpHTTP::m_completionThread = 0;
+std::mutex AimpHTTP::m_completedMutex;
+std::deque<AimpHTTP::RequestPtr> AimpHTTP::m_completed;
+
+extern HINSTANCE g_hInst;
+
+AimpHTTP::Request::~Request() {
+    if (m_stream)
+        m_stream->Release();
+}
+
+AimpHTTP::RequestPtr AimpHTTP::Request::Then(CallbackFunc callback, std::function<void()> dropped) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_continuations.push_back(callback);
+    m_dropped.push_back(dropped);
+    if (m_done) {
+        lock.unlock();
+        AimpHTTP::Enqueue(m_self.lock());
+    }
+    return m_self.lock();
+}
+
+bool AimpHTTP::Request::Wait() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_done; });
+    return m_succeeded;
+}
+
+bool AimpHTTP::Request::Succeeded() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_done && m_succeeded;
+}
+
+int AimpHTTP::Request::Status() {
+    // HTTP/1.1 304 Not Modified
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::size_t pos = m_headers.find(L' ');
+    return pos == std::wstring::npos ? 0 : _wtoi(m_headers.c_str() + pos + 1);
+}
+
+std::wstring AimpHTTP::Request::Header(const std::wstring &name) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (std::size_t pos = 0; pos < m_headers.size();) {
+        std::size_t end = m_headers.find(L"\r\n", pos);
+        if (end == std::wstring::npos)
+            end = m_headers.size();
+
+        if (end - pos > name.size() && m_headers[pos + name.size()] == L':' && _wcsnicmp(m_headers.c_str() + pos, name.c_str(), name.size()) == 0) {
+            std::size_t value = m_headers.find_first_not_of(L' ', pos + name.size() + 1);
+            return value < end ? m_headers.substr(value, end - value) : std::wstring();
+        }
+        pos = end + 2;
+    }
+    return std::wstring();
+}
+
+void AimpHTTP::Request::SetHeaders(const wchar_t *headers) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_headers = headers;
+}
+
+void AimpHTTP::Request::Complete(IAIMPStream *stream, bool succeeded) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_done)
+        return;
+
+    if (stream) {
+        if (unsigned char *data = AimpHTTP::Terminate(stream, &m_size)) {
+            // Read in place, the stream is kept as long as the request
+            stream->AddRef();
+            m_stream = stream;
+            m_view = data;
+        } else {
+            m_data.resize(m_size + 1);
+            m_data[m_size] = 0;
+            stream->Seek(0, AIMP_STREAM_SEEKMODE_FROM_BEGINNING);
+            stream->Read(m_data.data(), m_size);
+            m_view = m_data.data();
+        }
+    }
+    m_succeeded = succeeded;
+    m_done = true;
+    m_cv.notify_all();
+
+    bool pending = !m_continuations.empty();
+    lock.unlock();
+    if (pending)
+        AimpHTTP::Enqueue(m_self.lock());
+}
+
+void AimpHTTP::Request::Dispatch() {
+    std::vector<CallbackFunc> continuations;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    continuations.swap(m_continuations);
+    m_dropped.clear();
+    lock.unlock();
+
+    for (auto &x : continuations) {
+        if (x)
+            x(Data(), Size());
+    }
+}
+
+void AimpHTTP::Request::Drop() {
+    std::vector<std::function<void()>> dropped;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    dropped.swap(m_dropped);
+    m_continuations.clear();
+    lock.unlock();
+
+    for (auto &x : dropped) {
+        if (x)
+            x();
+    }
+}
 
 AimpHTTP::EventListener::EventListener(CallbackFunc callback, bool isFile) : m_isFileStream(isFile), m_callback(callback) {
     AimpHTTP::m_handlers.insert(this);
@@ -25,47 +137,96 @@ void WINAPI AimpHTTP::EventListener::OnAccept(IAIMPString *ContentType, const IN
     ContentType->AddRef();
     ContentType->Release();
     *Allow = AimpHTTP::m_initialized && Plugin::instance()->core();
+    if (*Allow && m_imageSink)
+        m_imageSink->Reserve(ContentSize);
 }
 
 void WINAPI AimpHTTP::EventListener::OnAcceptHeaders(IAIMPString *Header, BOOL *Allow) {
     Header->AddRef();
+    if (m_request)
+        m_request->SetHeaders(Header->GetData());
     Header->Release();
     *Allow = AimpHTTP::m_initialized && Plugin::instance()->core();
 }
 
 void WINAPI AimpHTTP::EventListener::OnComplete(IAIMPErrorInfo *ErrorInfo, BOOL Canceled) {
+    bool alive = AimpHTTP::m_initialized && Plugin::instance()->core();
+    if (m_request)
+        m_request->Complete(alive ? m_stream : nullptr, alive && !Canceled && !ErrorInfo);
+
     if (m_stream) {
-        if (AimpHTTP::m_initialized && Plugin::instance()->core()) {
+        if (alive) {
             if (m_isFileStream) {
                 m_stream->Release();
+                m_stream = nullptr;
                 if (m_callback)
                     m_callback(nullptr, 0);
                 return;
             }
 
-            if (m_callback || m_imageContainer) {
-                int s = (int)m_stream->GetSize();
-                unsigned char *buf = new unsigned char[s + 1];
-                buf[s] = 0;
-                m_stream->Seek(0, AIMP_STREAM_SEEKMODE_FROM_BEGINNING);
-                m_stream->Read(buf, s);
-
-                if (m_callback) {
-                    m_callback(buf, s);
-                } else if (m_imageContainer) {
-                    if (s <= m_maxSize) {
-                        (*m_imageContainer)->SetDataSize(s);
-                        memcpy((*m_imageContainer)->GetData(), buf, s);
-                    } else {
-                        (*m_imageContainer)->Release();
-                        *m_imageContainer = nullptr;
-                    }
+            if (m_imageSink) {
+                m_imageSink->Finish(!Canceled && !ErrorInfo);
+            } else if (m_callback) {
+                // The callback reads the response in place, the stream is released after it returns
+                int s = 0;
+                if (unsigned char *data = AimpHTTP::Terminate(m_stream, &s)) {
+                    m_callback(data, s);
+                } else {
+                    std::vector<unsigned char> buf(s + 1, 0);
+                    m_stream->Seek(0, AIMP_STREAM_SEEKMODE_FROM_BEGINNING);
+                    m_stream->Read(buf.data(), s);
+                    m_callback(buf.data(), s);
                 }
-                delete[] buf;
             }
         }
         m_stream->Release();
+        m_stream = nullptr;
+    }
+}
+
+HRESULT WINAPI AimpHTTP::ImageSink::Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written) {
+    if (m_written + Count > m_maxSize)
+        return E_ABORT; // Too big to be used anyway
+
+    if (m_reserved > 0 && m_written + Count > m_reserved) {
+        // Longer than announced
+        m_spill.assign((*m_image)->GetData(), (*m_image)->GetData() + m_written);
+        m_reserved = 0;
     }
+    if (m_reserved > 0) {
+        memcpy((*m_image)->GetData() + m_written, Buffer, Count);
+    } else {
+        m_spill.insert(m_spill.end(), Buffer, Buffer + Count);
+    }
+
+    m_written += Count;
+    if (Written)
+        *Written = Count;
+    return S_OK;
+}
+
+void AimpHTTP::ImageSink::Reserve(INT64 size) {
+    if (m_written == 0 && size > 0 && size <= m_maxSize && SUCCEEDED((*m_image)->SetDataSize(DWORD(size))) && (*m_image)->GetData())
+        m_reserved = size;
+}
+
+bool AimpHTTP::ImageSink::Finish(bool succeeded) {
+    if (succeeded && m_reserved > 0 && m_written < m_reserved) {
+        // Shorter than announced
+        m_spill.assign((*m_image)->GetData(), (*m_image)->GetData() + m_written);
+        m_reserved = 0;
+    }
+    if (succeeded && m_reserved == 0) {
+        succeeded = !m_spill.empty() && SUCCEEDED((*m_image)->SetDataSize(DWORD(m_spill.size())));
+        if (succeeded)
+            memcpy((*m_image)->GetData(), m_spill.data(), m_spill.size());
+    }
+
+    if (!succeeded) {
+        (*m_image)->Release();
+        *m_image = nullptr;
+    }
+    return succeeded;
 }
 
 void WINAPI AimpHTTP::EventListener::OnProgress(const INT64 Downloaded, const INT64 Total) {
@@ -79,7 +240,122 @@ bool AimpHTTP::Get(const std::wstring &url, CallbackFunc callback, bool synchron
     EventListener *listener = new EventListener(callback);
     Plugin::instance()->core()->CreateObject(IID_IAIMPMemoryStream, reinterpret_cast<void **>(&(listener->m_stream)));
 
-    return SUCCEEDED(m_httpClient->Get(AIMPString(url), synchronous ? AIMP_SERVICE_HTTPCLIENT_FLAGS_WAITFOR : 0, listener->m_stream, listener, 0, reinterpret_cast<void **>(&(listener->m_taskId))));
+    return Send(listener, url, synchronous ? AIMP_SERVICE_HTTPCLIENT_FLAGS_WAITFOR : 0);
+}
+
+bool AimpHTTP::Send(EventListener *listener, const std::wstring &url, DWORD flags, IAIMPStream *postData) {
+    // Our reference keeps the listener alive across the call, a client that fails may have taken and dropped
+    // its own already. OnComplete doesn't run for a request that wasn't started, its stream is released here.
+    listener->AddRef();
+    HRESULT result = E_FAIL;
+    if (listener->m_stream) {
+        void **taskId = reinterpret_cast<void **>(&(listener->m_taskId));
+        result = postData ? m_httpClient->Post(AIMPString(url), flags, listener->m_stream, postData, listener, 0, taskId)
+                          : m_httpClient->Get(AIMPString(url), flags, listener->m_stream, listener, 0, taskId);
+    }
+    if (FAILED(result) && listener->m_stream) {
+        listener->m_stream->Release();
+        listener->m_stream = nullptr;
+    }
+    listener->Release();
+    return SUCCEEDED(result);
+}
+
+unsigned char *AimpHTTP::Terminate(IAIMPStream *stream, int *size) {
+    *size = int(stream->GetSize());
+
+    // Only called on the memory streams created here
+    unsigned char zero = 0;
+    if (FAILED(stream->Seek(0, AIMP_STREAM_SEEKMODE_FROM_END)) || FAILED(stream->Write(&zero, 1, nullptr)))
+        return nullptr;
+    return static_cast<unsigned char *>(static_cast<IAIMPMemoryStream *>(stream)->GetData());
+}
+
+AimpHTTP::RequestPtr AimpHTTP::NewRequest() {
+    RequestPtr request = std::make_shared<Request>();
+    request->m_self = request;
+    return request;
+}
+
+AimpHTTP::RequestPtr AimpHTTP::GetAsync(const std::wstring &url) {
+    RequestPtr request = NewRequest();
+    if (!AimpHTTP::m_initialized || !Plugin::instance()->core()) {
+        request->Complete(nullptr, false);
+        return request;
+    }
+
+    EventListener *listener = new EventListener(nullptr);
+    listener->m_request = request;
+    Plugin::instance()->core()->CreateObject(IID_IAIMPMemoryStream, reinterpret_cast<void **>(&(listener->m_stream)));
+
+    if (!Send(listener, url, 0))
+        request->Complete(nullptr, false);
+    return request;
+}
+
+AimpHTTP::RequestPtr AimpHTTP::PostAsync(const std::wstring &url, const std::string &body) {
+    RequestPtr request = NewRequest();
+    IAIMPStream *postData = nullptr;
+    if (!AimpHTTP::m_initialized || !Plugin::instance()->core() || FAILED(Plugin::instance()->core()->CreateObject(IID_IAIMPMemoryStream, reinterpret_cast<void **>(&postData)))) {
+        request->Complete(nullptr, false);
+        return request;
+    }
+    postData->Write((unsigned char *)(body.data()), body.size(), nullptr);
+
+    EventListener *listener = new EventListener(nullptr);
+    listener->m_request = request;
+    Plugin::instance()->core()->CreateObject(IID_IAIMPMemoryStream, reinterpret_cast<void **>(&(listener->m_stream)));
+
+    if (!Send(listener, url, 0, postData))
+        request->Complete(nullptr, false);
+    postData->Release();
+    return request;
+}
+
+bool AimpHTTP::RunOnCompletionThread(std::function<void()> func) {
+    if (!AimpHTTP::m_initialized || !m_completionWindow)
+        return false;
+
+    RequestPtr request = NewRequest();
+    request->Then([func](unsigned char *, int) { func(); });
+    request->Complete(nullptr, true);
+    return true;
+}
+
+void AimpHTTP::Enqueue(RequestPtr request) {
+    if (!request)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_completedMutex);
+    if (!AimpHTTP::m_initialized || !m_completionWindow) {
+        // Nothing dispatches the queue anymore, Deinit has emptied it already
+        lock.unlock();
+        request->Drop();
+        return;
+    }
+    m_completed.push_back(request);
+    lock.unlock();
+
+    PostMessage(m_completionWindow, WM_HTTP_COMPLETED, 0, 0);
+}
+
+LRESULT CALLBACK AimpHTTP::CompletionWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    if (msg != WM_HTTP_COMPLETED)
+        return DefWindowProc(hwnd, msg, wParam, lParam);
+
+    std::deque<RequestPtr> completed;
+    std::unique_lock<std::mutex> lock(m_completedMutex);
+    completed.swap(m_completed);
+    lock.unlock();
+
+    for (auto &x : completed) {
+        if (AimpHTTP::m_initialized && Plugin::instance()->core()) {
+            x->Dispatch();
+        } else {
+            x->Drop();
+        }
+    }
+    return 0;
 }
 
 bool AimpHTTP::Download(const std::wstring &url, const std::wstring &destination, CallbackFunc callback) {
@@ -93,21 +369,20 @@ bool AimpHTTP::Download(const std::wstring &url, const std::wstring &destination
         fileStreaming->Release();
     }
     
-    return SUCCEEDED(m_httpClient->Get(AIMPString(url), 0, listener->m_stream, listener, 0, reinterpret_cast<void **>(&(listener->m_taskId))));
+    return Send(listener, url, 0);
 }
 
 bool AimpHTTP::DownloadImage(const std::wstring &url, IAIMPImageContainer **Image, int maxSize) {
     if (!AimpHTTP::m_initialized || !Plugin::instance()->core())
         return false;
 
-    EventListener *listener = new EventListener(nullptr);
-    Plugin::instance()->core()->CreateObject(IID_IAIMPMemoryStream, reinterpret_cast<void **>(&(listener->m_stream)));
-
     if (SUCCEEDED(Plugin::instance()->core()->CreateObject(IID_IAIMPImageContainer, reinterpret_cast<void **>(Image)))) {
-        listener->m_imageContainer = Image;
-        listener->m_maxSize = maxSize;
+        EventListener *listener = new EventListener(nullptr);
+        listener->m_imageSink = new ImageSink(Image, maxSize);
+        listener->m_stream = listener->m_imageSink;
+        listener->m_stream->AddRef();
 
-        return SUCCEEDED(m_httpClient->Get(AIMPString(url), AIMP_SERVICE_HTTPCLIENT_FLAGS_WAITFOR, listener->m_stream, listener, 0, reinterpret_cast<void **>(&(listener->m_taskId))));
+        return Send(listener, url, AIMP_SERVICE_HTTPCLIENT_FLAGS_WAITFOR);
     }
     return false;
 }
@@ -123,7 +398,7 @@ bool AimpHTTP::Post(const std::wstring &url, const std::string &body, CallbackFu
         EventListener *listener = new EventListener(callback);
         Plugin::instance()->core()->CreateObject(IID_IAIMPMemoryStream, reinterpret_cast<void **>(&(listener->m_stream)));
 
-        bool ok = SUCCEEDED(m_httpClient->Post(AIMPString(url), synchronous ? AIMP_SERVICE_HTTPCLIENT_FLAGS_WAITFOR : 0, listener->m_stream, postData, listener, 0, reinterpret_cast<void **>(&(listener->m_taskId))));
+        bool ok = Send(listener, url, synchronous ? AIMP_SERVICE_HTTPCLIENT_FLAGS_WAITFOR : 0, postData);
         postData->Release();
         return ok;
     }
@@ -133,11 +408,22 @@ bool AimpHTTP::Post(const std::wstring &url, const std::string &body, CallbackFu
 bool AimpHTTP::Init(IAIMPCore *Core) {
     m_initialized = SUCCEEDED(Core->QueryInterface(IID_IAIMPServiceHTTPClient, reinterpret_cast<void **>(&m_httpClient)));
 
+    // Message-only window on the main thread, completed async requests are dispatched from its queue
+    WNDCLASSEX wc = { sizeof(WNDCLASSEX) };
+    wc.lpfnWndProc = CompletionWndProc;
+    wc.hInstance = g_hInst;
+    wc.lpszClassName = L"AIMPYouTubeHTTPCompletion";
+    RegisterClassEx(&wc);
+    m_completionWindow = CreateWindowEx(0, wc.lpszClassName, L"", 0, 0, 0, 0, 0, HWND_MESSAGE, NULL, g_hInst, NULL);
+    m_completionThread = GetCurrentThreadId();
+    ConnectionPool::Init(Config::GetInt32(L"RawRequestWorkers", 2));
+
     return m_initialized;
 }
 
 void AimpHTTP::Deinit() {
     m_initialized = false;
+    ConnectionPool::Deinit();
 
     std::unordered_set<uintptr_t *> ids;
     for (auto x : m_handlers) ids.insert(x->m_taskId);
@@ -147,6 +433,18 @@ void AimpHTTP::Deinit() {
         m_httpClient->Release();
         m_httpClient = nullptr;
     }
+
+    if (m_completionWindow) {
+        DestroyWindow(m_completionWindow);
+        UnregisterClass(L"AIMPYouTubeHTTPCompletion", g_hInst);
+        m_completionWindow = NULL;
+    }
+    std::deque<RequestPtr> completed;
+    std::unique_lock<std::mutex> lock(m_completedMutex);
+    completed.swap(m_completed);
+    lock.unlock();
+    for (auto &x : completed)
+        x->Drop();
 }
 
 bool AimpHTTP::Put(const std::wstring &url, CallbackFunc callback) {
@@ -157,77 +455,6 @@ bool AimpHTTP::Delete(const std::wstring &url, CallbackFunc callback) {
     return RawRequest("DELETE", url, callback);
 }
 
-void AimpHTTP::RawRequestThread(void *args) {
-    ThreadParams *params = static_cast<ThreadParams *>(args);
-    std::string request = params->request;
-    std::string host = params->host;
-    AimpHTTP::CallbackFunc callback = params->callback;
-    delete params;
-
-    WSADATA wsaData;
-    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
-        DebugA("WSAStartup failed.\n");
-        return;
-    }
-
-    struct addrinfo hints;
-    ZeroMemory(&hints, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_protocol = IPPROTO_TCP;
-    hints.ai_socktype = SOCK_STREAM;
-
-    struct addrinfo *targetAdressInfo = NULL;
-    DWORD getAddrRes = getaddrinfo(host.c_str(), NULL, &hints, &targetAdressInfo);
-    if (getAddrRes != 0 || targetAdressInfo == NULL) {
-        DebugA("Could not resolve the Host Name\n");
-        WSACleanup();
-        return;
-    }
-
-    SOCKADDR_IN sockAddr;
-    sockAddr.sin_addr = ((struct sockaddr_in *)targetAdressInfo->ai_addr)->sin_addr;
-    sockAddr.sin_family = AF_INET;
-    sockAddr.sin_port = htons(80);
-    freeaddrinfo(targetAdressInfo);
-
-    SOCKET webSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (webSocket == INVALID_SOCKET) {
-        DebugA("Creation of the Socket Failed\n");
-        WSACleanup();
-        return;
-    }
-
-    if (connect(webSocket, (SOCKADDR *)&sockAddr, sizeof(sockAddr)) != 0) {
-        DebugA("Could not connect\n");
-        closesocket(webSocket);
-        WSACleanup();
-        return;
-    }
-
-    const char *httpRequest = request.c_str();
-    int sentBytes = send(webSocket, httpRequest, strlen(httpRequest), 0);
-    if (sentBytes < (int)request.size() || sentBytes == SOCKET_ERROR) {
-        DebugA("Could not send the request to the Server");
-        closesocket(webSocket);
-        WSACleanup();
-        return;
-    }
-
-    char buffer[10240];
-    ZeroMemory(buffer, sizeof(buffer));
-    int dataLen;
-    if ((dataLen = recv(webSocket, buffer, sizeof(buffer), 0) > 0)) {
-        if (char *body = strstr(buffer, "\r\n\r\n")) {
-            body += 4;
-            if (callback && m_initialized && Plugin::instance()->core())
-                callback(reinterpret_cast<unsigned char *>(body), strlen(body));
-        }
-    }
-
-    closesocket(webSocket);
-    WSACleanup();
-};
-
 bool AimpHTTP::RawRequest(const std::string &method, const std::wstring &url, CallbackFunc callback) {
     // Not perfect but does its job
 
@@ -236,15 +463,19 @@ bool AimpHTTP::RawRequest(const std::string &method, const std::wstring &url, Ca
     if (urlc = strstr(urlc, "://")) {
         urlc += 3;
         if (const char *request = strstr(urlc, "/")) {
-            ThreadParams *p = new ThreadParams();
-            p->request += method + " ";
-            p->request += request;
-            p->host = std::string(urlc, request);
-            p->request += " HTTP/1.1\r\nHost: " + p->host + "\r\nConnection: close\r\n\r\n";
-            p->callback = callback;
-
-            HANDLE hThread = (HANDLE)_beginthread(AimpHTTP::RawRequestThread, 0, p);
-            return hThread != INVALID_HANDLE_VALUE;
+            std::string host(urlc, request);
+            unsigned short port = 80;
+            std::size_t colon = host.find(':');
+            if (colon != std::string::npos) {
+                port = static_cast<unsigned short>(atoi(host.c_str() + colon + 1));
+                host.resize(colon);
+            }
+
+            std::string head = method + " " + request + " HTTP/1.1\r\nHost: " + std::string(urlc, request) + "\r\nContent-Length: 0\r\n\r\n";
+            return ConnectionPool::Submit(host, port, head, [callback](unsigned char *data, int size) {
+                if (callback && m_initialized && Plugin::instance()->core())
+                    callback(data, size);
+            });
         }
     }
     return false;
@@ -4,10 +4,96 @@
 #include "IUnknownInterfaceImpl.h"
 #include <functional>
 #include <set>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <windows.h>
 
 class AimpHTTP {
     typedef std::function<void(unsigned char *, int)> CallbackFunc;
 
+public:
+    // Pending asynchronous request. Continuations added with Then() run on the thread that called
+    // AimpHTTP::Init (the main thread) through its completion queue; worker threads may Wait() instead.
+    // Once AimpHTTP is deinitialized continuations are dropped, their dropped functions run instead
+    // (on any thread) to release what the continuation would have.
+    class Request {
+    public:
+        ~Request();
+
+        std::shared_ptr<Request> Then(CallbackFunc callback, std::function<void()> dropped = nullptr);
+        bool Wait();
+
+        bool Succeeded();
+        // 0 terminated response, it stays valid as long as the request
+        unsigned char *Data() { return m_view ? m_view : &m_empty; }
+        int Size() { return m_size; }
+        int Status();
+        std::wstring Header(const std::wstring &name);
+
+    private:
+        void Complete(IAIMPStream *stream, bool succeeded);
+        void Dispatch();
+        void Drop();
+        void SetHeaders(const wchar_t *headers);
+
+        std::mutex m_mutex;
+        std::condition_variable m_cv;
+        IAIMPStream *m_stream{ nullptr };
+        std::vector<unsigned char> m_data;
+        unsigned char *m_view{ nullptr };
+        int m_size{ 0 };
+        unsigned char m_empty{ 0 };
+        std::vector<CallbackFunc> m_continuations;
+        std::vector<std::function<void()>> m_dropped;
+        std::wstring m_headers;
+        std::weak_ptr<Request> m_self;
+        bool m_done{ false };
+        bool m_succeeded{ false };
+        friend class AimpHTTP;
+    };
+    typedef std::shared_ptr<Request> RequestPtr;
+
+private:
+    // Receives an image straight into its container, which is sized up front when the length is announced
+    class ImageSink : public IUnknownInterfaceImpl<IAIMPStream> {
+    public:
+        ImageSink(IAIMPImageContainer **image, int maxSize) : m_image(image), m_maxSize(maxSize) {}
+
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+            if (riid == IID_IAIMPStream) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            return E_NOINTERFACE;
+        }
+        virtual INT64 WINAPI GetPosition() { return m_written; }
+        virtual INT64 WINAPI GetSize() { return m_written; }
+
+        virtual HRESULT WINAPI SetSize(const INT64 Value) { return S_OK; }
+
+        virtual HRESULT WINAPI Seek(const INT64 Offset, int Mode) { return S_OK; }
+        virtual int WINAPI Read(unsigned char *Buffer, unsigned int Count) { return 0; }
+        virtual HRESULT WINAPI Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written);
+
+        void Reserve(INT64 size);
+        // Releases the container unless a complete image was received
+        bool Finish(bool succeeded);
+
+    private:
+        IAIMPImageContainer **m_image;
+        int m_maxSize;
+        INT64 m_written{ 0 };
+        // Size of the container while receiving in place, the data goes to m_spill otherwise
+        INT64 m_reserved{ 0 };
+        std::vector<unsigned char> m_spill;
+    };
+
     class EventListener : public IUnknownInterfaceImpl<IAIMPHTTPClientEvents>, IAIMPHTTPClientEvents2 {
         typedef IUnknownInterfaceImpl<IAIMPHTTPClientEvents> Base;
     public:
@@ -43,9 +129,9 @@ class AimpHTTP {
         bool m_isFileStream{ false };
         CallbackFunc m_callback{ nullptr };
         IAIMPStream *m_stream{ nullptr };
-        IAIMPImageContainer **m_imageContainer{ nullptr };
-        int m_maxSize{ 0 };
+        ImageSink *m_imageSink{ nullptr };
         uintptr_t *m_taskId{ nullptr };
+        RequestPtr m_request;
         friend class AimpHTTP;
     };
 
@@ -53,6 +139,7 @@ public:
     static bool Init(IAIMPCore *Core);
     static void Deinit();
 
+    // Plain HTTP through ConnectionPool, the callback runs on a worker thread (with nullptr if the request failed)
     static bool Put(const std::wstring &url, CallbackFunc callback = nullptr);
     static bool Delete(const std::wstring &url, CallbackFunc callback = nullptr);
     static bool Get(const std::wstring &url, CallbackFunc callback, bool synchronous = false);
@@ -60,15 +147,23 @@ public:
     static bool DownloadImage(const std::wstring &url, IAIMPImageContainer **Image, int maxSize = 0);
     static bool Post(const std::wstring &url, const std::string &body, CallbackFunc callback, bool synchronous = false);
 
+    static RequestPtr GetAsync(const std::wstring &url);
+    static RequestPtr PostAsync(const std::wstring &url, const std::string &body);
+    static bool OnCompletionThread() { return GetCurrentThreadId() == m_completionThread; }
+    // Runs func on the completion (main) thread, false if it can't be queued
+    static bool RunOnCompletionThread(std::function<void()> func);
+
 private:
-    struct ThreadParams {
-        std::string request;
-        std::string host;
-        CallbackFunc callback;
-    };
-    static void RawRequestThread(void *args);
     static bool RawRequest(const std::string &method, const std::wstring &, CallbackFunc callback);
 
+    // Appends a 0 to a memory stream and returns its buffer, size excludes the 0
+    static unsigned char *Terminate(IAIMPStream *stream, int *size);
+    // Starts listener's request, a Post with postData. The listener is freed when that fails.
+    static bool Send(EventListener *listener, const std::wstring &url, DWORD flags, IAIMPStream *postData = nullptr);
+    static RequestPtr NewRequest();
+    static void Enqueue(RequestPtr request);
+    static LRESULT CALLBACK CompletionWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+
     AimpHTTP();
     AimpHTTP(const AimpHTTP&);
     AimpHTTP& operator=(const AimpHTTP&);
@@ -77,4 +172,10 @@ private:
     static IAIMPServiceHTTPClient *m_httpClient;
 
     static std::set<EventListener *> m_handlers;
+
+    static const UINT WM_HTTP_COMPLETED = WM_APP + 1;
+    static HWND m_completionWindow;
+    static DWORD m_completionThread;
+    static std::mutex m_completedMutex;
+    static std::deque<RequestPtr> m_completed;
 };
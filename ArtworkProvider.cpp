@@ -8,11 +8,12 @@ HRESULT WINAPI ArtworkProvider::Get2(IAIMPFileInfo *FileInfo, IAIMPPropertyList
 
     IAIMPString *url = nullptr;
     if (SUCCEEDED(FileInfo->GetValueAsObject(AIMP_FILEINFO_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
-        if (auto ti = Tools::TrackInfo(url)) {
-            if (!ti->Artwork.empty()) {
+        Config::TrackInfo ti;
+        if (Tools::TrackInfo(url, &ti)) {
+            if (!ti.Artwork.empty()) {
                 int maxFileSize = 0;
                 if (SUCCEEDED(Options->GetValueAsInt32(AIMP_SERVICE_ALBUMART_PROPID_FIND_IN_INTERNET_MAX_FILE_SIZE, &maxFileSize))) {
-                    AimpHTTP::DownloadImage(ti->Artwork, Image, maxFileSize);
+                    AimpHTTP::DownloadImage(ti.Artwork, Image, maxFileSize);
                     return *Image ? S_OK : E_FAIL;
                 }
             }
@@ -6,7 +6,10 @@
 #include "SDK/apiCore.h"
 #include "AimpHTTP.h"
 #include "Tools.h"
-#include <regex>
+#include "TrackCache.h"
+#include "Journal.h"
+#include "Timer.h"
+#include <algorithm>
 #include "rapidjson/document.h"
 #include "rapidjson/stringbuffer.h"
 #include "rapidjson/prettywriter.h"
@@ -15,11 +18,20 @@
 
 IAIMPConfig *Config::m_config = nullptr;
 std::wstring Config::m_configFolder;
+std::mutex Config::m_saveMutex;
+bool Config::m_saveScheduled = false;
+std::unordered_map<VideoId, std::vector<std::size_t>> Config::m_playlistOwners;
+const Config::Playlist *Config::m_playlistOwnersData = nullptr;
+std::size_t Config::m_playlistOwnersSize = 0;
+bool Config::m_playlistOwnersValid = false;
 
-std::unordered_set<std::wstring> Config::TrackExclusions;
+static const std::vector<std::size_t> NoPlaylists;
+
+VideoIdSet Config::TrackExclusions;
 std::vector<Config::MonitorUrl> Config::MonitorUrls;
 std::vector<Config::Playlist> Config::UserPlaylists;
-std::unordered_map<std::wstring, Config::TrackInfo> Config::TrackInfos;
+std::unordered_map<VideoId, Config::TrackInfo> Config::TrackInfos;
+std::mutex Config::TrackInfosMutex;
 
 bool Config::Init(IAIMPCore *core) {
     IAIMPString *str = nullptr;
@@ -32,6 +44,8 @@ bool Config::Init(IAIMPCore *core) {
 }
 
 void Config::Deinit() {
+    Journal::Close();
+    TrackCache::Close();
     if (m_config)
         m_config->Release();
 }
@@ -79,9 +93,41 @@ int32_t Config::GetInt32(const std::wstring &name, const int32_t &def) {
 }
 
 void Config::SaveExtendedConfig() {
-    std::wstring configFile = m_configFolder + L"Config.json";
+    // Changes go to the journal, Config.json is rewritten when it is compacted
+    ScheduleSave();
+}
+
+void Config::ScheduleSave() {
+    // Everything saved within SaveDelay ms is picked up by a single journal sync
+    std::unique_lock<std::mutex> lock(m_saveMutex);
+    if (m_saveScheduled)
+        return;
+
+    m_saveScheduled = true;
+    lock.unlock();
+
+    auto schedule = [] {
+        Timer::SingleShot((std::max)(0, GetInt32(L"SaveDelay", 2000)), Flush);
+    };
+    if (AimpHTTP::OnCompletionThread()) {
+        schedule();
+    } else if (!AimpHTTP::RunOnCompletionThread(schedule)) {
+        Flush();
+    }
+}
+
+void Config::Flush() {
+    std::unique_lock<std::mutex> lock(m_saveMutex);
+    m_saveScheduled = false;
+    lock.unlock();
+
+    Journal::Sync();
+}
+
+bool Config::WriteExtendedConfig(const std::wstring &configFile, const VideoIdSet &exclusions, const std::vector<MonitorUrl> &monitorUrls, const std::vector<Playlist> &playlists) {
+    std::wstring tempFile = configFile + L".tmp";
     FILE *file = nullptr;
-    if (_wfopen_s(&file, configFile.c_str(), L"wb") == 0) {
+    if (_wfopen_s(&file, tempFile.c_str(), L"wb") == 0) {
         using namespace rapidjson;
         char writeBuffer[65536];
 
@@ -91,31 +137,32 @@ void Config::SaveExtendedConfig() {
         writer.StartObject();
         writer.String(L"Exclusions");
         writer.StartArray();
-        for (const auto &trackId : TrackExclusions) {
-            writer.String(trackId.c_str());
+        for (const auto &trackId : exclusions) {
+            std::wstring id = trackId.ToString();
+            writer.String(id.c_str(), id.size());
         }
         writer.EndArray();
 
         writer.String(L"MonitorURLs");
         writer.StartArray();
-        for (const auto &monitorUrl : MonitorUrls) {
+        for (const auto &monitorUrl : monitorUrls) {
             writer << monitorUrl;
         }
         writer.EndArray();
 
         writer.String(L"UserPlaylists");
         writer.StartArray();
-        for (const auto &playlist : UserPlaylists) {
+        for (const auto &playlist : playlists) {
             writer << playlist;
         }
         writer.EndArray();
 
         writer.EndObject();
 
-        fclose(file);
+        if (fclose(file) == 0 && MoveFileEx(tempFile.c_str(), configFile.c_str(), MOVEFILE_REPLACE_EXISTING))
+            return true;
     }
-
-    SaveCache();
+    return false;
 }
 
 void Config::LoadExtendedConfig() {
@@ -165,32 +212,32 @@ void Config::LoadExtendedConfig() {
         fclose(file);
     }
     LoadCache();
+    Journal::Open();
 }
 
 void Config::SaveCache() {
-    std::wstring configFile = m_configFolder + L"Cache.json";
-    FILE *file = nullptr;
-    if (_wfopen_s(&file, configFile.c_str(), L"wb") == 0) {
-        using namespace rapidjson;
-        char writeBuffer[65536];
+    // Changed tracks go to the journal, Cache.bin is rewritten when it is compacted
+    ScheduleSave();
+}
 
-        FileWriteStream stream(file, writeBuffer, sizeof(writeBuffer));
-        Writer<decltype(stream), UTF16<>> writer(stream);
+void Config::LoadCache() {
+    std::lock_guard<std::mutex> lock(TrackInfosMutex);
+    TrackInfos.clear();
 
-        writer.StartObject();
-        for (const auto &ti : TrackInfos) {
-            writer.String(ti.first.c_str());
-            writer << ti.second;
-        }
-        writer.EndObject();
+    std::wstring cacheFile = m_configFolder + L"Cache.bin";
+    if (TrackCache::Open(cacheFile))
+        return;
 
-        fclose(file);
+    // First start with the binary cache, convert the old one
+    ImportJsonCache();
+    if (!TrackInfos.empty() && TrackCache::Save(cacheFile, TrackInfos)) {
+        std::wstring jsonFile = m_configFolder + L"Cache.json";
+        MoveFileEx(jsonFile.c_str(), (jsonFile + L".bak").c_str(), MOVEFILE_REPLACE_EXISTING);
+        TrackInfos.clear();
     }
 }
 
-void Config::LoadCache() {
-    TrackInfos.clear();
-
+void Config::ImportJsonCache() {
     std::wstring configFile = m_configFolder + L"Cache.json";
     FILE *file = nullptr;
     if (_wfopen_s(&file, configFile.c_str(), L"rb") == 0) {
@@ -204,60 +251,153 @@ void Config::LoadCache() {
         if (d.IsObject()) {
             for (auto x = d.MemberBegin(), e = d.MemberEnd(); x != e; x++) {
                 std::wstring id = (*x).name.GetString();
-                TrackInfos[id] = (*x).value;
-                TrackInfos[id].Id = id;
+                TrackInfo &ti = TrackInfos[id];
+                ti = (*x).value;
+                ti.Id = id;
             }
         }
         fclose(file);
     }
 }
 
-bool Config::ResolveTrackInfo(const std::wstring &id) {
-    std::wstring url(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + id);
-    url += L"&key=" TEXT(APP_KEY);
-    if (Plugin::instance()->isConnected())
-        url += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+Config::TrackInfo *Config::FindTrackInfo(const std::wstring &id) {
+    VideoId key(id);
+    auto it = TrackInfos.find(key);
+    if (it != TrackInfos.end())
+        return &it->second;
 
+    TrackInfo ti;
+    if (!TrackCache::Find(id, &ti))
+        return nullptr;
+
+    // Kept in memory from now on, callers hold on to the pointer
+    std::lock_guard<std::mutex> lock(TrackInfosMutex);
+    return &(TrackInfos[key] = ti);
+}
+
+bool Config::FindTrackInfo(const std::wstring &id, TrackInfo *info) {
+    std::unique_lock<std::mutex> lock(TrackInfosMutex);
+    auto it = TrackInfos.find(VideoId(id));
+    if (it != TrackInfos.end()) {
+        *info = it->second;
+        return true;
+    }
+    lock.unlock();
+
+    return TrackCache::Find(id, info);
+}
+
+bool Config::StoreTrackInfo(const std::wstring &id, const rapidjson::Value *item) {
     bool result = false;
     std::wstring title, artwork;
-    int64_t videoDuration = -1;
-    auto permalink = L"https://www.youtube.com/watch?v=" + id;
-
-    AimpHTTP::Get(url, [&](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
-
-        if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0) {
-            auto &snippet = d["items"][0]["snippet"];
-            auto &contentDetails = d["items"][0]["contentDetails"];
-
-            title = Tools::ToWString(snippet["title"]);
-            if (title != L"Deleted video" && title != L"Private video") {
-                if (contentDetails.IsObject() && contentDetails.HasMember("duration")) {
-                    std::wstring duration = Tools::ToWString(contentDetails["duration"]);
-
-                    std::wregex re(L"PT(?:([0-9]+)H)?(?:([0-9]+)M)?(?:([0-9]+)S)?");
-                    std::wsmatch match;
-                    if (std::regex_match(duration, match, re)) {
-                        auto h = match[1].matched ? std::stoll(match[1].str()) : 0;
-                        auto m = match[2].matched ? std::stoll(match[2].str()) : 0;
-                        auto s = match[3].matched ? std::stoll(match[3].str()) : 0;
-                        videoDuration = h * 3600 + m * 60 + s;
-                    }
-                }
-
-                if (snippet.HasMember("thumbnails") && snippet["thumbnails"].IsObject() && snippet["thumbnails"].HasMember("high") && snippet["thumbnails"]["high"].HasMember("url")) {
-                    artwork = Tools::ToWString(snippet["thumbnails"]["high"]["url"]);
-                }
+    double videoDuration = -1;
+    auto permalink = Tools::Permalink(id);
+
+    if (item && item->IsObject() && item->HasMember("snippet") && item->HasMember("contentDetails")) {
+        auto &snippet = (*item)["snippet"];
+        auto &contentDetails = (*item)["contentDetails"];
+
+        title = Tools::ToWString(snippet["title"]);
+        if (title != L"Deleted video" && title != L"Private video") {
+            if (contentDetails.IsObject() && contentDetails.HasMember("duration")) {
+                if (!Tools::ParseDuration(contentDetails["duration"], &videoDuration))
+                    videoDuration = -1;
+            }
 
-                result = true;
+            if (snippet.HasMember("thumbnails") && snippet["thumbnails"].IsObject() && snippet["thumbnails"].HasMember("high") && snippet["thumbnails"]["high"].HasMember("url")) {
+                artwork = Tools::ToWString(snippet["thumbnails"]["high"]["url"]);
             }
+
+            result = true;
         }
+    }
+
+    SetTrackInfo(id, TrackInfo(title, id, permalink, artwork, videoDuration));
+    return result;
+}
 
-        TrackInfos[id] = TrackInfo(title, id, permalink, artwork, videoDuration);
+void Config::SetTrackInfo(const VideoId &id, const TrackInfo &info) {
+    std::unique_lock<std::mutex> lock(TrackInfosMutex);
+    TrackInfos[id] = info;
+    lock.unlock();
+    Journal::TrackChanged(id);
+}
 
-        Config::SaveCache();
-    }, true);
+void Config::SetTrackExcluded(const VideoId &id, bool excluded) {
+    if (excluded ? TrackExclusions.insert(id).second : TrackExclusions.erase(id) > 0)
+        Journal::ExclusionChanged(id);
+}
 
-    return result;
+void Config::MonitorUrlsChanged() {
+    Journal::MonitorUrlsChanged();
+}
+
+void Config::UserPlaylistsChanged() {
+    m_playlistOwnersValid = false;
+    Journal::PlaylistsChanged();
+}
+
+void Config::UserPlaylistChanged(const Playlist &playlist) {
+    Journal::PlaylistChanged(playlist.ID);
+}
+
+void Config::IndexUserPlaylists() {
+    // Growing or swapping the vector moves the entries, that is caught here as well
+    if (m_playlistOwnersValid && m_playlistOwnersData == UserPlaylists.data() && m_playlistOwnersSize == UserPlaylists.size())
+        return;
+
+    m_playlistOwners.clear();
+    for (std::size_t i = 0; i < UserPlaylists.size(); ++i) {
+        for (const auto &x : UserPlaylists[i].Items) {
+            m_playlistOwners[x].push_back(i);
+        }
+    }
+    m_playlistOwnersData = UserPlaylists.data();
+    m_playlistOwnersSize = UserPlaylists.size();
+    m_playlistOwnersValid = true;
+}
+
+std::size_t Config::UserPlaylistIndex(const Playlist &playlist) {
+    for (std::size_t i = 0; i < UserPlaylists.size(); ++i) {
+        if (&UserPlaylists[i] == &playlist)
+            return i;
+    }
+    return std::size_t(-1);
+}
+
+const std::vector<std::size_t> &Config::UserPlaylistsWith(const VideoId &id) {
+    IndexUserPlaylists();
+    auto it = m_playlistOwners.find(id);
+    return it != m_playlistOwners.end() ? it->second : NoPlaylists;
+}
+
+void Config::AddUserPlaylistItem(Playlist &playlist, const VideoId &id) {
+    if (!playlist.Items.insert(id).second)
+        return;
+
+    Journal::PlaylistItemChanged(playlist, id, true);
+    if (!m_playlistOwnersValid)
+        return;
+
+    std::size_t index = UserPlaylistIndex(playlist);
+    if (index != std::size_t(-1))
+        m_playlistOwners[id].push_back(index);
+}
+
+void Config::RemoveUserPlaylistItem(Playlist &playlist, const VideoId &id) {
+    if (!playlist.Items.erase(id))
+        return;
+
+    Journal::PlaylistItemChanged(playlist, id, false);
+    if (!m_playlistOwnersValid)
+        return;
+
+    auto it = m_playlistOwners.find(id);
+    if (it == m_playlistOwners.end())
+        return;
+
+    auto &owners = it->second;
+    owners.erase(std::remove(owners.begin(), owners.end(), UserPlaylistIndex(playlist)), owners.end());
+    if (owners.empty())
+        m_playlistOwners.erase(it);
 }
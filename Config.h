@@ -4,7 +4,10 @@
 #include <unordered_set>
 #include <unordered_map>
 #include <vector>
+#include <mutex>
 #include "SDK/apiCore.h"
+#include "VideoId.h"
+#include "VideoIdSet.h"
 #include <cstdint>
 #include "rapidjson/document.h"
 #include "rapidjson/prettywriter.h"
@@ -21,8 +24,9 @@ public:
         std::wstring PlaylistID;
         int Flags;
         std::wstring GroupName;
+        std::wstring ETag; // Of the first playlistItems page at the last sweep
+        std::wstring LastPublishedAt; // Newest publishedAt seen so far
 
-        typedef rapidjson::PrettyWriter<rapidjson::FileWriteStream, rapidjson::UTF16<>> Writer;
         typedef rapidjson::GenericValue<rapidjson::UTF16<>> Value;
 
         MonitorUrl(const std::wstring &url, const std::wstring &playlistID, int flags, const std::wstring &groupName = std::wstring())
@@ -36,10 +40,15 @@ public:
                 Flags = v[L"Flags"].GetInt();
                 PlaylistID = v[L"PlaylistID"].GetString();
                 GroupName = v[L"GroupName"].GetString();
+                if (v.HasMember(L"ETag") && v[L"ETag"].IsString())
+                    ETag = v[L"ETag"].GetString();
+                if (v.HasMember(L"LastPublishedAt") && v[L"LastPublishedAt"].IsString())
+                    LastPublishedAt = v[L"LastPublishedAt"].GetString();
             }
         }
 
-        friend Writer &operator <<(Writer &writer, const MonitorUrl &that) {
+        template <typename W>
+        friend W &operator <<(W &writer, const MonitorUrl &that) {
             writer.StartObject();
 
             writer.String(L"URL");
@@ -54,6 +63,12 @@ public:
             writer.String(L"GroupName");
             writer.String(that.GroupName.c_str(), that.GroupName.size());
 
+            writer.String(L"ETag");
+            writer.String(that.ETag.c_str(), that.ETag.size());
+
+            writer.String(L"LastPublishedAt");
+            writer.String(that.LastPublishedAt.c_str(), that.LastPublishedAt.size());
+
             writer.EndObject();
             return writer;
         }
@@ -63,11 +78,10 @@ public:
         std::wstring Title;
         std::wstring ChannelName;
         std::wstring ReferenceName;
-        std::unordered_set<std::wstring> Items;
+        std::unordered_set<VideoId> Items;
         bool CanModify;
         std::wstring AIMPPlaylistId;
 
-        typedef rapidjson::PrettyWriter<rapidjson::FileWriteStream, rapidjson::UTF16<>> Writer;
         typedef rapidjson::GenericValue<rapidjson::UTF16<>> Value;
 
         Playlist(const std::wstring &id, const std::wstring &title, bool canModify, const std::wstring &refName = std::wstring(), const std::wstring &channelName = std::wstring())
@@ -90,7 +104,8 @@ public:
             }
         }
 
-        friend Writer &operator <<(Writer &writer, const Playlist &that) {
+        template <typename W>
+        friend W &operator <<(W &writer, const Playlist &that) {
             writer.StartObject();
 
             writer.String(L"ID");
@@ -114,7 +129,8 @@ public:
             writer.String(L"Items");
             writer.StartArray();
             for (auto &x : that.Items) {
-                writer.String(x.c_str(), x.size());
+                std::wstring id = x.ToString();
+                writer.String(id.c_str(), id.size());
             }
             writer.EndArray();
 
@@ -129,7 +145,6 @@ public:
         std::wstring Artwork;
         double Duration;
 
-        typedef rapidjson::Writer<rapidjson::FileWriteStream, rapidjson::UTF16<>> Writer;
         typedef rapidjson::GenericValue<rapidjson::UTF16<>> Value;
 
         TrackInfo() : Duration(0) {}
@@ -138,6 +153,10 @@ public:
 
         }
 
+        bool operator ==(const TrackInfo &that) const {
+            return Id == that.Id && Name == that.Name && Permalink == that.Permalink && Artwork == that.Artwork && Duration == that.Duration;
+        }
+
         TrackInfo(const Value &v) {
             if (v.IsObject()) {
                 Name      = v[L"N"].GetString();
@@ -147,7 +166,8 @@ public:
             }
         }
 
-        friend Writer &operator <<(Writer &writer, const TrackInfo &that) {
+        template <typename W>
+        friend W &operator <<(W &writer, const TrackInfo &that) {
             writer.StartObject();
 
             writer.String(L"N");
@@ -184,21 +204,57 @@ public:
 
     static void SaveExtendedConfig();
     static void LoadExtendedConfig();
+    static bool WriteExtendedConfig(const std::wstring &configFile, const VideoIdSet &exclusions, const std::vector<MonitorUrl> &monitorUrls, const std::vector<Playlist> &playlists);
 
     static void SaveCache();
+    // Writes whatever SaveExtendedConfig/SaveCache left pending right away
+    static void Flush();
     static void LoadCache();
-    static bool ResolveTrackInfo(const std::wstring &id);
-
-    static std::unordered_set<std::wstring> TrackExclusions;
+    // Main thread only, the info is kept in TrackInfos from now on
+    static TrackInfo *FindTrackInfo(const std::wstring &id);
+    // Any thread, copies the info and leaves TrackInfos as it is
+    static bool FindTrackInfo(const std::wstring &id, TrackInfo *info);
+    static bool StoreTrackInfo(const std::wstring &id, const rapidjson::Value *item);
+    // Main thread only, replaces the info and journals it
+    static void SetTrackInfo(const VideoId &id, const TrackInfo &info);
+    static void SetTrackExcluded(const VideoId &id, bool excluded);
+    // Call after changing MonitorUrls
+    static void MonitorUrlsChanged();
+
+    // Indices into UserPlaylists of the playlists holding the video
+    static const std::vector<std::size_t> &UserPlaylistsWith(const VideoId &id);
+    static void AddUserPlaylistItem(Playlist &playlist, const VideoId &id);
+    static void RemoveUserPlaylistItem(Playlist &playlist, const VideoId &id);
+    // Call after replacing UserPlaylists or any of its entries, items go through Add/RemoveUserPlaylistItem
+    static void UserPlaylistsChanged();
+    // Call after changing the fields of one entry
+    static void UserPlaylistChanged(const Playlist &playlist);
+
+    static VideoIdSet TrackExclusions;
     static std::vector<MonitorUrl> MonitorUrls;
     static std::vector<Playlist> UserPlaylists;
-    static std::unordered_map<std::wstring, TrackInfo> TrackInfos;
+    // Tracks looked up or added since startup, the rest stays in the mapped Cache.bin until asked for.
+    // Only the main thread changes it, holding TrackInfosMutex; other threads hold it to read.
+    static std::unordered_map<VideoId, TrackInfo> TrackInfos;
+    static std::mutex TrackInfosMutex;
 
 private:
     Config();
     Config(const Config&);
     Config& operator=(const Config&);
 
+    static void ImportJsonCache();
+    static void ScheduleSave();
+    static void IndexUserPlaylists();
+    static std::size_t UserPlaylistIndex(const Playlist &playlist);
+
     static std::wstring m_configFolder;
     static IAIMPConfig *m_config;
+    static std::mutex m_saveMutex;
+    static bool m_saveScheduled;
+
+    static std::unordered_map<VideoId, std::vector<std::size_t>> m_playlistOwners;
+    static const Playlist *m_playlistOwnersData;
+    static std::size_t m_playlistOwnersSize;
+    static bool m_playlistOwnersValid;
 };
@@ -0,0 +1,260 @@
+#include "ConnectionPool.h"
+#include "HttpResponseParser.h"
+#include <algorithm>
+
+std::mutex ConnectionPool::m_mutex;
+std::condition_variable ConnectionPool::m_cv;
+std::vector<std::thread> ConnectionPool::m_workers;
+std::deque<ConnectionPool::Job> ConnectionPool::m_queue;
+int ConnectionPool::m_workerCount = 2;
+bool ConnectionPool::m_started = false;
+bool ConnectionPool::m_stop = false;
+std::unordered_map<std::string, ConnectionPool::Address> ConnectionPool::m_addresses;
+std::unordered_map<std::string, std::vector<ConnectionPool::Connection>> ConnectionPool::m_idle;
+std::set<ConnectionPool::Socket> ConnectionPool::m_active;
+
+void ConnectionPool::Init(int workers) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_workerCount = (std::max)(1, workers);
+}
+
+bool ConnectionPool::Submit(const std::string &host, unsigned short port, const std::string &request, CallbackFunc callback) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_stop)
+        return false;
+
+    if (!m_started) {
+        if (!Net::Startup())
+            return false;
+        m_started = true;
+
+        for (int i = 0; i < m_workerCount; ++i)
+            m_workers.push_back(std::thread(Worker));
+    }
+
+    Job job = { host, port, request, callback };
+    m_queue.push_back(job);
+    m_cv.notify_one();
+    return true;
+}
+
+void ConnectionPool::Deinit() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_started)
+        return;
+
+    m_stop = true;
+    m_queue.clear();
+    for (auto x : m_active)
+        Net::Shutdown(x);
+    m_cv.notify_all();
+
+    std::vector<std::thread> workers;
+    workers.swap(m_workers);
+    lock.unlock();
+    for (auto &x : workers)
+        x.join();
+
+    lock.lock();
+    for (const auto &x : m_idle) {
+        for (const auto &c : x.second)
+            Net::Close(c.Handle);
+    }
+    m_idle.clear();
+    m_addresses.clear();
+    m_started = false;
+    m_stop = false;
+    lock.unlock();
+
+    Net::Cleanup();
+}
+
+void ConnectionPool::Worker() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_cv.wait(lock, [] { return m_stop || !m_queue.empty(); });
+        if (m_stop)
+            return;
+
+        Job job = m_queue.front();
+        m_queue.pop_front();
+        lock.unlock();
+        Run(job);
+        lock.lock();
+    }
+}
+
+void ConnectionPool::Run(const Job &job) {
+    // The server may have closed a pooled connection in the meantime, the request is retried once on a new one
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        bool reused = false;
+        Socket s = Acquire(job.Host, job.Port, &reused);
+        if (s == Net::Invalid)
+            break;
+
+        std::string body;
+        bool keepAlive = false, received = false;
+        if (!Exchange(s, job.Request, body, &keepAlive, &received)) {
+            Close(s);
+            if (reused && !received)
+                continue;
+
+            Net::Trace("Could not complete the request to " + job.Host + "\n");
+            break;
+        }
+
+        if (keepAlive) {
+            Release(job.Host, job.Port, s);
+        } else {
+            Close(s);
+        }
+
+        if (job.Callback)
+            job.Callback(reinterpret_cast<unsigned char *>(&body[0]), int(body.size()));
+        return;
+    }
+
+    // Requests cut short by Deinit() don't call back, like those of the AIMP client after AimpHTTP::Deinit()
+    std::unique_lock<std::mutex> lock(m_mutex);
+    bool stopping = m_stop;
+    lock.unlock();
+    if (!stopping && job.Callback)
+        job.Callback(nullptr, 0);
+}
+
+bool ConnectionPool::Resolve(const std::string &host, uint32_t *ip) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_addresses.find(host);
+    if (it != m_addresses.end() && Net::Ticks() - it->second.Resolved < DnsTtl) {
+        *ip = it->second.Ip;
+        return true;
+    }
+    lock.unlock();
+
+    if (!Net::Resolve(host, ip))
+        return false;
+
+    lock.lock();
+    Address address = { *ip, Net::Ticks() };
+    m_addresses[host] = address;
+    return true;
+}
+
+ConnectionPool::Socket ConnectionPool::Acquire(const std::string &host, unsigned short port, bool *reused) {
+    std::string key = host + ":" + std::to_string(port);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_idle.find(key);
+    if (it != m_idle.end()) {
+        // Most recently used first, it is the least likely to have been closed by the server
+        uint32_t now = Net::Ticks();
+        while (!it->second.empty()) {
+            Connection c = it->second.back();
+            it->second.pop_back();
+            if (now - c.Since < IdleTimeout) {
+                m_active.insert(c.Handle);
+                *reused = true;
+                return c.Handle;
+            }
+            Net::Close(c.Handle);
+        }
+    }
+    lock.unlock();
+    *reused = false;
+
+    uint32_t ip = 0;
+    if (!Resolve(host, &ip)) {
+        Net::Trace("Could not resolve the Host Name\n");
+        return Net::Invalid;
+    }
+
+    Socket s = Net::Connect(ip, port, IoTimeout);
+    if (s == Net::Invalid) {
+        // The cached address may be stale
+        lock.lock();
+        m_addresses.erase(host);
+        return Net::Invalid;
+    }
+
+    lock.lock();
+    if (m_stop) {
+        Net::Close(s);
+        return Net::Invalid;
+    }
+    m_active.insert(s);
+    return s;
+}
+
+void ConnectionPool::Release(const std::string &host, unsigned short port, Socket s) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_active.erase(s);
+
+    auto &idle = m_idle[host + ":" + std::to_string(port)];
+    uint32_t now = Net::Ticks();
+    for (auto it = idle.begin(); it != idle.end();) {
+        if (now - it->Since >= IdleTimeout) {
+            Net::Close(it->Handle);
+            it = idle.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_stop || idle.size() >= MaxIdlePerHost) {
+        Net::Close(s);
+        return;
+    }
+    Connection c = { s, now };
+    idle.push_back(c);
+}
+
+void ConnectionPool::Close(Socket s) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_active.erase(s);
+    lock.unlock();
+    Net::Close(s);
+}
+
+bool ConnectionPool::Exchange(Socket s, const std::string &request, std::string &body, bool *keepAlive, bool *received) {
+    *keepAlive = false;
+    *received = false;
+    for (std::size_t sent = 0; sent < request.size();) {
+        int n = Net::Send(s, request.data() + sent, int(request.size() - sent));
+        if (n <= 0)
+            return false;
+        sent += n;
+    }
+
+    // body is grown ahead of a known body length and only filled up to filled
+    std::size_t filled = 0;
+    HttpResponseParser parser([&body](const char *data, std::size_t size) { body.append(data, size); });
+    char buffer[16384];
+    while (!parser.Done()) {
+        int n;
+        if (std::size_t direct = parser.Direct()) {
+            // The rest of a Content-Length body or chunk is received in place
+            if (filled == body.size())
+                body.resize(filled + (std::min)(direct, MaxDirect));
+            n = Net::Receive(s, &body[filled], int((std::min)(direct, body.size() - filled)));
+            if (n > 0) {
+                filled += n;
+                parser.Advance(n);
+            }
+        } else {
+            n = Net::Receive(s, buffer, sizeof(buffer));
+            if (n > 0 && !parser.Feed(buffer, n))
+                return false;
+            filled = body.size();
+        }
+
+        if (n <= 0) {
+            // Closed (or timed out), that only ends a response without length
+            body.resize(filled);
+            return n == 0 && parser.Finish();
+        }
+        *received = true;
+    }
+
+    body.resize(filled);
+    *keepAlive = parser.KeepAlive();
+    return true;
+}
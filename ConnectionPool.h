@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <cstdint>
+#include "Net.h"
+
+// Plain HTTP requests the AIMP HTTP client can't send (AimpHTTP::Put/Delete). They are queued to a fixed set
+// of worker threads, started on first use, which reuse keep-alive connections kept per host:port and
+// cache resolved host addresses for DnsTtl. Callbacks run on the worker thread.
+class ConnectionPool {
+public:
+    typedef std::function<void(unsigned char *, int)> CallbackFunc;
+
+    // Number of worker threads started by the first Submit
+    static void Init(int workers);
+    static void Deinit();
+
+    // request is the complete request head (and body), the callback gets the response body,
+    // or nullptr and 0 when the request failed
+    static bool Submit(const std::string &host, unsigned short port, const std::string &request, CallbackFunc callback);
+
+private:
+    typedef Net::Socket Socket;
+
+    struct Job {
+        std::string Host;
+        unsigned short Port;
+        std::string Request;
+        CallbackFunc Callback;
+    };
+    struct Connection {
+        Socket Handle;
+        uint32_t Since;
+    };
+    struct Address {
+        uint32_t Ip;
+        uint32_t Resolved;
+    };
+
+    static void Worker();
+    static void Run(const Job &job);
+    static bool Resolve(const std::string &host, uint32_t *ip);
+    static Socket Acquire(const std::string &host, unsigned short port, bool *reused);
+    static void Release(const std::string &host, unsigned short port, Socket s);
+    static void Close(Socket s);
+    static bool Exchange(Socket s, const std::string &request, std::string &body, bool *keepAlive, bool *received);
+
+    ConnectionPool();
+    ConnectionPool(const ConnectionPool &);
+    ConnectionPool &operator=(const ConnectionPool &);
+
+    static const uint32_t DnsTtl = 5 * 60 * 1000;
+    static const uint32_t IdleTimeout = 30 * 1000;
+    static const std::size_t MaxIdlePerHost = 4;
+    static const int IoTimeout = 15 * 1000;
+    static const std::size_t MaxDirect = 1024 * 1024;
+
+    static std::mutex m_mutex;
+    static std::condition_variable m_cv;
+    static std::vector<std::thread> m_workers;
+    static std::deque<Job> m_queue;
+    static int m_workerCount;
+    static bool m_started;
+    static bool m_stop;
+
+    static std::unordered_map<std::string, Address> m_addresses;
+    static std::unordered_map<std::string, std::vector<Connection>> m_idle;
+    // Sockets a worker is using, shut down by Deinit to unblock it
+    static std::set<Socket> m_active;
+};
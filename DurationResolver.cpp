@@ -1,8 +1,9 @@
 #include "DurationResolver.h"
 #include "Tools.h"
 #include "AimpHTTP.h"
+#include "JsonResponse.h"
+#include "TrackInfoResolver.h"
 #include "AIMPYouTube.h"
-#include <regex>
 #include <cmath>
 #include <unordered_map>
 #include <memory>
@@ -17,13 +18,20 @@ void DurationResolver::AddPlaylist(IAIMPPlaylist *pl) {
             if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILEINFO, IID_IAIMPFileInfo, reinterpret_cast<void **>(&finfo)))) {
                 IAIMPString *custom = nullptr;
                 if (SUCCEEDED(finfo->GetValueAsObject(AIMP_FILEINFO_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&custom)))) {
-                    if (auto ti = Tools::TrackInfo(custom)) {
-                        if (ti->Duration <= 0) {
-                            Item itm;
-                            itm.FileInfo = finfo;
-                            itm.Id = ti->Id;
-                            m_items.push_back(itm);
-                        }
+                    std::wstring id = Tools::TrackIdFromUrl(custom->GetData());
+                    auto ti = id.empty() ? nullptr : Config::FindTrackInfo(id);
+                    if (ti && ti->Duration <= 0) {
+                        Item itm;
+                        itm.FileInfo = finfo;
+                        itm.Id = ti->Id;
+                        m_items.push_back(itm);
+                    } else if (!ti && !id.empty()) {
+                        // The resolved info carries the duration already
+                        TrackInfoResolver::Resolve(id, [finfo](Config::TrackInfo *ti) {
+                            if (ti && ti->Duration > 0)
+                                finfo->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, ti->Duration);
+                            finfo->Release();
+                        });
                     }
                     custom->Release();
                 }
@@ -36,10 +44,10 @@ void DurationResolver::AddPlaylist(IAIMPPlaylist *pl) {
 
 void DurationResolver::Resolve() {
     std::wstring allIds;
-    auto map = std::make_shared<std::unordered_map<std::wstring, IAIMPFileInfo *>>();
+    auto map = std::make_shared<std::unordered_map<VideoId, IAIMPFileInfo *>>();
     int n = (std::min)(std::size_t(50), m_items.size());
     for (int i = 0; i < n; ++i) {
-        allIds += m_items[i].Id + L",";
+        allIds += m_items[i].Id.ToString() + L",";
         (*map)[m_items[i].Id] = m_items[i].FileInfo;
     }
     m_items.erase(m_items.begin(), m_items.begin() + n);
@@ -52,9 +60,10 @@ void DurationResolver::Resolve() {
         if (Plugin::instance()->isConnected())
             reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
 
-        AimpHTTP::Get(reqUrl, [map](unsigned char *data, int size) {
-            rapidjson::Document d;
-            d.Parse(reinterpret_cast<const char *>(data));
+        // Completed on the main thread, which owns Config::TrackInfos
+        AimpHTTP::GetAsync(reqUrl)->Then([map](unsigned char *data, int size) {
+            JsonResponse response(data, size);
+            rapidjson::Document &d = *response;
 
             if (d.IsObject() && d.HasMember("items")) {
                 rapidjson::Value &a = d["items"];
@@ -66,18 +75,9 @@ void DurationResolver::Resolve() {
 
                         const rapidjson::Value &contentDetails = (*px)["contentDetails"];
 
-                        int videoDuration = 0;
+                        double videoDuration = 0;
                         if (contentDetails.IsObject() && contentDetails.HasMember("duration")) {
-                            std::wstring duration = Tools::ToWString(contentDetails["duration"]);
-
-                            std::wregex re(L"PT(?:([0-9]+)H)?(?:([0-9]+)M)?(?:([0-9]+)S)?");
-                            std::wsmatch match;
-                            if (std::regex_match(duration, match, re)) {
-                                auto h = match[1].matched ? std::stoll(match[1].str()) : 0;
-                                auto m = match[2].matched ? std::stoll(match[2].str()) : 0;
-                                auto s = match[3].matched ? std::stoll(match[3].str()) : 0;
-                                videoDuration = h * 3600 + m * 60 + s;
-
+                            if (Tools::ParseDuration(contentDetails["duration"], &videoDuration)) {
                                 std::wstring id = Tools::ToWString((*px)["id"].GetString());
                                 if (auto finfo = (*map)[id]) {
                                     finfo->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, videoDuration);
@@ -86,8 +86,10 @@ void DurationResolver::Resolve() {
                                     finfo->Release();
                                 }
 
-                                if (auto ti = Tools::TrackInfo(id)) {
-                                    ti->Duration = videoDuration;
+                                if (auto ti = Config::FindTrackInfo(id)) {
+                                    Config::TrackInfo info(*ti);
+                                    info.Duration = videoDuration;
+                                    Config::SetTrackInfo(id, info);
                                 }
                             }
                         }
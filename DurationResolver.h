@@ -1,6 +1,7 @@
 #pragma once
 
 #include <vector>
+#include "VideoId.h"
 #include "SDK/apiPlaylists.h"
 #include "SDK/apiFileManager.h"
 
@@ -13,7 +14,7 @@ public:
 
     struct Item {
         IAIMPFileInfo *FileInfo;
-        std::wstring Id;
+        VideoId Id;
     };
     static std::vector<Item> m_items;
 };
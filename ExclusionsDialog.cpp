@@ -5,6 +5,7 @@
 #include "GdiPlusImageLoader.h"
 #include "AIMPYouTube.h"
 #include "OptionsDialog.h"
+#include "TrackInfoResolver.h"
 #include <Commctrl.h>
 #include <unordered_map>
 #include <memory>
@@ -35,6 +36,30 @@ void ExclusionsDialog::Show(HWND parent) {
     DialogBox(g_hInst, MAKEINTRESOURCE(IDD_EXCLUSIONS), parent, DlgProc);
 }
 
+void ExclusionsDialog::AddItem(HWND lv, Config::TrackInfo *ti) {
+    if (!ti || ti->Duration < 0)
+        return;
+
+    LVITEM lvi;
+    lvi.mask = LVIF_TEXT | LVIF_PARAM;
+    lvi.pszText = const_cast<wchar_t *>(ti->Name.c_str());
+    lvi.iItem = 0;
+    lvi.iSubItem = 0;
+    lvi.iImage = 0;
+    lvi.lParam = reinterpret_cast<LPARAM>(ti);
+    int i = ListView_InsertItem(lv, &lvi);
+
+    wchar_t buf[16];
+    unsigned int hours = floor(ti->Duration / 3600.0);
+    if (hours > 0) {
+        swprintf_s(buf, L"%d:%02d:%02d", hours, (uint32_t)floor(fmod(ti->Duration, 3600.0) / 60.0), (uint32_t)floor(fmod(ti->Duration, 60.0)));
+    } else {
+        swprintf_s(buf, L"%d:%02d", (uint32_t)floor(fmod(ti->Duration, 3600.0) / 60.0), (uint32_t)floor(fmod(ti->Duration, 60.0)));
+    }
+
+    ListView_SetItemText(lv, i, 1, buf);
+}
+
 BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM lParam) {
     switch (Msg) {
         case WM_CLOSE:
@@ -79,7 +104,7 @@ BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPAR
                                 if (auto ti = reinterpret_cast<Config::TrackInfo *>(selectedItem.lParam)) {
                                     switch (result) {
                                         case 0x57d001: // remove from exclusions
-                                            Config::TrackExclusions.erase(ti->Id);
+                                            Config::SetTrackExcluded(ti->Id, false);
                                             ListView_DeleteItem(lv, i--);
                                         break;
                                         case 0x57d003: // open in web browser
@@ -88,7 +113,7 @@ BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPAR
                                         break;
                                         default:
                                             if (auto pl = plMap[result]) {
-                                                Config::TrackExclusions.erase(ti->Id);
+                                                Config::SetTrackExcluded(ti->Id, false);
 
                                                 auto state = std::make_shared<YouTubeAPI::LoadingState>();
                                                 std::wstring url = L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + ti->Id;
@@ -143,31 +168,18 @@ BOOL CALLBACK ExclusionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPAR
             ImageList_Add(himl, hbIcon, (HBITMAP)NULL);
             DeleteObject(hbIcon);
 
-            LVITEM lvi;
-            lvi.mask = LVIF_TEXT | LVIF_PARAM;
-
-            int i = 0;
-            wchar_t buf[16];
-            for (auto x : Config::TrackExclusions) {
-                if (auto ti = Tools::TrackInfo(x)) {
-                    if (ti->Duration >= 0) {
-                        lvi.pszText = const_cast<wchar_t *>(ti->Name.c_str());
-                        lvi.iItem = i;
-                        lvi.iSubItem = 0;
-                        lvi.iImage = 0;
-                        lvi.lParam = reinterpret_cast<LPARAM>(ti);
-                        ListView_InsertItem(lv, &lvi);
-
-                        unsigned int hours = floor(ti->Duration / 3600.0);
-                        if (hours > 0) {
-                            swprintf_s(buf, L"%d:%02d:%02d", hours, (uint32_t)floor(fmod(ti->Duration, 3600.0) / 60.0), (uint32_t)floor(fmod(ti->Duration, 60.0)));
-                        } else {
-                            swprintf_s(buf, L"%d:%02d", (uint32_t)floor(fmod(ti->Duration, 3600.0) / 60.0), (uint32_t)floor(fmod(ti->Duration, 60.0)));
-                        }
-
-                        ListView_SetItemText(lv, i, 1, buf);
-                    }
+            for (const auto &trackId : Config::TrackExclusions) {
+                std::wstring x = trackId.ToString();
+                if (auto ti = Config::FindTrackInfo(x)) {
+                    AddItem(lv, ti);
+                    continue;
                 }
+
+                // Unknown tracks are listed as their info arrives
+                TrackInfoResolver::Resolve(x, [lv](Config::TrackInfo *ti) {
+                    if (IsWindow(lv))
+                        AddItem(lv, ti);
+                });
             }
 
             ListView_SetImageList(lv, himl, LVSIL_SMALL);
@@ -202,7 +214,7 @@ LRESULT CALLBACK ExclusionsDialog::ListViewProc(HWND hWnd, UINT uMsg, WPARAM wPa
                             ListView_GetItem(hWnd, (LVITEM *)&selectedItem);
 
                             if (auto ti = reinterpret_cast<Config::TrackInfo *>(selectedItem.lParam)) {
-                                Config::TrackExclusions.erase(ti->Id);
+                                Config::SetTrackExcluded(ti->Id, false);
                                 ListView_DeleteItem(hWnd, i--);
                             }
                             i = ListView_GetNextItem(hWnd, i, LVNI_SELECTED);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <windows.h>
+#include "Config.h"
 
 class ExclusionsDialog {
 public:
@@ -11,6 +12,8 @@ private:
     ExclusionsDialog(const ExclusionsDialog &);
     ExclusionsDialog &operator=(const ExclusionsDialog &);
 
+    static void AddItem(HWND lv, Config::TrackInfo *ti);
+
     static BOOL CALLBACK DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM lParam);
     static LRESULT CALLBACK ListViewProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam, UINT_PTR uIdSubclass, DWORD_PTR dwRefData);
 };
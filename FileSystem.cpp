@@ -2,27 +2,52 @@
 #include "Config.h"
 #include "AIMPYoutube.h"
 #include "YouTubeAPI.h"
+#include "Prefetcher.h"
 #include <algorithm>
 #include <windows.h>
 
-HRESULT WINAPI FileSystem::HTTPStream::SetSize(const INT64 Value) {
-    m_size = Value;
+FileSystem::HTTPStream::~HTTPStream() {
     if (m_buffer) {
-        delete[] m_buffer;
+        m_buffer->Close();
+        if (m_taskId && !m_buffer->IsComplete())
+            m_httpClient->Cancel(m_taskId, 0);
     }
-    m_buffer = new unsigned char[m_size];
-    return S_OK;
-}
-FileSystem::HTTPStream::~HTTPStream() {
-    delete[] m_buffer;
 }
-void FileSystem::HTTPStream::Wait() {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    m_cv.wait(lock);
+bool FileSystem::HTTPStream::Open(INT64 offset) {
+    std::size_t capacity = std::size_t(Config::GetInt32(L"StreamBufferSize", 4096)) * 1024;
+    std::size_t high = capacity / 100 * Config::GetInt32(L"StreamBufferHighWatermark", 90);
+    std::size_t low = capacity / 100 * Config::GetInt32(L"StreamBufferLowWatermark", 50);
+    m_buffer = std::make_shared<RingBuffer>(capacity, high, low, offset);
+
+    std::wstring url(m_url);
+    if (offset > 0)
+        url += L"\r\nRange: bytes=" + std::to_wstring(offset) + L"-";
+
+    EventListener *listener = new EventListener(m_buffer, m_cache, offset);
+    listener->AddRef();
+    m_taskId = nullptr;
+    if (FAILED(m_httpClient->Get(AIMPString(url), 0, listener->m_sink, listener, nullptr, &m_taskId))) {
+        // OnComplete won't run to release the sink
+        listener->m_sink->Release();
+        listener->Release();
+        return false;
+    }
+    listener->Release();
+    if (!m_buffer->WaitForSize())
+        return false;
+
+    if (m_size < 0)
+        m_size = m_buffer->Size();
+    return true;
 }
-void FileSystem::HTTPStream::Signal() {
-    std::unique_lock<std::mutex> lock(m_mutex);
-    m_cv.notify_all();
+void FileSystem::HTTPStream::Park() {
+    m_buffer->Close();
+    if (m_taskId && !m_buffer->IsComplete())
+        m_httpClient->Cancel(m_taskId, 0);
+
+    m_spans.push_front(m_buffer);
+    while (m_spans.size() > MaxParkedSpans)
+        m_spans.pop_back();
 }
 HRESULT WINAPI FileSystem::HTTPStream::Seek(const INT64 Offset, int Mode) {
     switch (Mode) {
@@ -30,40 +55,88 @@ HRESULT WINAPI FileSystem::HTTPStream::Seek(const INT64 Offset, int Mode) {
         case AIMP_STREAM_SEEKMODE_FROM_BEGINNING: m_position = Offset; break;
         case AIMP_STREAM_SEEKMODE_FROM_END:       m_position = m_size - Offset; break;
     }
+    m_buffer->Seek(m_position);
     return S_OK;
 }
 int WINAPI FileSystem::HTTPStream::Read(unsigned char *Buffer, unsigned int Count) {
-    while (m_bufferSize - m_position <= 0 && m_bufferSize < m_size)
-        Wait();
+    if (m_size >= 0 && m_position >= m_size)
+        return 0;
+
+    if (m_cache && m_position < m_cache->Size()) {
+        if (int read = m_cache->Read(m_position, Buffer, Count)) {
+            m_position += read;
+            return read;
+        }
+    }
+
+    if (!m_buffer->IsNear(m_position, SeekThreshold)) {
+        for (auto &span : m_spans) {
+            if (span->Contains(m_position)) {
+                int read = span->Read(m_position, Buffer, Count);
+                m_position += read;
+                return read;
+            }
+        }
 
-    Count = min(Count, m_bufferSize - m_position);
+        // Nothing downloaded around the new position, restart the transfer from there
+        Park();
+        if (!Open(m_position))
+            return 0;
+    }
 
-    memcpy(Buffer, m_buffer + m_position, Count);
-    m_position += Count;
+    int read = m_buffer->Read(m_position, Buffer, Count);
+    m_position += read;
 
-    return Count;
+    return read;
 }
-HRESULT WINAPI FileSystem::HTTPStream::Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written) {
-    memcpy(m_buffer + m_bufferSize, Buffer, Count);
-    m_bufferSize += Count;
-    Signal();
 
+HRESULT WINAPI FileSystem::Sink::Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written) {
+    if (m_cache)
+        m_cache->Append(m_buffer->Offset() + m_written, Buffer, Count);
+
+    if (!m_buffer->Write(Buffer, Count))
+        return E_ABORT;
+
+    m_written += Count;
+    if (Written)
+        *Written = Count;
     return S_OK;
 }
 
-FileSystem::EventListener::EventListener() {
-    m_stream = new FileSystem::HTTPStream();
-    m_stream->AddRef();
+// HTTP/1.1 206 Partial Content, falls back to looking for Content-Range if there is no status line
+static bool IsPartialContent(const wchar_t *headers) {
+    if (wcsncmp(headers, L"HTTP/", 5) == 0) {
+        const wchar_t *status = wcschr(headers, L' ');
+        return status && _wtoi(status + 1) == 206;
+    }
+    return Tools::HeaderValue(headers, L"Content-Range", nullptr);
+}
+
+FileSystem::EventListener::EventListener(std::shared_ptr<RingBuffer> buffer, std::shared_ptr<StreamCache::File> cache, INT64 offset)
+    : m_buffer(buffer), m_cache(cache), m_offset(offset) {
+    m_sink = new FileSystem::Sink(buffer, cache);
+    m_sink->AddRef();
 }
 void WINAPI FileSystem::EventListener::OnAccept(IAIMPString *ContentType, const INT64 ContentSize, BOOL *Allow) {
     ContentType->AddRef();
     ContentType->Release();
     *Allow = true;
-    m_stream->SetSize(ContentSize);
-    m_stream->Signal();
+    m_buffer->SetSize(ContentSize);
+    if (m_cache && ContentSize >= 0)
+        m_cache->SetTotalSize(m_buffer->Size()); // Offset of a ranged response included
+}
+void WINAPI FileSystem::EventListener::OnAcceptHeaders(IAIMPString *Header, BOOL *Allow) {
+    if (m_offset > 0 && !IsPartialContent(Header->GetData())) {
+        // Server ignored the Range header and sends the whole stream
+        m_buffer->SetOffset(0);
+    }
+    *Allow = true;
 }
 void WINAPI FileSystem::EventListener::OnComplete(IAIMPErrorInfo *ErrorInfo, BOOL Canceled) {
-
+    m_buffer->Complete();
+    if (m_cache && !Canceled && !ErrorInfo)
+        m_cache->Commit(m_buffer->Size());
+    m_sink->Release();
 }
 void WINAPI FileSystem::EventListener::OnProgress(const INT64 Downloaded, const INT64 Total) {
 
@@ -94,25 +167,43 @@ HRESULT WINAPI FileSystem::GetValueAsObject(int PropertyID, REFIID IID, void **V
 }
 
 HRESULT WINAPI FileSystem::CreateStream(IAIMPString *FileName, IAIMPStream **Stream) {
-    HRESULT ret = E_FAIL;
-    if (Config::TrackInfo *ti = Tools::TrackInfo(FileName)) {
-        EventListener *listener = new EventListener();
-        *Stream = listener->m_stream;
-
-        std::wstring url = YouTubeAPI::GetStreamUrl(ti->Id);
+    // Only the id is needed, the track info may not have been fetched yet
+    std::wstring id = Tools::TrackIdFromUrl(FileName->GetData());
+    if (!id.empty()) {
+        std::wstring cached = StreamCache::Lookup(id);
+        if (!cached.empty()) {
+            IAIMPServiceFileStreaming *fileStreaming = nullptr;
+            if (SUCCEEDED(m_core->QueryInterface(IID_IAIMPServiceFileStreaming, reinterpret_cast<void **>(&fileStreaming)))) {
+                HRESULT ret = fileStreaming->CreateStreamForFile(AIMPString(cached), 0, -1, -1, Stream);
+                fileStreaming->Release();
+                if (SUCCEEDED(ret))
+                    return S_OK;
+            }
+        }
 
-        uintptr_t *taskId = nullptr;
-        ret = m_httpClient->Get(AIMPString(url), 0, *Stream, listener, nullptr, reinterpret_cast<void **>(&taskId));
-        if (ret == S_OK) {
-            listener->m_stream->Wait();
+        Prefetcher::Release(id);
+        int itag = 0;
+        int64_t contentLength = -1;
+        HTTPStream *stream = new HTTPStream(YouTubeAPI::GetStreamUrl(id, &itag, &contentLength), m_httpClient);
+        stream->AddRef();
+        if (itag > 0)
+            stream->m_cache = StreamCache::Open(id, itag, contentLength);
+
+        // A partial file of a different size is dropped by the cache as soon as the response announces the size
+        if (stream->Open(stream->m_cache ? stream->m_cache->Size() : 0)) {
+            *Stream = stream;
+            return S_OK;
         }
+        stream->Release();
+        YouTubeAPI::InvalidateStreamUrl(id); // Might have been revoked before its expire time
     }
-    return ret;
+    return E_FAIL;
 }
 
 HRESULT WINAPI FileSystem::Process(IAIMPString *FileName) {
-    if (Config::TrackInfo *ti = Tools::TrackInfo(FileName)) {
-        ShellExecute(Plugin::instance()->GetMainWindowHandle(), L"open", ti->Permalink.c_str(), NULL, NULL, SW_SHOWNORMAL);
+    std::wstring id = Tools::TrackIdFromUrl(FileName->GetData());
+    if (!id.empty()) {
+        ShellExecute(Plugin::instance()->GetMainWindowHandle(), L"open", Tools::Permalink(id).c_str(), NULL, NULL, SW_SHOWNORMAL);
         return S_OK;
     }
     return E_FAIL;
@@ -123,8 +214,9 @@ HRESULT WINAPI FileSystem::CopyToClipboard(IAIMPObjectList *Files) {
     for (int i = 0, n = Files->GetCount(); i < n; ++i) {
         IAIMPString *str = nullptr;
         Files->GetObject(i, IID_IAIMPString, reinterpret_cast<void **>(&str));
-        if (Config::TrackInfo *ti = Tools::TrackInfo(str)) {
-            text += Tools::ToString(ti->Permalink) + "\r\n";
+        std::wstring id = Tools::TrackIdFromUrl(str->GetData());
+        if (!id.empty()) {
+            text += Tools::ToString(Tools::Permalink(id)) + "\r\n";
         }
         str->Release();
     }
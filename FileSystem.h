@@ -5,8 +5,10 @@
 #include "AIMPString.h"
 #include "Tools.h"
 #include "IUnknownInterfaceImpl.h"
-#include <mutex>
-#include <condition_variable>
+#include "RingBuffer.h"
+#include "StreamCache.h"
+#include <memory>
+#include <list>
 
 class FileSystem : public IUnknownInterfaceImpl<IAIMPExtensionFileSystem>, 
                    public IAIMPFileSystemCommandDropSource, 
@@ -17,6 +19,7 @@ public:
 
     class HTTPStream : public IUnknownInterfaceImpl<IAIMPStream> {
     public:
+        HTTPStream(const std::wstring &url, IAIMPServiceHTTPClient *httpClient) : m_url(url), m_httpClient(httpClient) {}
         ~HTTPStream();
         virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
             if (!ppvObj) return E_POINTER;
@@ -30,35 +33,96 @@ public:
         virtual INT64 WINAPI GetPosition() { return m_position; }
         virtual INT64 WINAPI GetSize() { return m_size; }
 
-        virtual HRESULT WINAPI SetSize(const INT64 Value);
+        virtual HRESULT WINAPI SetSize(const INT64 Value) { return E_NOTIMPL; }
 
         virtual HRESULT WINAPI Seek(const INT64 Offset, int Mode);
         virtual int WINAPI Read(unsigned char *Buffer, unsigned int Count);
-        virtual HRESULT WINAPI Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written);
+        virtual HRESULT WINAPI Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written) { return E_NOTIMPL; }
 
-        void Wait();
-        void Signal();
+        bool Open(INT64 offset = 0);
 
     private:
-        std::condition_variable m_cv;
-        std::mutex m_mutex;
-        unsigned char *m_buffer{nullptr};
+        void Park();
+
+        // Reads this close past the download head wait for it instead of issuing a ranged request
+        static const std::size_t SeekThreshold = 512 * 1024;
+        static const std::size_t MaxParkedSpans = 2;
+
+        std::wstring m_url;
+        std::shared_ptr<StreamCache::File> m_cache;
+        std::shared_ptr<RingBuffer> m_buffer;
+        std::list<std::shared_ptr<RingBuffer>> m_spans; // Windows of earlier transfers, most recent first
+        IAIMPServiceHTTPClient *m_httpClient{nullptr};
+        void *m_taskId{nullptr};
 
         INT64 m_position{0};
-        INT64 m_bufferSize{0};
-        INT64 m_size{0};
+        INT64 m_size{-1};
+        friend class FileSystem;
+    };
+
+    // Stream handed to the HTTP client, feeds the ring buffer shared with HTTPStream
+    class Sink : public IUnknownInterfaceImpl<IAIMPStream> {
+    public:
+        Sink(std::shared_ptr<RingBuffer> buffer, std::shared_ptr<StreamCache::File> cache) : m_buffer(buffer), m_cache(cache) {}
+
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+            if (riid == IID_IAIMPStream) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            return E_NOINTERFACE;
+        }
+        virtual INT64 WINAPI GetPosition() { return m_written; }
+        virtual INT64 WINAPI GetSize() { return m_written; }
+
+        virtual HRESULT WINAPI SetSize(const INT64 Value) { return S_OK; }
+
+        virtual HRESULT WINAPI Seek(const INT64 Offset, int Mode) { return S_OK; }
+        virtual int WINAPI Read(unsigned char *Buffer, unsigned int Count) { return 0; }
+        virtual HRESULT WINAPI Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written);
+
+    private:
+        std::shared_ptr<RingBuffer> m_buffer;
+        std::shared_ptr<StreamCache::File> m_cache;
+        INT64 m_written{0};
     };
 
-    class EventListener : public IUnknownInterfaceImpl<IAIMPHTTPClientEvents> {
+    class EventListener : public IUnknownInterfaceImpl<IAIMPHTTPClientEvents>, IAIMPHTTPClientEvents2 {
+        typedef IUnknownInterfaceImpl<IAIMPHTTPClientEvents> Base;
     public:
-        EventListener();
+        EventListener(std::shared_ptr<RingBuffer> buffer, std::shared_ptr<StreamCache::File> cache, INT64 offset);
 
         void WINAPI OnAccept(IAIMPString *ContentType, const INT64 ContentSize, BOOL *Allow);
         void WINAPI OnComplete(IAIMPErrorInfo *ErrorInfo, BOOL Canceled);
         void WINAPI OnProgress(const INT64 Downloaded, const INT64 Total);
+        void WINAPI OnAcceptHeaders(IAIMPString *Header, BOOL *Allow);
+
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+
+            if (riid == IID_IAIMPHTTPClientEvents) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            if (riid == IID_IAIMPHTTPClientEvents2) {
+                *ppvObj = static_cast<IAIMPHTTPClientEvents2 *>(this);
+                AddRef();
+                return S_OK;
+            }
+
+            return E_NOINTERFACE;
+        }
+        virtual ULONG WINAPI AddRef(void) { return Base::AddRef(); }
+        virtual ULONG WINAPI Release(void) { return Base::Release(); }
 
     private:
-        HTTPStream *m_stream;
+        std::shared_ptr<RingBuffer> m_buffer;
+        std::shared_ptr<StreamCache::File> m_cache;
+        INT64 m_offset;
+        Sink *m_sink;
         friend class FileSystem;
     };
 
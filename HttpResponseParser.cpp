@@ -0,0 +1,244 @@
+#include "HttpResponseParser.h"
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <cstdlib>
+
+HttpResponseParser::HttpResponseParser(BodyFunc body) : m_body(body) {
+
+}
+
+bool HttpResponseParser::Feed(const char *data, std::size_t size) {
+    while (size > 0 && m_state != Complete && m_state != Error) {
+        std::size_t n;
+        switch (m_state) {
+            case Body:
+            case ChunkData:
+                n = std::size_t((std::min)(uint64_t(size), m_remaining));
+                if (m_body)
+                    m_body(data, n);
+                BodyDone(n);
+                break;
+            case UntilClose:
+                n = size;
+                if (m_body)
+                    m_body(data, n);
+                break;
+            default:
+                n = Line(data, size);
+                break;
+        }
+        data += n;
+        size -= n;
+    }
+
+    // Nothing may follow the response, the connection is out of step otherwise
+    if (size > 0 && m_state == Complete)
+        m_keepAlive = false;
+    return m_state != Error;
+}
+
+bool HttpResponseParser::Finish() {
+    if (m_state == UntilClose)
+        m_state = Complete;
+    if (m_state != Complete)
+        m_state = Error;
+
+    m_keepAlive = false;
+    return m_state == Complete;
+}
+
+std::size_t HttpResponseParser::Direct() const {
+    if (m_state != Body && m_state != ChunkData)
+        return 0;
+    return std::size_t((std::min)(m_remaining, uint64_t(SIZE_MAX)));
+}
+
+void HttpResponseParser::Advance(std::size_t size) {
+    if (m_state == Body || m_state == ChunkData)
+        BodyDone(std::size_t((std::min)(uint64_t(size), m_remaining)));
+}
+
+void HttpResponseParser::BodyDone(std::size_t size) {
+    m_remaining -= size;
+    if (m_remaining == 0)
+        m_state = m_state == Body ? Complete : ChunkEnd;
+}
+
+std::string HttpResponseParser::Header(const char *name) const {
+    for (const auto &x : m_headers) {
+        if (Equal(x.first, name))
+            return x.second;
+    }
+    return std::string();
+}
+
+std::size_t HttpResponseParser::Line(const char *data, std::size_t size) {
+    const char *end = static_cast<const char *>(memchr(data, '\n', size));
+    std::size_t n = end ? end - data + 1 : size;
+    if (m_line.size() + n > MaxLine) {
+        m_state = Error;
+        return size;
+    }
+
+    m_line.append(data, n);
+    if (!end)
+        return n;
+
+    // A bare \n is accepted as well
+    m_line.pop_back();
+    if (!m_line.empty() && m_line.back() == '\r')
+        m_line.pop_back();
+
+    bool ok = false;
+    switch (m_state) {
+        case StatusLine: ok = StatusLineDone(); break;
+        case HeaderLine: ok = HeaderLineDone(); break;
+        case ChunkSize: ok = ChunkSizeDone(); break;
+        case ChunkEnd:
+            ok = m_line.empty();
+            m_state = ChunkSize;
+            break;
+        case Trailer:
+            // Trailer fields aren't needed, the empty line ends the response
+            ok = (m_headerBytes += m_line.size()) <= MaxHeaders;
+            if (m_line.empty())
+                m_state = Complete;
+            break;
+        default:
+            break;
+    }
+
+    m_line.clear();
+    if (!ok)
+        m_state = Error;
+    return n;
+}
+
+bool HttpResponseParser::StatusLineDone() {
+    // HTTP/1.1 200 OK
+    const char *line = m_line.c_str();
+    if (m_line.size() < 12 || strncmp(line, "HTTP/1.", 7) != 0 || !isdigit((unsigned char)line[7]) || line[8] != ' ' ||
+        !isdigit((unsigned char)line[9]) || !isdigit((unsigned char)line[10]) || !isdigit((unsigned char)line[11]) ||
+        (m_line.size() > 12 && line[12] != ' '))
+        return false;
+
+    m_http11 = line[7] != '0';
+    m_status = atoi(line + 9);
+    m_headers.clear();
+    m_headerBytes = m_line.size();
+    m_state = HeaderLine;
+    return true;
+}
+
+bool HttpResponseParser::HeaderLineDone() {
+    if ((m_headerBytes += m_line.size()) > MaxHeaders)
+        return false;
+    if (m_line.empty())
+        return HeadersComplete();
+
+    // Obsolete line folding continues the previous value
+    if (m_line[0] == ' ' || m_line[0] == '\t') {
+        if (m_headers.empty())
+            return false;
+        std::size_t start = m_line.find_first_not_of(" \t");
+        if (start != std::string::npos)
+            m_headers.back().second += " " + m_line.substr(start);
+        return true;
+    }
+
+    std::size_t colon = m_line.find(':');
+    if (colon == 0 || colon == std::string::npos || m_line.find_first_of(" \t") < colon)
+        return false;
+
+    std::size_t start = m_line.find_first_not_of(" \t", colon + 1);
+    std::size_t end = m_line.find_last_not_of(" \t");
+    m_headers.push_back(std::make_pair(m_line.substr(0, colon), start != std::string::npos ? m_line.substr(start, end + 1 - start) : std::string()));
+    return true;
+}
+
+bool HttpResponseParser::HeadersComplete() {
+    // Interim 1xx responses are followed by the actual one
+    if (m_status >= 100 && m_status < 200 && m_status != 101) {
+        m_state = StatusLine;
+        return true;
+    }
+
+    bool close = false, keepAlive = false;
+    std::string contentLength;
+    std::vector<std::string> transferEncoding;
+    for (const auto &x : m_headers) {
+        if (Equal(x.first, "Connection")) {
+            for (const auto &t : Tokens(x.second)) {
+                close |= Equal(t, "close");
+                keepAlive |= Equal(t, "keep-alive");
+            }
+        } else if (Equal(x.first, "Transfer-Encoding")) {
+            std::vector<std::string> tokens = Tokens(x.second);
+            transferEncoding.insert(transferEncoding.end(), tokens.begin(), tokens.end());
+        } else if (Equal(x.first, "Content-Length")) {
+            // Repeated values have to agree
+            if (x.second.empty() || x.second.find_first_not_of("0123456789") != std::string::npos || x.second.size() > 18 ||
+                (!contentLength.empty() && contentLength != x.second))
+                return false;
+            contentLength = x.second;
+        }
+    }
+    m_keepAlive = !close && (m_http11 || keepAlive);
+
+    if (m_status == 204 || m_status == 304) {
+        m_state = Complete;
+    } else if (!transferEncoding.empty()) {
+        // Only a final chunked coding delimits the body, anything else runs until the connection closes
+        m_state = Equal(transferEncoding.back(), "chunked") ? ChunkSize : UntilClose;
+    } else if (!contentLength.empty()) {
+        m_remaining = strtoull(contentLength.c_str(), nullptr, 10);
+        m_state = m_remaining > 0 ? Body : Complete;
+    } else {
+        m_state = UntilClose;
+    }
+
+    if (m_state == UntilClose)
+        m_keepAlive = false;
+    return true;
+}
+
+bool HttpResponseParser::ChunkSizeDone() {
+    // 1a2b;extension
+    std::size_t end = m_line.find_first_of("; \t");
+    if (end == std::string::npos)
+        end = m_line.size();
+    if (end == 0 || end > 15 || m_line.find_first_not_of("0123456789abcdefABCDEF") < end)
+        return false;
+
+    m_remaining = strtoull(m_line.substr(0, end).c_str(), nullptr, 16);
+    m_state = m_remaining > 0 ? ChunkData : Trailer;
+    return true;
+}
+
+bool HttpResponseParser::Equal(const std::string &a, const char *b) {
+    // ASCII only, like header names and tokens
+    std::size_t i = 0;
+    for (; i < a.size() && b[i]; ++i) {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return false;
+    }
+    return i == a.size() && !b[i];
+}
+
+std::vector<std::string> HttpResponseParser::Tokens(const std::string &value) {
+    std::vector<std::string> tokens;
+    for (std::size_t pos = 0; pos <= value.size();) {
+        std::size_t end = value.find(',', pos);
+        if (end == std::string::npos)
+            end = value.size();
+
+        std::size_t start = value.find_first_not_of(" \t", pos);
+        if (start < end) {
+            std::size_t last = value.find_last_not_of(" \t", end - 1);
+            tokens.push_back(value.substr(start, last + 1 - start));
+        }
+        pos = end + 1;
+    }
+    return tokens;
+}
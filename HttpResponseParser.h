@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+// Incremental HTTP/1.x response parser: status line, headers, Content-Length, chunked and
+// close-delimited bodies. Received bytes can be fed in pieces of any size, body bytes are passed to
+// the body function as they arrive. While a known number of body bytes is expected (Direct()), the
+// caller may instead receive them straight into its own buffer and only report them with Advance().
+class HttpResponseParser {
+public:
+    typedef std::function<void(const char *, std::size_t)> BodyFunc;
+
+    explicit HttpResponseParser(BodyFunc body = nullptr);
+
+    // False once the response is malformed
+    bool Feed(const char *data, std::size_t size);
+    // Connection closed, false unless that completes the response
+    bool Finish();
+
+    std::size_t Direct() const;
+    void Advance(std::size_t size);
+
+    bool HeadersDone() const { return m_state > HeaderLine; }
+    bool Done() const { return m_state == Complete; }
+    bool Failed() const { return m_state == Error; }
+    // The connection can carry another request after this response
+    bool KeepAlive() const { return m_keepAlive; }
+
+    int Status() const { return m_status; }
+    std::string Header(const char *name) const;
+
+private:
+    enum State { StatusLine, HeaderLine, Body, ChunkSize, ChunkData, ChunkEnd, Trailer, UntilClose, Complete, Error };
+
+    std::size_t Line(const char *data, std::size_t size);
+    bool StatusLineDone();
+    bool HeaderLineDone();
+    bool HeadersComplete();
+    bool ChunkSizeDone();
+    void BodyDone(std::size_t size);
+    static std::vector<std::string> Tokens(const std::string &value);
+    // Case-insensitive comparison
+    static bool Equal(const std::string &a, const char *b);
+
+    static const std::size_t MaxLine = 8 * 1024;
+    static const std::size_t MaxHeaders = 64 * 1024;
+
+    BodyFunc m_body;
+    State m_state{ StatusLine };
+    std::string m_line;
+    std::vector<std::pair<std::string, std::string>> m_headers;
+    std::size_t m_headerBytes{ 0 };
+    uint64_t m_remaining{ 0 };
+    int m_status{ 0 };
+    bool m_http11{ false };
+    bool m_keepAlive{ false };
+};
@@ -0,0 +1,374 @@
+#include "Journal.h"
+#include "TrackCache.h"
+#include <windows.h>
+#include <share.h>
+#include <algorithm>
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/stringbuffer.h"
+
+typedef rapidjson::GenericStringBuffer<rapidjson::UTF8<>> LineBuffer;
+typedef rapidjson::Writer<LineBuffer, rapidjson::UTF16<>, rapidjson::UTF8<>> LineWriter;
+
+std::mutex Journal::m_mutex;
+std::wstring Journal::m_path;
+FILE *Journal::m_file = nullptr;
+int64_t Journal::m_size = 0;
+int64_t Journal::m_compactAt = Journal::CompactThreshold;
+std::thread Journal::m_compactor;
+bool Journal::m_compacting = false;
+std::mutex Journal::m_changesMutex;
+std::string Journal::m_records;
+std::unordered_set<VideoId> Journal::m_changedTracks;
+std::unordered_set<VideoId> Journal::m_changedExclusions;
+std::unordered_set<std::wstring> Journal::m_changedPlaylists;
+bool Journal::m_monitorUrlsChanged = false;
+bool Journal::m_playlistsChanged = false;
+std::unordered_set<std::wstring> Journal::m_playlistIds;
+std::unordered_map<VideoId, Config::TrackInfo> Journal::m_tracks;
+
+template <typename T>
+std::string Journal::Serialize(const T &value) {
+    LineBuffer buffer;
+    LineWriter writer(buffer);
+    writer << value;
+    return buffer.GetString();
+}
+
+template <>
+std::string Journal::Serialize(const std::wstring &value) {
+    LineBuffer buffer;
+    LineWriter writer(buffer);
+    writer.String(value.c_str(), rapidjson::SizeType(value.size()));
+    return buffer.GetString();
+}
+
+template <>
+std::string Journal::Serialize(const std::vector<Config::MonitorUrl> &value) {
+    LineBuffer buffer;
+    LineWriter writer(buffer);
+    writer.StartArray();
+    for (const auto &x : value) {
+        writer << x;
+    }
+    writer.EndArray();
+    return buffer.GetString();
+}
+
+void Journal::Open() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_path = Config::PluginConfigFolder() + L"Journal.log";
+    std::wstring oldPath = Config::PluginConfigFolder() + L"Journal.old";
+    m_tracks.clear();
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+
+    // Journal.old is left behind when the last compaction didn't finish, it comes before Journal.log
+    bool hasOld = Replay(oldPath);
+    Replay(m_path);
+    if (hasOld) {
+        std::wstring merged = m_path + L".tmp";
+        FILE *out = nullptr;
+        if (_wfopen_s(&out, merged.c_str(), L"wb") == 0) {
+            Append(out, oldPath);
+            Append(out, m_path);
+            if (fclose(out) == 0 && MoveFileEx(merged.c_str(), m_path.c_str(), MOVEFILE_REPLACE_EXISTING))
+                DeleteFile(oldPath.c_str());
+        }
+    }
+
+    m_file = _wfsopen(m_path.c_str(), L"ab", _SH_DENYWR);
+    m_size = 0;
+    m_compactAt = CompactThreshold;
+    if (m_file) {
+        _fseeki64(m_file, 0, SEEK_END);
+        m_size = _ftelli64(m_file);
+    }
+    // Replaying reported the changes it made, they are in the journal already
+    ForgetChanges();
+}
+
+void Journal::Close() {
+    Sync();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::thread compactor(std::move(m_compactor));
+    lock.unlock();
+    if (compactor.joinable())
+        compactor.join();
+
+    lock.lock();
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+}
+
+bool Journal::Append(FILE *out, const std::wstring &path) {
+    FILE *in = nullptr;
+    if (_wfopen_s(&in, path.c_str(), L"rb") != 0)
+        return false;
+
+    char buffer[65536];
+    std::size_t n;
+    bool written = true;
+    while (written && (n = fread(buffer, 1, sizeof(buffer), in)) > 0)
+        written = fwrite(buffer, 1, n, out) == n;
+    written = written && !ferror(in);
+    fclose(in);
+    return written;
+}
+
+bool Journal::Replay(const std::wstring &path) {
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, path.c_str(), L"rb") != 0)
+        return false;
+
+    std::string contents;
+    char buffer[65536];
+    std::size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        contents.append(buffer, n);
+    fclose(file);
+
+    using namespace rapidjson;
+    std::size_t start = 0, end;
+    while (start < contents.size()) {
+        if ((end = contents.find('\n', start)) == std::string::npos)
+            end = contents.size();
+        std::string line(contents, start, end - start);
+        start = end + 1;
+
+        // A torn last line of a crashed session doesn't parse and is skipped
+        GenericStringStream<UTF8<>> stream(line.c_str());
+        GenericDocument<UTF16<>> d;
+        d.ParseStream<0, UTF8<>>(stream);
+        if (!d.IsObject() || !d.HasMember(L"T") || !d[L"T"].IsString())
+            continue;
+
+        std::wstring type = d[L"T"].GetString();
+        std::wstring id = d.HasMember(L"Id") && d[L"Id"].IsString() ? d[L"Id"].GetString() : std::wstring();
+        if (type == L"X+") {
+            Config::TrackExclusions.insert(id);
+        } else if (type == L"X-") {
+            Config::TrackExclusions.erase(id);
+        } else if (type == L"M" && d.HasMember(L"V") && d[L"V"].IsArray()) {
+            Config::MonitorUrls.clear();
+            for (auto x = d[L"V"].Begin(), e = d[L"V"].End(); x != e; x++) {
+                if ((*x).IsObject())
+                    Config::MonitorUrls.push_back(*x);
+            }
+        } else if ((type == L"P" && d.HasMember(L"V") && d[L"V"].IsObject()) || type == L"P-") {
+            Config::Playlist playlist = type == L"P" ? Config::Playlist(d[L"V"]) : Config::Playlist(id, std::wstring(), false);
+            auto &playlists = Config::UserPlaylists;
+            auto it = std::find_if(playlists.begin(), playlists.end(), [&playlist](const Config::Playlist &p) { return p.ID == playlist.ID; });
+            if (type == L"P-") {
+                if (it != playlists.end())
+                    playlists.erase(it);
+            } else if (it != playlists.end()) {
+                *it = playlist;
+            } else {
+                playlists.push_back(playlist);
+            }
+        } else if ((type == L"PI+" || type == L"PI-") && d.HasMember(L"V") && d[L"V"].IsString()) {
+            auto &playlists = Config::UserPlaylists;
+            auto it = std::find_if(playlists.begin(), playlists.end(), [&id](const Config::Playlist &p) { return p.ID == id; });
+            if (it != playlists.end()) {
+                if (type == L"PI+") {
+                    it->Items.insert(d[L"V"].GetString());
+                } else {
+                    it->Items.erase(d[L"V"].GetString());
+                }
+            }
+        } else if (type == L"I" && d.HasMember(L"V") && d[L"V"].IsObject()) {
+            Config::TrackInfo info(d[L"V"]);
+            info.Id = id;
+            std::unique_lock<std::mutex> lock(Config::TrackInfosMutex);
+            Config::TrackInfos[id] = info;
+            lock.unlock();
+            m_tracks[id] = info;
+        }
+    }
+    Config::UserPlaylistsChanged();
+    return true;
+}
+
+void Journal::ForgetChanges() {
+    std::unique_lock<std::mutex> lock(m_changesMutex);
+    m_records.clear();
+    m_changedTracks.clear();
+    m_changedExclusions.clear();
+    m_changedPlaylists.clear();
+    m_monitorUrlsChanged = false;
+    m_playlistsChanged = false;
+    m_playlistIds.clear();
+    for (const auto &x : Config::UserPlaylists)
+        m_playlistIds.insert(x.ID);
+}
+
+void Journal::TrackChanged(const VideoId &id) {
+    std::unique_lock<std::mutex> lock(m_changesMutex);
+    m_changedTracks.insert(id);
+}
+
+void Journal::ExclusionChanged(const VideoId &id) {
+    std::unique_lock<std::mutex> lock(m_changesMutex);
+    m_changedExclusions.insert(id);
+}
+
+void Journal::MonitorUrlsChanged() {
+    std::unique_lock<std::mutex> lock(m_changesMutex);
+    m_monitorUrlsChanged = true;
+}
+
+void Journal::PlaylistsChanged() {
+    std::unique_lock<std::mutex> lock(m_changesMutex);
+    m_playlistsChanged = true;
+}
+
+void Journal::PlaylistChanged(const std::wstring &playlistId) {
+    std::unique_lock<std::mutex> lock(m_changesMutex);
+    m_changedPlaylists.insert(playlistId);
+}
+
+void Journal::PlaylistItemChanged(const Config::Playlist &playlist, const VideoId &id, bool added) {
+    std::string record = std::string("{\"T\":\"") + (added ? "PI+" : "PI-") + "\",\"Id\":" + Serialize(playlist.ID) +
+                         ",\"V\":" + Serialize(id.ToString()) + "}\n";
+    std::unique_lock<std::mutex> lock(m_changesMutex);
+    m_records += record;
+}
+
+bool Journal::Persisted(const VideoId &id, const Config::TrackInfo &info) {
+    auto it = m_tracks.find(id);
+    if (it != m_tracks.end())
+        return it->second == info;
+
+    Config::TrackInfo stored;
+    return TrackCache::Find(id.ToString(), &stored) && stored == info;
+}
+
+void Journal::Sync() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_file)
+        return;
+
+    std::string out;
+    std::unordered_set<VideoId> tracks, exclusions;
+    std::unordered_set<std::wstring> changedPlaylists;
+    std::unique_lock<std::mutex> changes(m_changesMutex);
+    out.swap(m_records);
+    tracks.swap(m_changedTracks);
+    exclusions.swap(m_changedExclusions);
+    changedPlaylists.swap(m_changedPlaylists);
+    bool monitorUrls = m_monitorUrlsChanged;
+    bool playlists = m_playlistsChanged;
+    m_monitorUrlsChanged = m_playlistsChanged = false;
+    changes.unlock();
+
+    for (const auto &x : exclusions) {
+        const char *type = Config::TrackExclusions.count(x) ? "X+" : "X-";
+        out += std::string("{\"T\":\"") + type + "\",\"Id\":" + Serialize(x.ToString()) + "}\n";
+    }
+
+    if (monitorUrls)
+        out += "{\"T\":\"M\",\"V\":" + Serialize(Config::MonitorUrls) + "}\n";
+
+    // Item records of a playlist written here as a whole come before it and are superseded
+    if (playlists) {
+        std::unordered_set<std::wstring> playlistIds;
+        for (const auto &x : Config::UserPlaylists) {
+            playlistIds.insert(x.ID);
+            out += "{\"T\":\"P\",\"V\":" + Serialize(x) + "}\n";
+        }
+        for (const auto &x : m_playlistIds) {
+            if (playlistIds.find(x) == playlistIds.end())
+                out += "{\"T\":\"P-\",\"Id\":" + Serialize(x) + "}\n";
+        }
+        m_playlistIds.swap(playlistIds);
+    } else if (!changedPlaylists.empty()) {
+        for (const auto &x : Config::UserPlaylists) {
+            if (changedPlaylists.count(x.ID))
+                out += "{\"T\":\"P\",\"V\":" + Serialize(x) + "}\n";
+        }
+    }
+
+    for (const auto &x : tracks) {
+        Config::TrackInfo info;
+        if (!Config::FindTrackInfo(x.ToString(), &info) || Persisted(x, info))
+            continue;
+
+        out += "{\"T\":\"I\",\"Id\":" + Serialize(x.ToString()) + ",\"V\":" + Serialize(info) + "}\n";
+        m_tracks[x] = info;
+    }
+
+    if (out.empty())
+        return;
+
+    fwrite(out.data(), 1, out.size(), m_file);
+    fflush(m_file);
+    m_size += out.size();
+
+    if (m_size >= m_compactAt)
+        Compact();
+}
+
+void Journal::Compact() {
+    // Called with m_mutex held
+    if (m_compacting)
+        return;
+
+    std::wstring oldPath = Config::PluginConfigFolder() + L"Journal.old";
+    fclose(m_file);
+
+    // Journal.old of a compaction that failed comes first, the log goes after it as in Open()
+    bool rotated;
+    FILE *old = nullptr;
+    if (GetFileAttributes(oldPath.c_str()) == INVALID_FILE_ATTRIBUTES) {
+        rotated = MoveFileEx(m_path.c_str(), oldPath.c_str(), 0) != FALSE;
+    } else if (_wfopen_s(&old, oldPath.c_str(), L"ab") == 0) {
+        // A partial copy only duplicates records, the log is kept and replays after them
+        rotated = Append(old, m_path);
+        rotated = fclose(old) == 0 && rotated;
+    } else {
+        rotated = false;
+    }
+
+    if (!rotated) {
+        // Tried again once the journal has grown by another threshold, not on every Sync()
+        m_file = _wfsopen(m_path.c_str(), L"ab", _SH_DENYWR);
+        m_compactAt = m_size + CompactThreshold;
+        return;
+    }
+    m_file = _wfsopen(m_path.c_str(), L"wb", _SH_DENYWR);
+    m_size = 0;
+    m_compactAt = CompactThreshold;
+
+    if (m_compactor.joinable())
+        m_compactor.join();
+
+    // Everything up to here is in Journal.old, the snapshot is written from copies
+    m_compacting = true;
+    m_compactor = std::thread(Compactor, Config::TrackExclusions, Config::MonitorUrls, Config::UserPlaylists, m_tracks);
+}
+
+void Journal::Compactor(VideoIdSet exclusions, std::vector<Config::MonitorUrl> monitorUrls,
+                        std::vector<Config::Playlist> playlists, std::unordered_map<VideoId, Config::TrackInfo> tracks) {
+    std::wstring folder = Config::PluginConfigFolder();
+    bool written = Config::WriteExtendedConfig(folder + L"Config.json", exclusions, monitorUrls, playlists) &&
+                   TrackCache::Save(folder + L"Cache.bin", tracks);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (written) {
+        DeleteFile((folder + L"Journal.old").c_str());
+
+        // Tracks journaled again since the rotation stay until the next compaction
+        for (const auto &x : tracks) {
+            auto it = m_tracks.find(x.first);
+            if (it != m_tracks.end() && it->second == x.second)
+                m_tracks.erase(it);
+        }
+    }
+    m_compacting = false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+#include <cstdint>
+#include "Config.h"
+
+// Write-ahead journal (Journal.log) of changes to the exclusions, monitor urls, user playlists and track infos.
+// Config reports each change as it is made, Sync() appends one JSON line per change reported since the last call;
+// once the journal grows past CompactThreshold it is rotated to Journal.old and folded into Config.json and
+// Cache.bin on a background thread.
+class Journal {
+public:
+    static void Open();
+    static void Close();
+    static void Sync();
+
+    static void TrackChanged(const VideoId &id);
+    static void ExclusionChanged(const VideoId &id);
+    static void MonitorUrlsChanged();
+    // The list was replaced, all of it is written again
+    static void PlaylistsChanged();
+    static void PlaylistChanged(const std::wstring &playlistId);
+    static void PlaylistItemChanged(const Config::Playlist &playlist, const VideoId &id, bool added);
+
+private:
+    // Copies the file at path to the end of out
+    static bool Append(FILE *out, const std::wstring &path);
+    static bool Replay(const std::wstring &path);
+    static void Compact();
+    static void Compactor(VideoIdSet exclusions, std::vector<Config::MonitorUrl> monitorUrls,
+                          std::vector<Config::Playlist> playlists, std::unordered_map<VideoId, Config::TrackInfo> tracks);
+    static void ForgetChanges();
+    static bool Persisted(const VideoId &id, const Config::TrackInfo &info);
+
+    template <typename T>
+    static std::string Serialize(const T &value);
+
+    Journal();
+    Journal(const Journal &);
+    Journal &operator=(const Journal &);
+
+    static const int64_t CompactThreshold = 4 * 1024 * 1024;
+
+    static std::mutex m_mutex;
+    static std::wstring m_path;
+    static FILE *m_file;
+    static int64_t m_size;
+    // Size at which Sync() compacts, pushed back after a rotation failed
+    static int64_t m_compactAt;
+    static std::thread m_compactor;
+    static bool m_compacting;
+
+    // Changes reported since the last Sync(), guarded by m_changesMutex as they come from outside of Sync()
+    static std::mutex m_changesMutex;
+    static std::string m_records;
+    static std::unordered_set<VideoId> m_changedTracks;
+    static std::unordered_set<VideoId> m_changedExclusions;
+    static std::unordered_set<std::wstring> m_changedPlaylists;
+    static bool m_monitorUrlsChanged;
+    static bool m_playlistsChanged;
+
+    // Playlists in the journal, those missing from a replaced list get a removal record
+    static std::unordered_set<std::wstring> m_playlistIds;
+    // Journaled since the last compaction, the rest is in Cache.bin
+    static std::unordered_map<VideoId, Config::TrackInfo> m_tracks;
+};
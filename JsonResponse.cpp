@@ -0,0 +1,37 @@
+#include "JsonResponse.h"
+
+std::mutex JsonResponse::m_poolMutex;
+std::vector<std::unique_ptr<std::vector<char>>> JsonResponse::m_pool;
+
+JsonResponse::Arena::Arena() {
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+    if (!m_pool.empty()) {
+        m_buffer = std::move(m_pool.back());
+        m_pool.pop_back();
+        return;
+    }
+    lock.unlock();
+
+    m_buffer.reset(new std::vector<char>(ArenaSize));
+}
+
+JsonResponse::Arena::~Arena() {
+    // Grown to what this response needed, the next one of its kind fits then
+    if (Used > m_buffer->size() && m_buffer->size() < MaxArenaSize) {
+        std::size_t size = Used + Used / 4;
+        std::vector<char>(size < MaxArenaSize ? size : MaxArenaSize).swap(*m_buffer);
+    }
+
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+    if (m_pool.size() < MaxPooled)
+        m_pool.push_back(std::move(m_buffer));
+}
+
+JsonResponse::JsonResponse(unsigned char *data, int size) : m_allocator(m_arena.Data(), m_arena.Size()), m_document(&m_allocator, StackSize, &m_stackAllocator) {
+    if (data && size > 0)
+        m_document.ParseInsitu(reinterpret_cast<char *>(data));
+}
+
+JsonResponse::~JsonResponse() {
+    m_arena.Used = m_allocator.Size() + 1024;
+}
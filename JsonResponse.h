@@ -0,0 +1,51 @@
+#pragma once
+
+#include "rapidjson/document.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+
+// API response parsed in place: the strings of the document point into the response buffer, which the
+// parse modifies and which has to outlive the document. Values are allocated from an arena borrowed
+// from a pool and sized to what earlier responses needed, so a page usually parses without allocating.
+class JsonResponse {
+public:
+    // data has to be 0 terminated and stay valid, like the buffer passed to AimpHTTP callbacks
+    JsonResponse(unsigned char *data, int size);
+    ~JsonResponse();
+
+    rapidjson::Document &operator*() { return m_document; }
+    rapidjson::Document *operator->() { return &m_document; }
+
+private:
+    // Returned to the pool after the allocator is done with it
+    class Arena {
+    public:
+        Arena();
+        ~Arena();
+
+        char *Data() { return m_buffer->data(); }
+        std::size_t Size() { return m_buffer->size(); }
+
+        std::size_t Used{ 0 };
+
+    private:
+        std::unique_ptr<std::vector<char>> m_buffer;
+    };
+
+    JsonResponse(const JsonResponse &);
+    JsonResponse &operator=(const JsonResponse &);
+
+    static const std::size_t ArenaSize = 64 * 1024;
+    static const std::size_t MaxArenaSize = 4 * 1024 * 1024;
+    static const std::size_t MaxPooled = 4;
+    static const std::size_t StackSize = 4 * 1024;
+
+    Arena m_arena;
+    rapidjson::MemoryPoolAllocator<> m_allocator;
+    rapidjson::CrtAllocator m_stackAllocator;
+    rapidjson::Document m_document;
+
+    static std::mutex m_poolMutex;
+    static std::vector<std::unique_ptr<std::vector<char>>> m_pool;
+};
@@ -1,10 +1,12 @@
 #include "MessageHook.h"
 
 #include "Tools.h"
+#include "PlaylistIndex.h"
 #include "SDK/apiPlaylists.h"
 #include "SDK/apiPlayer.h"
 #include "AIMPYouTube.h"
 #include "YouTubeAPI.h"
+#include "Prefetcher.h"
 
 MessageHook::MessageHook(Plugin *pl) : m_plugin(pl) {
     
@@ -22,25 +24,17 @@ void WINAPI MessageHook::CoreMessage(DWORD AMessage, int AParam1, void *AParam2,
             std::wstring id = Tools::TrackIdFromUrl(url->GetData());
             url->Release();
             if (!id.empty()) {
-                for (auto &x : Config::UserPlaylists) {
-                    for (auto &xx : x.Items) {
-                        if (xx == id) {
-                            x.Items.erase(id);
-
-                            if (IAIMPPlaylist *playlist = Plugin::instance()->GetPlaylistById(x.AIMPPlaylistId)) {
-                                Plugin::instance()->ForEveryItem(playlist, [&id](IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &itemid) {
-                                    if (!itemid.empty() && itemid == id) {
-                                        return Plugin::FLAG_DELETE_ITEM | Plugin::FLAG_STOP_LOOP;
-                                    }
-                                    return 0;
-                                });
-                                playlist->Release();
-                            }
-                            break;
-                        }
+                // Copied, removing the item updates the index
+                std::vector<std::size_t> owners = Config::UserPlaylistsWith(id);
+                for (auto i : owners) {
+                    Config::Playlist &x = Config::UserPlaylists[i];
+                    Config::RemoveUserPlaylistItem(x, id);
+                    if (IAIMPPlaylist *playlist = Plugin::instance()->GetPlaylistById(x.AIMPPlaylistId)) {
+                        PlaylistIndex::Remove(playlist, id);
+                        playlist->Release();
                     }
                 }
-                Config::TrackExclusions.insert(id);
+                Config::SetTrackExcluded(id, true);
                 Config::SaveExtendedConfig();
                 IAIMPPlaylist *parent = nullptr;
                 if (SUCCEEDED(currentTrack->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_PLAYLIST, IID_IAIMPPlaylist, reinterpret_cast<void **>(&parent)))) {
@@ -71,10 +65,15 @@ void WINAPI MessageHook::CoreMessage(DWORD AMessage, int AParam1, void *AParam2,
             std::remove_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), [&](const Config::MonitorUrl &element) -> bool {
             return deleted.find(Tools::TrackIdFromUrl(element.URL)) != deleted.end();
         }), Config::MonitorUrls.end());
+        Config::MonitorUrlsChanged();
 
         Config::SaveExtendedConfig();
     }
 
+    if (AMessage == AIMP_MSG_EVENT_STREAM_START) {
+        Prefetcher::TrackStarted();
+    }
+
     if (AMessage == AIMP_MSG_CMD_BOOKMARKS_ADD) {
         IAIMPString *url = nullptr;
         IAIMPPlaylistItem *currentTrack = m_plugin->GetCurrentTrack();
@@ -0,0 +1,142 @@
+#include "MonitorScheduler.h"
+#include "AIMPYouTube.h"
+#include <algorithm>
+#include <cstdio>
+#include <ctime>
+
+bool MonitorScheduler::m_running = false;
+int MonitorScheduler::m_active = 0;
+DWORD MonitorScheduler::m_started = 0;
+std::vector<MonitorScheduler::Result> MonitorScheduler::m_results;
+std::deque<std::size_t> MonitorScheduler::m_pending;
+std::set<std::wstring> MonitorScheduler::m_busyPlaylists;
+
+void MonitorScheduler::StartSweep(const std::vector<Config::MonitorUrl> &urls) {
+    if (m_running)
+        return; // Previous sweep still running
+
+    m_running = true;
+    m_active = 0;
+    m_started = GetTickCount();
+    m_results.clear();
+    m_pending.clear();
+    m_busyPlaylists.clear();
+
+    for (const auto &x : urls) {
+        m_pending.push_back(m_results.size());
+        m_results.push_back({ x, 0, 0, 0, 0, false, false });
+    }
+    Next();
+}
+
+void MonitorScheduler::Deinit() {
+    m_running = false;
+    m_active = 0;
+    m_results.clear();
+    m_pending.clear();
+    m_busyPlaylists.clear();
+}
+
+void MonitorScheduler::Next() {
+    int limit = (std::max)(1, Config::GetInt32(L"MonitorConcurrency", 4));
+    for (auto it = m_pending.begin(); it != m_pending.end() && m_active < limit;) {
+        Result &result = m_results[*it];
+        if (m_busyPlaylists.count(result.Url.PlaylistID)) {
+            ++it;
+            continue;
+        }
+
+        std::size_t index = *it;
+        it = m_pending.erase(it);
+        result.Started = GetTickCount();
+
+        IAIMPPlaylist *pl = Plugin::instance()->GetPlaylistById(result.Url.PlaylistID, false);
+        if (!pl) {
+            result.Skipped = true;
+            continue;
+        }
+
+        auto state = std::make_shared<YouTubeAPI::LoadingState>();
+        state->ReferenceName = result.Url.GroupName;
+        state->Flags = result.Url.Flags;
+        state->ETag = result.Url.ETag;
+        state->KnownPublishedAt = result.Url.LastPublishedAt;
+
+        YouTubeAPI::GetExistingTrackIds(pl, state);
+
+        m_active++;
+        m_busyPlaylists.insert(result.Url.PlaylistID);
+        YouTubeAPI::LoadFromUrl(result.Url.URL, pl, state, [index, state] {
+            Finished(index, state);
+        });
+    }
+
+    if (m_active == 0 && m_pending.empty() && m_running) {
+        m_running = false;
+        Config::SaveExtendedConfig();
+        WriteReport();
+    }
+}
+
+void MonitorScheduler::Finished(std::size_t index, std::shared_ptr<YouTubeAPI::LoadingState> state) {
+    Result &result = m_results[index];
+    result.Duration = GetTickCount() - result.Started;
+    result.ItemsAdded = state->AddedItems;
+    result.FailedRequests = state->FailedRequests;
+    result.NotModified = state->NotModified;
+    UpdateWatermarks(result, *state);
+
+    m_active--;
+    m_busyPlaylists.erase(result.Url.PlaylistID);
+    Next();
+}
+
+void MonitorScheduler::UpdateWatermarks(const Result &result, const YouTubeAPI::LoadingState &state) {
+    if (state.FailedRequests > 0)
+        return; // Something may have been missed, check everything again next time
+
+    for (auto &x : Config::MonitorUrls) {
+        if (x.URL != result.Url.URL || x.PlaylistID != result.Url.PlaylistID)
+            continue;
+
+        if (!state.NewETag.empty())
+            x.ETag = state.NewETag;
+        if (state.NewestPublishedAt > x.LastPublishedAt)
+            x.LastPublishedAt = state.NewestPublishedAt;
+    }
+    Config::MonitorUrlsChanged();
+}
+
+void MonitorScheduler::WriteReport() {
+    DWORD duration = GetTickCount() - m_started;
+    int added = 0, failed = 0, skipped = 0;
+    for (const auto &x : m_results) {
+        added += x.ItemsAdded;
+        failed += x.FailedRequests > 0;
+        skipped += x.Skipped;
+    }
+
+    std::wstring reportFile = Config::PluginConfigFolder() + L"MonitorReport.txt";
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, reportFile.c_str(), L"w, ccs=UTF-8") != 0)
+        return;
+
+    wchar_t date[64] = { 0 };
+    std::time_t now = std::time(nullptr);
+    std::tm tm;
+    if (localtime_s(&tm, &now) == 0)
+        wcsftime(date, 64, L"%Y-%m-%d %H:%M:%S", &tm);
+
+    fwprintf(file, L"Sweep finished %s: %u urls in %u ms, %d items added, %d failed, %d skipped\n",
+             date, unsigned(m_results.size()), unsigned(duration), added, failed, skipped);
+    for (const auto &x : m_results) {
+        if (x.Skipped) {
+            fwprintf(file, L"skipped  %s (playlist not found)\n", x.Url.URL.c_str());
+        } else if (x.NotModified) {
+            fwprintf(file, L"%6u ms  not modified  %s\n", unsigned(x.Duration), x.Url.URL.c_str());
+        } else {
+            fwprintf(file, L"%6u ms  +%d  %d failed  %s\n", unsigned(x.Duration), x.ItemsAdded, x.FailedRequests, x.Url.URL.c_str());
+        }
+    }
+    fclose(file);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <set>
+#include <memory>
+#include "Config.h"
+#include "YouTubeAPI.h"
+
+// Runs a monitor sweep over Config::MonitorUrls with up to MonitorConcurrency urls loading at once.
+// Urls of the same playlist are loaded one after another to keep their insert order.
+// When the sweep is done a report is written to <PluginConfigFolder>\MonitorReport.txt
+class MonitorScheduler {
+public:
+    static bool Running() { return m_running; }
+    static void StartSweep(const std::vector<Config::MonitorUrl> &urls);
+    // Forgets a sweep whose loads were cut off by the shutdown
+    static void Deinit();
+
+private:
+    struct Result {
+        Config::MonitorUrl Url;
+        DWORD Started;
+        DWORD Duration;
+        int ItemsAdded;
+        int FailedRequests;
+        bool NotModified;
+        bool Skipped;
+    };
+
+    static void Next();
+    static void Finished(std::size_t index, std::shared_ptr<YouTubeAPI::LoadingState> state);
+    static void UpdateWatermarks(const Result &result, const YouTubeAPI::LoadingState &state);
+    static void WriteReport();
+
+    MonitorScheduler();
+    MonitorScheduler(const MonitorScheduler &);
+    MonitorScheduler &operator=(const MonitorScheduler &);
+
+    static bool m_running;
+    static int m_active;
+    static DWORD m_started;
+    static std::vector<Result> m_results;
+    static std::deque<std::size_t> m_pending;
+    static std::set<std::wstring> m_busyPlaylists;
+};
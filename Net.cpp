@@ -0,0 +1,85 @@
+#include <WinSock2.h>
+#include <WS2tcpip.h>
+#include <Windows.h>
+
+#include "Net.h"
+#pragma comment(lib,"ws2_32.lib")
+
+bool Net::Startup() {
+    WSADATA wsaData;
+    if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
+        Trace("WSAStartup failed.\n");
+        return false;
+    }
+    return true;
+}
+
+void Net::Cleanup() {
+    WSACleanup();
+}
+
+bool Net::Resolve(const std::string &host, uint32_t *ip) {
+    struct addrinfo hints;
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *info = NULL;
+    if (getaddrinfo(host.c_str(), NULL, &hints, &info) != 0 || info == NULL)
+        return false;
+
+    *ip = ((struct sockaddr_in *)info->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(info);
+    return true;
+}
+
+Net::Socket Net::Connect(uint32_t ip, unsigned short port, int timeout) {
+    SOCKET s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) {
+        Trace("Creation of the Socket Failed\n");
+        return Invalid;
+    }
+
+    DWORD ms = timeout;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char *>(&ms), sizeof(ms));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, reinterpret_cast<const char *>(&ms), sizeof(ms));
+    BOOL noDelay = TRUE;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&noDelay), sizeof(noDelay));
+
+    SOCKADDR_IN sockAddr;
+    ZeroMemory(&sockAddr, sizeof(sockAddr));
+    sockAddr.sin_family = AF_INET;
+    sockAddr.sin_addr.s_addr = ip;
+    sockAddr.sin_port = htons(port);
+    if (connect(s, (SOCKADDR *)&sockAddr, sizeof(sockAddr)) != 0) {
+        Trace("Could not connect\n");
+        closesocket(s);
+        return Invalid;
+    }
+    return Socket(s);
+}
+
+int Net::Send(Socket s, const char *data, int size) {
+    return send(SOCKET(s), data, size, 0);
+}
+
+int Net::Receive(Socket s, char *data, int size) {
+    return recv(SOCKET(s), data, size, 0);
+}
+
+void Net::Shutdown(Socket s) {
+    shutdown(SOCKET(s), SD_BOTH);
+}
+
+void Net::Close(Socket s) {
+    closesocket(SOCKET(s));
+}
+
+uint32_t Net::Ticks() {
+    return GetTickCount();
+}
+
+void Net::Trace(const std::string &message) {
+    OutputDebugStringA(message.c_str());
+}
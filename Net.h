@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+// The sockets and the clock ConnectionPool uses. Net.cpp implements them on WinSock, tests/ links its own
+// implementation over loopback sockets with a clock the tests move.
+struct Net {
+    // SOCKET, WinSock2.h can't be included after the windows.h the other headers pull in
+    typedef uintptr_t Socket;
+    static const Socket Invalid = ~Socket(0);
+
+    static bool Startup();
+    static void Cleanup();
+
+    // IPv4 address of host, in network byte order
+    static bool Resolve(const std::string &host, uint32_t *ip);
+    // Connected socket with Nagle off and timeout (ms) for sends and receives, Invalid if that fails
+    static Socket Connect(uint32_t ip, unsigned short port, int timeout);
+    // Like send/recv: bytes transferred, 0 when closed by the peer, < 0 on errors and timeouts
+    static int Send(Socket s, const char *data, int size);
+    static int Receive(Socket s, char *data, int size);
+    // Makes a Send/Receive blocked on s return
+    static void Shutdown(Socket s);
+    static void Close(Socket s);
+
+    // Milliseconds, wrapping around like GetTickCount
+    static uint32_t Ticks();
+    static void Trace(const std::string &message);
+};
@@ -3,6 +3,7 @@
 #include "resource.h"
 #include "TcpServer.h"
 #include "AimpHTTP.h"
+#include "JsonResponse.h"
 #include "Tools.h"
 #include "rapidjson/document.h"
 #include "AIMPYouTube.h"
@@ -151,6 +152,7 @@ void WINAPI OptionsDialog::Notification(int ID) {
             if (m_userPlaylists.size() > 0) {
                 Config::UserPlaylists.clear();
                 Config::UserPlaylists.swap(m_userPlaylists);
+                Config::UserPlaylistsChanged();
             }
             m_plugin->UpdatePlaylistMenu();
             Config::SaveExtendedConfig();
@@ -167,8 +169,8 @@ void OptionsDialog::LoadProfileInfo(std::function<void()> onFinished) {
     }
     std::wstring auth = L"\r\nAuthorization: Bearer " + m_plugin->getAccessToken();
     AimpHTTP::Get(L"https://www.googleapis.com/plus/v1/people/me" + auth, [this](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
+        JsonResponse response(data, size);
+        rapidjson::Document &d = *response;
 
         if (d.IsObject() && d.HasMember("id")) {
             m_userId = Tools::ToWString(d["id"]);
@@ -200,8 +202,8 @@ void OptionsDialog::LoadProfileInfo(std::function<void()> onFinished) {
 
     m_userPlaylists.clear();
     AimpHTTP::Get(L"https://www.googleapis.com/youtube/v3/channels?part=contentDetails%2Csnippet&mine=true&fields=items(contentDetails%2Csnippet)" + auth, [this, auth, onFinished](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
+        JsonResponse response(data, size);
+        rapidjson::Document &d = *response;
 
         if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0 && d["items"][0].HasMember("contentDetails")) {
             const rapidjson::Value &i = d["items"][0]["contentDetails"]["relatedPlaylists"];
@@ -216,8 +218,8 @@ void OptionsDialog::LoadProfileInfo(std::function<void()> onFinished) {
 
         // Load standard playlists
         AimpHTTP::Get(L"https://www.googleapis.com/youtube/v3/playlists?part=snippet&maxResults=50&mine=true&fields=items(id%2Csnippet)" + auth, [this, onFinished](unsigned char *data, int size) {
-            rapidjson::Document d;
-            d.Parse(reinterpret_cast<const char *>(data));
+            JsonResponse response(data, size);
+            rapidjson::Document &d = *response;
 
             if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0) {
                 for (auto x = d["items"].Begin(), e = d["items"].End(); x != e; x++) {
@@ -708,6 +710,7 @@ BOOL CALLBACK OptionsDialog::DlgProc(HWND hwnd, UINT Msg, WPARAM wParam, LPARAM
                         dialog->m_userYTName.clear();
                         dialog->m_userPlaylists.clear();
                         Config::UserPlaylists.clear();
+                        Config::UserPlaylistsChanged();
                         std::wstring path = Config::PluginConfigFolder() + L"user_avatar.jpg";
                         DeleteFile(path.c_str());
 
@@ -782,8 +785,8 @@ void OptionsDialog::Connect(std::function<void()> onFinished) {
             postData += token;
 
             AimpHTTP::Post(L"https://accounts.google.com/o/oauth2/token", postData, [onFinished](unsigned char *data, int size) {
-                rapidjson::Document d;
-                d.Parse(reinterpret_cast<const char *>(data));
+                JsonResponse response(data, size);
+                rapidjson::Document &d = *response;
 
                 if (d.HasMember("access_token")) {
                     Plugin::instance()->setAccessToken(Tools::ToWString(d["access_token"]), Tools::ToWString(d["refresh_token"]), d["expires_in"].GetUint());
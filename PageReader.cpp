@@ -0,0 +1,160 @@
+#include "PageReader.h"
+#include "ParseTools.h"
+#include <cstring>
+
+bool PageReader::Read(char *json, Page *page) {
+    Handler handler(page);
+    rapidjson::InsituStringStream stream(json);
+    rapidjson::Reader reader;
+    if (reader.Parse<rapidjson::kParseInsituFlag>(stream, handler))
+        return page->Valid;
+
+    // Like a document that doesn't parse, nothing of it is used
+    *page = Page();
+    return false;
+}
+
+PageReader::Key PageReader::Lookup(const char *str, rapidjson::SizeType length) {
+    struct Name {
+        const char *Str;
+        PageReader::Key Key;
+    };
+    static const Name names[] = {
+        { "items", Items }, { "id", Id }, { "snippet", Snippet }, { "title", Title }, { "resourceId", ResourceId },
+        { "videoId", VideoIdKey }, { "channelTitle", ChannelTitle }, { "thumbnails", Thumbnails }, { "high", High },
+        { "url", Url }, { "publishedAt", PublishedAt }, { "localized", Localized }, { "contentDetails", ContentDetails },
+        { "duration", Duration }, { "relatedPlaylists", RelatedPlaylists }, { "uploads", Uploads },
+        { "nextPageToken", NextPageToken }, { "error", Error }
+    };
+    // str is 0 terminated in place, so its first byte can be compared before the length
+    for (const auto &x : names) {
+        if (x.Str[0] == str[0] && strlen(x.Str) == length && memcmp(x.Str, str, length) == 0)
+            return x.Key;
+    }
+    return Other;
+}
+
+bool PageReader::Handler::At(PageReader::Key a, PageReader::Key b, PageReader::Key c, PageReader::Key d, PageReader::Key e, PageReader::Key f) const {
+    const PageReader::Key path[] = { a, b, c, d, e, f };
+    int length = 0;
+    while (length < 6 && path[length] != Other)
+        length++;
+
+    if (m_depth != length)
+        return false;
+    for (int i = 0; i < length; ++i) {
+        if (m_path[i] != path[i])
+            return false;
+    }
+    return true;
+}
+
+void PageReader::Handler::Push(PageReader::Key key) {
+    if (m_depth < MaxDepth)
+        m_path[m_depth] = key;
+    m_depth++;
+}
+
+bool PageReader::Handler::StartObject() {
+    if (m_depth == 0) {
+        m_page->Valid = true;
+    } else if (At(Items, Element)) {
+        m_item = Item();
+        m_resourceId = false;
+    }
+    Push(Other);
+    return true;
+}
+
+bool PageReader::Handler::EndObject(rapidjson::SizeType) {
+    m_depth--;
+    if (At(Items, Element)) {
+        if (!m_resourceId)
+            m_item.VideoId = m_item.Id;
+        m_page->Items.push_back(std::move(m_item));
+    }
+    return true;
+}
+
+bool PageReader::Handler::StartArray() {
+    Push(Element);
+    return true;
+}
+
+bool PageReader::Handler::EndArray(rapidjson::SizeType) {
+    m_depth--;
+    return true;
+}
+
+bool PageReader::Handler::Key(const char *str, rapidjson::SizeType length, bool) {
+    if (m_depth > MaxDepth)
+        return true;
+
+    PageReader::Key key = PageReader::Lookup(str, length);
+    m_path[m_depth - 1] = key;
+    if (m_depth == 1 && key == Error) {
+        m_page->Valid = false;
+    } else if (At(Items, Element, Snippet, ResourceId)) {
+        m_resourceId = true;
+    } else if (At(Items, Element, ContentDetails, RelatedPlaylists) && m_page->Items.empty()) {
+        m_page->IsChannel = true;
+    }
+    return true;
+}
+
+bool PageReader::Handler::String(const char *str, rapidjson::SizeType length, bool) {
+    // Strings are 0 terminated in place. The key a string belongs to picks the one path it can be on.
+    if (m_depth == 0 || m_depth > MaxDepth)
+        return true;
+
+    switch (m_path[m_depth - 1]) {
+        case NextPageToken:
+            if (At(NextPageToken))
+                m_page->NextPageToken = ParseTools::Utf8ToWString(str, length);
+            break;
+        case Id:
+            if (At(Items, Element, Id))
+                m_item.Id = ParseTools::Utf8ToWString(str, length);
+            break;
+        case Title:
+            if (At(Items, Element, Snippet, Title)) {
+                m_item.Title = ParseTools::Utf8ToWString(str, length);
+                m_item.HasTitle = true;
+            } else if (m_page->Items.empty() && At(Items, Element, Snippet, Localized, Title)) {
+                m_page->ChannelName = ParseTools::Utf8ToWString(str, length);
+            }
+            break;
+        case ChannelTitle:
+            if (At(Items, Element, Snippet, ChannelTitle)) {
+                m_item.ChannelTitle = ParseTools::Utf8ToWString(str, length);
+                m_item.HasChannelTitle = true;
+            }
+            break;
+        case PublishedAt:
+            if (At(Items, Element, Snippet, PublishedAt))
+                m_item.PublishedAt = ParseTools::Utf8ToWString(str, length);
+            break;
+        case VideoIdKey:
+            if (At(Items, Element, Snippet, ResourceId, VideoIdKey))
+                m_item.VideoId = ParseTools::Utf8ToWString(str, length);
+            break;
+        case Url:
+            if (At(Items, Element, Snippet, Thumbnails, High, Url))
+                m_item.Artwork = ParseTools::Utf8ToWString(str, length);
+            break;
+        case Duration:
+            if (At(Items, Element, ContentDetails, Duration)) {
+                double seconds = 0;
+                if (ParseTools::ParseDuration(str, length, &seconds))
+                    m_item.Duration = seconds;
+            }
+            break;
+        case Uploads:
+            if (m_page->Items.empty() && At(Items, Element, ContentDetails, RelatedPlaylists, Uploads))
+                m_page->Uploads = ParseTools::Utf8ToWString(str, length);
+            break;
+        default:
+            break;
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "rapidjson/reader.h"
+#include <string>
+#include <vector>
+
+// Single pass SAX reader for playlistItems, videos and channels pages. Only the fields the loader uses
+// are kept, as compact item records, instead of building a DOM of the whole page.
+class PageReader {
+public:
+    struct Item {
+        std::wstring Id;
+        // snippet.resourceId.videoId of playlist items, the id otherwise
+        std::wstring VideoId;
+        std::wstring Title;
+        std::wstring ChannelTitle;
+        std::wstring Artwork;
+        std::wstring PublishedAt;
+        // contentDetails.duration in seconds, -1 without one
+        double Duration{ -1 };
+        bool HasTitle{ false };
+        bool HasChannelTitle{ false };
+    };
+
+    struct Page {
+        // An object without "error"
+        bool Valid{ false };
+        std::wstring NextPageToken;
+        std::vector<Item> Items;
+        // Channels, taken from the first item: its uploads playlist and snippet.localized.title
+        bool IsChannel{ false };
+        std::wstring Uploads;
+        std::wstring ChannelName;
+    };
+
+    // Parses in place, json is modified
+    static bool Read(char *json, Page *page);
+
+private:
+    enum Key { Other, Items, Element, Id, Snippet, Title, ResourceId, VideoIdKey, ChannelTitle, Thumbnails, High, Url,
+               PublishedAt, Localized, ContentDetails, Duration, RelatedPlaylists, Uploads, NextPageToken, Error };
+
+    class Handler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, Handler> {
+    public:
+        explicit Handler(Page *page) : m_page(page) {}
+
+        bool String(const char *str, rapidjson::SizeType length, bool);
+        bool Key(const char *str, rapidjson::SizeType length, bool);
+        bool StartObject();
+        bool EndObject(rapidjson::SizeType);
+        bool StartArray();
+        bool EndArray(rapidjson::SizeType);
+
+    private:
+        bool At(PageReader::Key a, PageReader::Key b = Other, PageReader::Key c = Other, PageReader::Key d = Other,
+                PageReader::Key e = Other, PageReader::Key f = Other) const;
+        void Push(PageReader::Key key);
+
+        static const int MaxDepth = 8;
+
+        Page *m_page;
+        // Key (or Element) per open container, deeper levels only count
+        PageReader::Key m_path[MaxDepth];
+        int m_depth{ 0 };
+        Item m_item;
+        bool m_resourceId{ false };
+    };
+
+    static PageReader::Key Lookup(const char *str, rapidjson::SizeType length);
+
+    PageReader();
+    PageReader(const PageReader &);
+    PageReader &operator=(const PageReader &);
+};
@@ -0,0 +1,177 @@
+#include "ParseTools.h"
+#include <cwchar>
+#include <cstring>
+
+static inline bool StartsWith(const wchar_t *p, const wchar_t *prefix) {
+    while (*prefix && *p == *prefix) {
+        ++p;
+        ++prefix;
+    }
+    return *prefix == 0;
+}
+
+static inline std::size_t SpanUntil(const wchar_t *p, const wchar_t *stop) {
+    std::size_t n = 0;
+    while (p[n] && !wcschr(stop, p[n]))
+        ++n;
+    return n;
+}
+
+ParseTools::UrlKind ParseTools::ClassifyUrl(const wchar_t *url, const wchar_t **id, std::size_t *idLength) {
+    *id = nullptr;
+    *idLength = 0;
+    if (!url)
+        return UrlOther;
+
+    // First occurrence of every marker, found in one pass
+    const wchar_t *youtubeCom = nullptr, *youtuBe = nullptr, *api = nullptr, *internal = nullptr;
+    const wchar_t *qv = nullptr, *av = nullptr, *qid = nullptr, *aid = nullptr, *qlist = nullptr, *alist = nullptr;
+    const wchar_t *user = nullptr, *channel = nullptr, *slash = nullptr;
+    for (const wchar_t *p = url; *p; ++p) {
+        switch (*p) {
+            case L'y':
+                if (!youtubeCom && StartsWith(p, L"youtube.com")) youtubeCom = p;
+                else if (!internal && StartsWith(p, L"youtube://")) internal = p;
+                else if (!youtuBe && StartsWith(p, L"youtu.be")) youtuBe = p;
+                break;
+            case L'g':
+                if (!api && StartsWith(p, L"googleapis.com/youtube/v3")) api = p;
+                break;
+            case L'?':
+            case L'&': {
+                bool q = *p == L'?';
+                const wchar_t **v = q ? &qv : &av, **i = q ? &qid : &aid, **l = q ? &qlist : &alist;
+                if (!*v && StartsWith(p + 1, L"v=")) *v = p + 3;
+                else if (!*i && StartsWith(p + 1, L"id=")) *i = p + 4;
+                else if (!*l && StartsWith(p + 1, L"list=")) *l = p + 6;
+            } break;
+            case L'/':
+                if (!slash && p - url >= 8) slash = p + 1;
+                if (!user && StartsWith(p, L"/user/")) user = p + 6;
+                else if (!channel && StartsWith(p, L"/channel/")) channel = p + 9;
+                break;
+        }
+    }
+
+    UrlKind kind = UrlOther;
+    const wchar_t *stop = L"&";
+    if (youtubeCom) {
+        if ((*id = qv ? qv : av) != nullptr) {
+            kind = UrlWatch;
+        } else if ((*id = user) != nullptr) {
+            kind = UrlUser;
+            stop = L"/?&";
+        } else if ((*id = channel) != nullptr) {
+            kind = UrlChannel;
+            stop = L"/?&";
+        } else if ((*id = qlist ? qlist : alist) != nullptr) {
+            kind = UrlPlaylist;
+        }
+    } else if (youtuBe) {
+        if ((*id = slash) != nullptr) {
+            kind = UrlShortLink;
+            stop = L"?&";
+        }
+    } else if (api) {
+        if ((*id = aid ? aid : qid) != nullptr)
+            kind = UrlApi;
+    } else if (internal) {
+        *id = internal + 10;
+        kind = UrlInternal;
+        stop = L"/";
+    }
+
+    if (*id)
+        *idLength = SpanUntil(*id, stop);
+    return kind;
+}
+
+bool ParseTools::ParseDuration(const char *duration, std::size_t length, double *seconds) {
+    static const char dateUnits[] = "YMWD";
+    static const double dateSeconds[] = { 365 * 86400, 30 * 86400, 7 * 86400, 86400 };
+    static const char timeUnits[] = "HMS";
+    static const double timeSeconds[] = { 3600, 60, 1 };
+
+    const char *p = duration, *end = duration + length;
+    if (p == end || *p++ != 'P')
+        return false;
+
+    double total = 0;
+    bool time = false, fraction = false;
+    int next = 0, dateCount = 0, timeCount = 0;
+    while (p < end) {
+        if (*p == 'T') {
+            if (time)
+                return false;
+            time = true;
+            next = 0;
+            ++p;
+            continue;
+        }
+        if (fraction)
+            return false; // Only the smallest value can have a fraction
+
+        double value = 0;
+        int digits = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; ++p, ++digits)
+            value = value * 10 + (*p - '0');
+        if (p < end && (*p == '.' || *p == ',')) {
+            fraction = true;
+            double scale = 0.1;
+            for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++digits, scale /= 10)
+                value += (*p - '0') * scale;
+        }
+        if (digits == 0 || p == end || *p == 0)
+            return false;
+
+        // Units have to come in order and at most once
+        const char *units = time ? timeUnits : dateUnits;
+        const char *unit = strchr(units + next, *p++);
+        if (!unit)
+            return false;
+
+        next = int(unit - units) + 1;
+        total += value * (time ? timeSeconds : dateSeconds)[unit - units];
+        (time ? timeCount : dateCount)++;
+    }
+
+    if ((time && timeCount == 0) || dateCount + timeCount == 0)
+        return false;
+
+    *seconds = total;
+    return true;
+}
+
+std::wstring ParseTools::Utf8ToWString(const char *utf8, std::size_t length) {
+    static const unsigned minimum[] = { 0, 0x80, 0x800, 0x10000 };
+    // Never longer than the input: a surrogate pair takes 4 bytes, U+FFFD at least one
+    std::wstring result(length, 0);
+    wchar_t *out = length ? &result[0] : nullptr;
+    const unsigned char *p = reinterpret_cast<const unsigned char *>(utf8), *end = p + length;
+    while (p < end) {
+        unsigned c = *p++;
+        if (c < 0x80) {
+            *out++ = wchar_t(c);
+            continue;
+        }
+
+        // Lead bytes C0, C1 and F5-FF never start a valid sequence, neither do continuation bytes
+        int extra = c < 0xC2 ? 0 : c < 0xE0 ? 1 : c < 0xF0 ? 2 : c < 0xF5 ? 3 : 0;
+        unsigned code = extra ? c & (0x3F >> extra) : 0xFFFD;
+        int i = 0;
+        for (; i < extra && p < end && (*p & 0xC0) == 0x80; ++i)
+            code = code << 6 | (*p++ & 0x3F);
+        if (i < extra || code < minimum[extra] || code > 0x10FFFF || (code >= 0xD800 && code < 0xE000))
+            code = 0xFFFD;
+
+        if (code >= 0x10000 && sizeof(wchar_t) == 2) {
+            code -= 0x10000;
+            *out++ = wchar_t(0xD800 + (code >> 10));
+            *out++ = wchar_t(0xDC00 + (code & 0x3FF));
+        } else {
+            *out++ = wchar_t(code);
+        }
+    }
+    result.resize(out - (length ? &result[0] : nullptr));
+    return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Parsing helpers that don't depend on Windows, also built by tests/. Tools derives from it.
+struct ParseTools {
+    enum UrlKind {
+        UrlOther,
+        UrlWatch,     // youtube.com/watch?v=
+        UrlShortLink, // youtu.be/
+        UrlInternal,  // youtube://
+        UrlApi,       // googleapis.com/youtube/v3/...?id=
+        UrlPlaylist,
+        UrlChannel,
+        UrlUser
+    };
+    // Allocation-free, id is a view into url: the video id, or the playlist/channel/user id for those kinds
+    static UrlKind ClassifyUrl(const wchar_t *url, const wchar_t **id, std::size_t *idLength);
+    static bool IsVideoUrl(UrlKind kind) { return kind >= UrlWatch && kind <= UrlApi; }
+
+    // ISO-8601 duration (P[n]Y[n]M[n]W[n]D[T[n]H[n]M[n]S], the last value may be fractional) in seconds.
+    // Years and months count as 365 and 30 days.
+    static bool ParseDuration(const char *duration, std::size_t length, double *seconds);
+
+    // UTF-16 where wchar_t is (UTF-32 elsewhere), invalid sequences become U+FFFD instead of throwing
+    static std::wstring Utf8ToWString(const char *utf8, std::size_t length);
+};
@@ -4,10 +4,13 @@
 #include "YouTubeAPI.h"
 
 HRESULT WINAPI PlayerHook::OnCheckURL(IAIMPString *URL, BOOL *Handled) {
-    if (wcsstr(URL->GetData(), L"youtube.com") == nullptr && wcsstr(URL->GetData(), L"youtube://") == nullptr)
+    const wchar_t *idStart;
+    std::size_t idLength;
+    Tools::UrlKind kind = Tools::ClassifyUrl(URL->GetData(), &idStart, &idLength);
+    if (kind != Tools::UrlWatch && kind != Tools::UrlInternal)
         return E_FAIL;
 
-    std::wstring id = Tools::TrackIdFromUrl(URL->GetData());
+    std::wstring id(idStart, idLength);
     std::wstring stream_url = YouTubeAPI::GetStreamUrl(id);
     URL->SetData(const_cast<wchar_t *>(stream_url.c_str()), stream_url.size());
 
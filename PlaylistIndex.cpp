@@ -0,0 +1,210 @@
+#include "PlaylistIndex.h"
+#include "AIMPYouTube.h"
+#include "Tools.h"
+
+std::mutex PlaylistIndex::m_mutex;
+std::unordered_map<std::wstring, PlaylistIndex::Entry> PlaylistIndex::m_entries;
+std::wstring PlaylistIndex::m_ownChange;
+DWORD PlaylistIndex::m_ownChangeThread = 0;
+
+void WINAPI PlaylistIndex::Watcher::Changed(DWORD Flags) {
+    if (!(Flags & AIMP_PLAYLIST_NOTIFY_CONTENT))
+        return;
+
+    std::unique_lock<std::mutex> lock(PlaylistIndex::m_mutex);
+    if (PlaylistIndex::m_ownChangeThread == GetCurrentThreadId() && PlaylistIndex::m_ownChange == m_playlistId)
+        return;
+
+    auto it = PlaylistIndex::m_entries.find(m_playlistId);
+    if (it != PlaylistIndex::m_entries.end())
+        it->second.Dirty = true;
+}
+
+PlaylistIndex::Insertion::Insertion(IAIMPPlaylist *pl) : m_playlist(pl), m_playlistId(Plugin::instance()->PlaylistId(pl)) {
+    // Insertions nest, AddPage() holds one around the update and AddItems() another
+    std::unique_lock<std::mutex> lock(PlaylistIndex::m_mutex);
+    m_previous = PlaylistIndex::m_ownChange;
+    m_previousThread = PlaylistIndex::m_ownChangeThread;
+    PlaylistIndex::m_ownChange = m_playlistId;
+    PlaylistIndex::m_ownChangeThread = GetCurrentThreadId();
+}
+
+PlaylistIndex::Insertion::~Insertion() {
+    std::unique_lock<std::mutex> lock(PlaylistIndex::m_mutex);
+    PlaylistIndex::m_ownChange = m_previous;
+    PlaylistIndex::m_ownChangeThread = m_previousThread;
+}
+
+void PlaylistIndex::Insertion::Added(const VideoId &id, int index) {
+    std::unique_lock<std::mutex> lock(PlaylistIndex::m_mutex);
+    auto it = PlaylistIndex::m_entries.find(m_playlistId);
+    if (it == PlaylistIndex::m_entries.end() || it->second.Dirty)
+        return; // Built from the playlist when it's needed
+
+    Entry &entry = it->second;
+    if (index < 0)
+        index = m_playlist->GetItemCount() - 1;
+
+    IAIMPPlaylistItem *item = nullptr;
+    if (FAILED(m_playlist->GetItem(index, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item)))) {
+        entry.Dirty = true;
+        return;
+    }
+
+    if (PlaylistIndex::ItemId(item) != id) {
+        // Not where we expected it, rescan rather than guess
+        item->Release();
+        entry.Dirty = true;
+        return;
+    }
+
+    entry.Ids.insert(id);
+    entry.Items.insert(std::make_pair(id, item));
+}
+
+void WINAPI PlaylistIndex::Watcher::Removed() {
+    std::wstring playlistId(m_playlistId); // Forget() releases this
+    PlaylistIndex::Forget(playlistId);
+}
+
+void PlaylistIndex::Deinit() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::unordered_map<std::wstring, Entry> entries;
+    entries.swap(m_entries);
+    lock.unlock();
+
+    for (auto &x : entries)
+        Release(x.second);
+}
+
+void PlaylistIndex::Forget(const std::wstring &playlistId) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(playlistId);
+    if (it == m_entries.end())
+        return;
+
+    Entry entry = it->second;
+    m_entries.erase(it);
+    lock.unlock();
+
+    Release(entry);
+}
+
+PlaylistIndex::Entry *PlaylistIndex::Lookup(IAIMPPlaylist *pl) {
+    // Called with m_mutex held
+    std::wstring playlistId = Plugin::instance()->PlaylistId(pl);
+    if (playlistId.empty())
+        return nullptr;
+
+    auto it = m_entries.find(playlistId);
+    if (it == m_entries.end()) {
+        Entry entry;
+        entry.Playlist = pl;
+        entry.Playlist->AddRef();
+        entry.Listener = new Watcher(playlistId);
+        entry.Listener->AddRef();
+        entry.Dirty = true;
+        pl->ListenerAdd(entry.Listener);
+        it = m_entries.insert(std::make_pair(playlistId, entry)).first;
+    }
+
+    if (it->second.Dirty)
+        Rebuild(it->second);
+    return &it->second;
+}
+
+void PlaylistIndex::Rebuild(Entry &entry) {
+    Clear(entry);
+
+    IAIMPPlaylist *pl = entry.Playlist;
+    int n = pl->GetItemCount();
+    entry.Ids.reserve(n);
+    entry.Items.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        IAIMPPlaylistItem *item = nullptr;
+        if (FAILED(pl->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item))))
+            continue;
+
+        VideoId videoId = ItemId(item);
+        if (videoId.Empty()) {
+            item->Release();
+            continue;
+        }
+
+        entry.Ids.insert(videoId);
+        entry.Items.insert(std::make_pair(videoId, item));
+    }
+    entry.Dirty = false;
+}
+
+VideoId PlaylistIndex::ItemId(IAIMPPlaylistItem *item) {
+    VideoId videoId;
+    IAIMPString *url = nullptr;
+    if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
+        videoId = Tools::VideoIdFromUrl(url->GetData());
+        url->Release();
+    }
+    return videoId;
+}
+
+void PlaylistIndex::Clear(Entry &entry) {
+    for (auto &x : entry.Items)
+        x.second->Release();
+
+    entry.Items.clear();
+    entry.Ids.clear();
+}
+
+void PlaylistIndex::Release(Entry &entry) {
+    Clear(entry);
+    entry.Playlist->ListenerRemove(entry.Listener);
+    entry.Listener->Release();
+    entry.Playlist->Release();
+}
+
+void PlaylistIndex::TrackIds(IAIMPPlaylist *pl, VideoIdSet &ids) {
+    if (!pl)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (Entry *entry = Lookup(pl)) {
+        ids.reserve(ids.size() + entry->Ids.size());
+        for (auto x : entry->Ids)
+            ids.insert(x);
+    }
+}
+
+bool PlaylistIndex::Remove(IAIMPPlaylist *pl, const VideoId &id) {
+    if (!pl)
+        return false;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Entry *entry = Lookup(pl);
+    if (!entry)
+        return false;
+
+    auto it = entry->Items.find(id);
+    if (it == entry->Items.end())
+        return false;
+
+    IAIMPPlaylistItem *item = it->second;
+    entry->Items.erase(it);
+    if (entry->Items.find(id) == entry->Items.end())
+        entry->Ids.erase(id);
+
+    // The index is already up to date, the deletion notifies the watcher from outside the lock
+    std::wstring playlistId = Plugin::instance()->PlaylistId(pl);
+    m_ownChange = playlistId;
+    m_ownChangeThread = GetCurrentThreadId();
+    lock.unlock();
+
+    bool deleted = SUCCEEDED(pl->Delete(item));
+    item->Release();
+
+    lock.lock();
+    if (m_ownChange == playlistId && m_ownChangeThread == GetCurrentThreadId()) {
+        m_ownChange.clear();
+        m_ownChangeThread = 0;
+    }
+    return deleted;
+}
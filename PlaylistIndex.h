@@ -0,0 +1,91 @@
+#pragma once
+
+#include "SDK/apiPlaylists.h"
+#include "IUnknownInterfaceImpl.h"
+#include "VideoId.h"
+#include "VideoIdSet.h"
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+// Video ids of the tracks in each AIMP playlist we touch, mapped to their playlist items.
+// Built on first use and thrown away when AIMP reports the content of the playlist changed,
+// so repeated dedupe checks and deletes don't have to walk the whole playlist again.
+// The plugin's own inserts and deletes update it in place instead.
+class PlaylistIndex {
+public:
+    // Items the plugin adds to a playlist while this is alive go into the index as they're added,
+    // and the content notification they cause, up to EndUpdate() included, keeps it
+    class Insertion {
+    public:
+        Insertion(IAIMPPlaylist *pl);
+        ~Insertion();
+
+        // Item with the given id was just added at index, -1 for the end of the playlist
+        void Added(const VideoId &id, int index);
+
+    private:
+        Insertion(const Insertion &);
+        Insertion &operator=(const Insertion &);
+
+        IAIMPPlaylist *m_playlist;
+        std::wstring m_playlistId;
+        std::wstring m_previous;
+        DWORD m_previousThread;
+    };
+
+    static void Deinit();
+
+    // Adds the ids found in the playlist to ids
+    static void TrackIds(IAIMPPlaylist *pl, VideoIdSet &ids);
+    // Deletes one item with the given id from the playlist
+    static bool Remove(IAIMPPlaylist *pl, const VideoId &id);
+    static void Forget(const std::wstring &playlistId);
+
+private:
+    class Watcher : public IUnknownInterfaceImpl<IAIMPPlaylistListener> {
+    public:
+        Watcher(const std::wstring &playlistId) : m_playlistId(playlistId) {}
+
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+            if (riid == IID_IAIMPPlaylistListener) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            return E_NOINTERFACE;
+        }
+
+        virtual void WINAPI Activated() { }
+        virtual void WINAPI Changed(DWORD Flags);
+        virtual void WINAPI Removed();
+
+    private:
+        std::wstring m_playlistId;
+    };
+
+    struct Entry {
+        IAIMPPlaylist *Playlist;
+        Watcher *Listener;
+        bool Dirty;
+        VideoIdSet Ids;
+        std::unordered_multimap<VideoId, IAIMPPlaylistItem *> Items;
+    };
+
+    static Entry *Lookup(IAIMPPlaylist *pl);
+    static VideoId ItemId(IAIMPPlaylistItem *item);
+    static void Rebuild(Entry &entry);
+    static void Clear(Entry &entry);
+    static void Release(Entry &entry);
+
+    PlaylistIndex();
+    PlaylistIndex(const PlaylistIndex &);
+    PlaylistIndex &operator=(const PlaylistIndex &);
+
+    static std::mutex m_mutex;
+    static std::unordered_map<std::wstring, Entry> m_entries;
+    // Playlist being changed by Remove() or an Insertion and on which thread, its own notification keeps the index
+    static std::wstring m_ownChange;
+    static DWORD m_ownChangeThread;
+};
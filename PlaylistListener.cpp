@@ -1,10 +1,12 @@
 #include "PlaylistListener.h"
 #include "Config.h"
 #include "AIMPYouTube.h"
+#include "PlaylistIndex.h"
+#include "SelectionSnapshot.h"
 #include <algorithm>
 
 void WINAPI PlaylistListener::PlaylistActivated(IAIMPPlaylist *Playlist) {
-
+    SelectionSnapshot::Invalidate();
 }
 
 void WINAPI PlaylistListener::PlaylistAdded(IAIMPPlaylist *Playlist) {
@@ -15,11 +17,13 @@ void WINAPI PlaylistListener::PlaylistRemoved(IAIMPPlaylist *Playlist) {
     std::wstring playlistId = Plugin::instance()->PlaylistId(Playlist);
 
     if (!playlistId.empty()) {
+        PlaylistIndex::Forget(playlistId);
         Config::MonitorUrls.erase(
             std::remove_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), [&](const Config::MonitorUrl &element) -> bool {
                 return element.PlaylistID == playlistId;
             }
         ), Config::MonitorUrls.end());
+        Config::MonitorUrlsChanged();
     }
     Config::SaveExtendedConfig();
 }
@@ -0,0 +1,292 @@
+#include "Prefetcher.h"
+#include "AIMPYouTube.h"
+#include "AIMPString.h"
+#include "YouTubeAPI.h"
+#include "Config.h"
+#include "Tools.h"
+#include "SDK/apiMessages.h"
+#include <algorithm>
+
+IAIMPCore *Prefetcher::m_core = nullptr;
+IAIMPServiceHTTPClient *Prefetcher::m_httpClient = nullptr;
+IAIMPPlaylist *Prefetcher::m_playlist = nullptr;
+Prefetcher::Listener *Prefetcher::m_listener = nullptr;
+
+std::mutex Prefetcher::m_mutex;
+std::condition_variable Prefetcher::m_cv;
+std::thread Prefetcher::m_thread;
+std::deque<std::wstring> Prefetcher::m_queue;
+std::vector<std::wstring> Prefetcher::m_planned;
+std::wstring Prefetcher::m_active;
+void *Prefetcher::m_taskId = nullptr;
+int64_t Prefetcher::m_budget = 0;
+std::atomic<unsigned> Prefetcher::m_generation(0);
+std::atomic<bool> Prefetcher::m_abortActive(false);
+bool Prefetcher::m_stop = false;
+bool Prefetcher::m_transferring = false;
+
+void WINAPI Prefetcher::Listener::Changed(DWORD Flags) {
+    if (Flags & (AIMP_PLAYLIST_NOTIFY_CONTENT | AIMP_PLAYLIST_NOTIFY_PLAYINGSWITCHS))
+        Prefetcher::TrackStarted();
+}
+
+void WINAPI Prefetcher::Listener::Removed() {
+    Prefetcher::Cancel();
+    Prefetcher::Watch(nullptr);
+}
+
+HRESULT WINAPI Prefetcher::Sink::Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written) {
+    if (Prefetcher::Aborted(m_generation) || m_offset + m_written >= m_limit)
+        return E_ABORT;
+
+    unsigned int n = unsigned((std::min)(int64_t(Count), m_limit - m_offset - m_written));
+    m_file->Append(m_offset + m_written, Buffer, n);
+
+    m_written += Count;
+    if (Written)
+        *Written = Count;
+    return S_OK;
+}
+
+Prefetcher::EventListener::EventListener(std::shared_ptr<StreamCache::File> file, Sink *sink) : m_file(file), m_sink(sink) {
+    m_sink->AddRef();
+}
+void WINAPI Prefetcher::EventListener::OnAccept(IAIMPString *ContentType, const INT64 ContentSize, BOOL *Allow) {
+    ContentType->AddRef();
+    ContentType->Release();
+    *Allow = true;
+    if (!m_ranged)
+        m_total = ContentSize;
+    if (m_total > 0)
+        m_file->SetTotalSize(m_total); // Kept even if the transfer is aborted
+}
+void WINAPI Prefetcher::EventListener::OnAcceptHeaders(IAIMPString *Header, BOOL *Allow) {
+    *Allow = true;
+    std::wstring range;
+    if (Tools::HeaderValue(Header->GetData(), L"Content-Range", &range)) {
+        // Content-Range: bytes <first>-<last>/<total>
+        std::size_t slash = range.find(L'/');
+        m_total = slash != std::wstring::npos && range[slash + 1] != L'*' ? _wtoi64(range.c_str() + slash + 1) : -1;
+        m_ranged = true;
+    } else if (m_sink->m_offset > 0) {
+        // Server ignored the Range header, only a contiguous prefix is cached
+        *Allow = false;
+    }
+}
+void WINAPI Prefetcher::EventListener::OnComplete(IAIMPErrorInfo *ErrorInfo, BOOL Canceled) {
+    if (m_total > 0)
+        m_file->Commit(m_total); // Records the size of the stream, finalizes short ones
+    m_file.reset();
+    m_sink->m_file.reset();
+    m_sink->Release();
+
+    std::unique_lock<std::mutex> lock(Prefetcher::m_mutex);
+    Prefetcher::m_transferring = false;
+    Prefetcher::m_cv.notify_all();
+}
+
+void Prefetcher::Init(IAIMPCore *core) {
+    m_core = core;
+    if (FAILED(m_core->QueryInterface(IID_IAIMPServiceHTTPClient, reinterpret_cast<void **>(&m_httpClient))))
+        return;
+
+    m_listener = new Listener();
+    m_listener->AddRef();
+
+    m_stop = false;
+    m_thread = std::thread(Worker);
+}
+
+void Prefetcher::Deinit() {
+    if (!m_listener)
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_generation++;
+    m_abortActive = true;
+    m_queue.clear();
+    void *taskId = m_taskId;
+    m_cv.notify_all();
+    lock.unlock();
+
+    if (taskId)
+        m_httpClient->Cancel(taskId, 0);
+    if (m_thread.joinable())
+        m_thread.join();
+
+    Watch(nullptr);
+    m_listener->Release();
+    m_listener = nullptr;
+
+    m_httpClient->Release();
+    m_httpClient = nullptr;
+}
+
+void Prefetcher::TrackStarted() {
+    if (!m_listener)
+        return;
+
+    int count = Config::GetInt32(L"PrefetchCount", 2);
+    int64_t budget = int64_t(Config::GetInt32(L"PrefetchSize", 512)) * 1024;
+
+    BOOL shuffle = FALSE;
+    IAIMPServiceMessageDispatcher *dispatcher = nullptr;
+    if (SUCCEEDED(m_core->QueryInterface(IID_IAIMPServiceMessageDispatcher, reinterpret_cast<void **>(&dispatcher)))) {
+        dispatcher->Send(AIMP_MSG_PROPERTY_SHUFFLE, AIMP_MSG_PROPVALUE_GET, &shuffle);
+        dispatcher->Release();
+    }
+
+    std::vector<std::wstring> planned;
+    IAIMPPlaylist *pl = nullptr;
+    if (IAIMPPlaylistItem *current = Plugin::instance()->GetCurrentTrack()) {
+        int index = -1;
+        current->GetValueAsInt32(AIMP_PLAYLISTITEM_PROPID_INDEX, &index);
+        current->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_PLAYLIST, IID_IAIMPPlaylist, reinterpret_cast<void **>(&pl));
+        current->Release();
+
+        // Next track can't be predicted in shuffle mode
+        if (pl && !shuffle && index >= 0) {
+            for (int i = index + 1, n = pl->GetItemCount(); i < n && int(planned.size()) < count; ++i) {
+                IAIMPPlaylistItem *item = nullptr;
+                if (FAILED(pl->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item))))
+                    continue;
+
+                int enabled = 1;
+                item->GetValueAsInt32(AIMP_PLAYLISTITEM_PROPID_PLAYINGSWITCH, &enabled);
+                IAIMPString *url = nullptr;
+                if (enabled && SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
+                    std::wstring id = Tools::TrackIdFromUrl(url->GetData());
+                    url->Release();
+                    if (!id.empty())
+                        planned.push_back(id);
+                }
+                item->Release();
+            }
+        }
+    }
+    Watch(pl);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (planned == m_planned && budget == m_budget)
+        return;
+
+    m_budget = budget;
+    m_planned = planned;
+    m_generation++;
+    m_queue.assign(planned.begin(), planned.end());
+    m_cv.notify_all();
+}
+
+void Prefetcher::Cancel() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_generation++;
+    m_queue.clear();
+    m_planned.clear();
+}
+
+void Prefetcher::Release(const std::wstring &id) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), id), m_queue.end());
+    if (m_active != id)
+        return;
+
+    // Playback wants this track now. The transfer is only cancelled, StreamCache::Open hands the
+    // cache file it still holds over to the player.
+    m_abortActive = true;
+    void *taskId = m_taskId;
+    lock.unlock();
+    if (taskId)
+        m_httpClient->Cancel(taskId, 0);
+}
+
+void Prefetcher::Watch(IAIMPPlaylist *pl) {
+    if (pl && pl == m_playlist) {
+        pl->Release();
+        return;
+    }
+
+    if (m_playlist) {
+        m_playlist->ListenerRemove(m_listener);
+        m_playlist->Release();
+    }
+    m_playlist = pl;
+    if (m_playlist)
+        m_playlist->ListenerAdd(m_listener);
+}
+
+void Prefetcher::Worker() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [] { return m_stop || !m_queue.empty(); });
+        if (m_stop)
+            break;
+
+        std::wstring id = m_queue.front();
+        m_queue.pop_front();
+        unsigned generation = m_generation;
+        m_active = id;
+        m_abortActive = false;
+        lock.unlock();
+
+        // Leaves the url in YouTubeAPI's cache for CreateStream
+        int itag = 0;
+        int64_t contentLength = -1;
+        std::wstring streamUrl = YouTubeAPI::GetStreamUrl(id, &itag, &contentLength);
+        if (!streamUrl.empty() && !Aborted(generation))
+            Warm(id, streamUrl, itag, contentLength, generation);
+
+        lock.lock();
+        m_active.clear();
+        m_cv.notify_all();
+    }
+}
+
+void Prefetcher::Warm(const std::wstring &id, const std::wstring &streamUrl, int itag, int64_t contentLength, unsigned generation) {
+    int64_t budget = m_budget;
+    if (budget <= 0 || itag <= 0 || !StreamCache::Lookup(id).empty())
+        return;
+
+    auto file = StreamCache::Open(id, itag, contentLength, false);
+    if (!file)
+        return;
+
+    int64_t offset = file->Size();
+    if (offset >= budget)
+        return;
+
+    std::wstring url(streamUrl + L"\r\nRange: bytes=" + std::to_wstring(offset) + L"-" + std::to_wstring(budget - 1));
+    Sink *sink = new Sink(file, offset, budget, generation);
+    sink->AddRef();
+    EventListener *listener = new EventListener(file, sink);
+    listener->AddRef();
+    file.reset();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_transferring = true;
+    lock.unlock();
+
+    // Release and Deinit read the task id under the lock
+    void *taskId = nullptr;
+    bool started = SUCCEEDED(m_httpClient->Get(AIMPString(url), 0, sink, listener, nullptr, &taskId));
+    if (!started)
+        sink->Release(); // The reference of the listener, OnComplete won't run
+    listener->Release();
+
+    lock.lock();
+    if (started) {
+        m_taskId = taskId;
+        if (m_transferring && Aborted(generation)) {
+            // Aborted before the id was published
+            lock.unlock();
+            m_httpClient->Cancel(taskId, 0);
+            lock.lock();
+        }
+        m_cv.wait(lock, [] { return !m_transferring; });
+    }
+    m_transferring = false;
+    m_taskId = nullptr;
+    lock.unlock();
+
+    sink->Release();
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include "SDK/apiCore.h"
+#include "SDK/apiPlaylists.h"
+#include "SDK/apiInternet.h"
+#include "IUnknownInterfaceImpl.h"
+#include "StreamCache.h"
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+
+// Resolves stream urls of the tracks following the playing one and downloads the head of each
+// into the stream cache, so the next CreateStream starts from disk instead of waiting on the network.
+// Work is dropped as soon as the playing track or the order of the playlist changes.
+class Prefetcher {
+public:
+    static void Init(IAIMPCore *core);
+    static void Deinit();
+
+    static void TrackStarted();
+    static void Cancel();
+    static void Release(const std::wstring &id);
+
+private:
+    class Listener : public IUnknownInterfaceImpl<IAIMPPlaylistListener> {
+    public:
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+            if (riid == IID_IAIMPPlaylistListener) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            return E_NOINTERFACE;
+        }
+
+        virtual void WINAPI Activated() { }
+        virtual void WINAPI Changed(DWORD Flags);
+        virtual void WINAPI Removed();
+    };
+
+    // Appends the response to the partial cache file, stops once the budget is reached
+    class Sink : public IUnknownInterfaceImpl<IAIMPStream> {
+    public:
+        Sink(std::shared_ptr<StreamCache::File> file, int64_t offset, int64_t limit, unsigned generation)
+            : m_file(file), m_offset(offset), m_limit(limit), m_generation(generation) {}
+
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+            if (riid == IID_IAIMPStream) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            return E_NOINTERFACE;
+        }
+        virtual INT64 WINAPI GetPosition() { return m_written; }
+        virtual INT64 WINAPI GetSize() { return m_written; }
+
+        virtual HRESULT WINAPI SetSize(const INT64 Value) { return S_OK; }
+
+        virtual HRESULT WINAPI Seek(const INT64 Offset, int Mode) { return S_OK; }
+        virtual int WINAPI Read(unsigned char *Buffer, unsigned int Count) { return 0; }
+        virtual HRESULT WINAPI Write(unsigned char *Buffer, unsigned int Count, unsigned int *Written);
+
+    private:
+        std::shared_ptr<StreamCache::File> m_file;
+        int64_t m_offset;
+        int64_t m_limit;
+        int64_t m_written{ 0 };
+        unsigned m_generation;
+        friend class Prefetcher;
+    };
+
+    class EventListener : public IUnknownInterfaceImpl<IAIMPHTTPClientEvents>, IAIMPHTTPClientEvents2 {
+        typedef IUnknownInterfaceImpl<IAIMPHTTPClientEvents> Base;
+    public:
+        EventListener(std::shared_ptr<StreamCache::File> file, Sink *sink);
+
+        void WINAPI OnAccept(IAIMPString *ContentType, const INT64 ContentSize, BOOL *Allow);
+        void WINAPI OnComplete(IAIMPErrorInfo *ErrorInfo, BOOL Canceled);
+        void WINAPI OnProgress(const INT64 Downloaded, const INT64 Total) { }
+        void WINAPI OnAcceptHeaders(IAIMPString *Header, BOOL *Allow);
+
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+
+            if (riid == IID_IAIMPHTTPClientEvents) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            if (riid == IID_IAIMPHTTPClientEvents2) {
+                *ppvObj = static_cast<IAIMPHTTPClientEvents2 *>(this);
+                AddRef();
+                return S_OK;
+            }
+
+            return E_NOINTERFACE;
+        }
+        virtual ULONG WINAPI AddRef(void) { return Base::AddRef(); }
+        virtual ULONG WINAPI Release(void) { return Base::Release(); }
+
+    private:
+        std::shared_ptr<StreamCache::File> m_file;
+        Sink *m_sink;
+        int64_t m_total{ -1 };
+        bool m_ranged{ false };
+    };
+
+    static void Watch(IAIMPPlaylist *pl);
+    static void Worker();
+    static void Warm(const std::wstring &id, const std::wstring &streamUrl, int itag, int64_t contentLength, unsigned generation);
+    static bool Aborted(unsigned generation) { return m_generation != generation || m_abortActive; }
+
+    Prefetcher();
+    Prefetcher(const Prefetcher &);
+    Prefetcher &operator=(const Prefetcher &);
+
+    static IAIMPCore *m_core;
+    static IAIMPServiceHTTPClient *m_httpClient;
+    static IAIMPPlaylist *m_playlist;
+    static Listener *m_listener;
+
+    static std::mutex m_mutex;
+    static std::condition_variable m_cv;
+    static std::thread m_thread;
+    static std::deque<std::wstring> m_queue;
+    static std::vector<std::wstring> m_planned;
+    static std::wstring m_active;
+    static void *m_taskId;
+    static int64_t m_budget;
+    static std::atomic<unsigned> m_generation;
+    static std::atomic<bool> m_abortActive;
+    static bool m_stop;
+    static bool m_transferring;
+};
@@ -0,0 +1,163 @@
+#include "RingBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+RingBuffer::RingBuffer(std::size_t capacity, std::size_t highWatermark, std::size_t lowWatermark, int64_t offset)
+    : m_capacity((std::max)(capacity, std::size_t(1))), m_highWatermark(highWatermark), m_lowWatermark(lowWatermark),
+      m_offset(offset), m_writeHead(offset), m_readPosition(offset) {
+
+}
+
+void RingBuffer::SetSize(int64_t size) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_size = size >= 0 ? m_offset + size : size;
+    if (m_writeHead == m_offset) {
+        std::size_t allocated = m_capacity;
+        if (size >= 0 && uint64_t(size) < m_capacity)
+            allocated = (std::max)(std::size_t(size), std::size_t(1));
+
+        m_data.resize(allocated);
+        m_data.shrink_to_fit();
+    }
+    m_highWatermark = (std::min)(m_highWatermark, m_data.size());
+    m_lowWatermark = (std::min)(m_lowWatermark, m_highWatermark);
+    m_sizeKnown = true;
+    m_cv.notify_all();
+}
+
+void RingBuffer::SetOffset(int64_t offset) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_writeHead != m_offset)
+        return;
+
+    if (m_size >= 0)
+        m_size += offset - m_offset;
+    m_offset = m_writeHead = offset;
+}
+
+int64_t RingBuffer::Size() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_size;
+}
+
+bool RingBuffer::WaitForSize() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_sizeKnown || m_complete || m_closed; });
+    return m_sizeKnown;
+}
+
+bool RingBuffer::Contains(int64_t position) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return position >= WindowStart() && position < m_writeHead;
+}
+
+bool RingBuffer::IsNear(int64_t position, std::size_t distance) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (position < WindowStart())
+        return false;
+
+    return position < m_writeHead + int64_t(distance) || (m_size >= 0 && m_writeHead >= m_size);
+}
+
+int64_t RingBuffer::WindowStart() const {
+    return (std::max)(m_offset, m_writeHead - int64_t(m_data.size()));
+}
+
+bool RingBuffer::Fits() const {
+    return m_size >= 0 && uint64_t(m_size - m_offset) <= m_data.size();
+}
+
+std::size_t RingBuffer::Ahead() const {
+    if (m_readPosition >= m_writeHead)
+        return 0;
+
+    return std::size_t((std::min)(m_writeHead - (std::max)(m_readPosition, WindowStart()), int64_t(m_data.size())));
+}
+
+bool RingBuffer::Throttled() {
+    if (Fits()) {
+        // Whole stream fits, nothing is ever overwritten
+        return false;
+    }
+
+    std::size_t ahead = Ahead();
+    if (m_throttled && ahead <= m_lowWatermark) {
+        m_throttled = false;
+    } else if (!m_throttled && ahead >= m_highWatermark) {
+        m_throttled = true;
+    }
+    return m_throttled || ahead >= m_data.size();
+}
+
+void RingBuffer::Seek(int64_t position) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_readPosition = position;
+    m_cv.notify_all();
+}
+
+int RingBuffer::Read(int64_t position, unsigned char *buffer, unsigned int count) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_readPosition = position;
+    m_cv.notify_all();
+
+    m_cv.wait(lock, [&] { return m_closed || m_complete || position < m_writeHead; });
+    if (position < WindowStart() || position >= m_writeHead)
+        return 0; // End of stream or already dropped from the window
+
+    std::size_t n = std::size_t((std::min)(int64_t(count), m_writeHead - position));
+    std::size_t offset = std::size_t((position - m_offset) % m_data.size());
+    std::size_t first = (std::min)(n, m_data.size() - offset);
+    memcpy(buffer, m_data.data() + offset, first);
+    memcpy(buffer + first, m_data.data(), n - first);
+
+    m_readPosition = position + n;
+    m_cv.notify_all();
+    return int(n);
+}
+
+bool RingBuffer::Write(const unsigned char *data, unsigned int count) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_data.empty())
+        m_data.resize(m_capacity);
+
+    while (count > 0) {
+        m_cv.wait(lock, [this] { return m_closed || !Throttled(); });
+        if (m_closed)
+            return false;
+
+        std::size_t free = m_data.size() - Ahead();
+        if (Fits())
+            free = m_data.size() - std::size_t(m_writeHead - m_offset);
+        if (free == 0)
+            return false; // Server sent more than announced
+
+        std::size_t n = (std::min)(std::size_t(count), free);
+        std::size_t offset = std::size_t((m_writeHead - m_offset) % m_data.size());
+        std::size_t first = (std::min)(n, m_data.size() - offset);
+        memcpy(m_data.data() + offset, data, first);
+        memcpy(m_data.data(), data + first, n - first);
+
+        m_writeHead += n;
+        data += n;
+        count -= unsigned(n);
+        m_cv.notify_all();
+    }
+    return true;
+}
+
+void RingBuffer::Complete() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_complete = true;
+    m_cv.notify_all();
+}
+
+void RingBuffer::Close() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_closed = true;
+    m_cv.notify_all();
+}
+
+bool RingBuffer::IsComplete() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_complete;
+}
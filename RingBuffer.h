@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <vector>
+
+// Fixed-size window over a linearly downloaded stream.
+// The producer (HTTP client) is throttled once it gets HighWatermark bytes ahead of the reader
+// and resumes when the reader brings that distance down to LowWatermark.
+// A buffer created with an offset holds a ranged transfer starting at that byte of the stream.
+class RingBuffer {
+public:
+    RingBuffer(std::size_t capacity, std::size_t highWatermark, std::size_t lowWatermark, int64_t offset = 0);
+
+    void SetSize(int64_t size);
+    void SetOffset(int64_t offset);
+    int64_t Size();
+    int64_t Offset() const { return m_offset; }
+    bool WaitForSize();
+
+    bool Contains(int64_t position);
+    bool IsNear(int64_t position, std::size_t distance);
+
+    int Read(int64_t position, unsigned char *buffer, unsigned int count);
+    bool Write(const unsigned char *data, unsigned int count);
+    void Seek(int64_t position);
+
+    void Complete();
+    void Close();
+    bool IsComplete();
+
+private:
+    int64_t WindowStart() const;
+    std::size_t Ahead() const;
+    bool Fits() const;
+    bool Throttled();
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<unsigned char> m_data;
+
+    std::size_t m_capacity;
+    std::size_t m_highWatermark;
+    std::size_t m_lowWatermark;
+
+    int64_t m_offset;
+    int64_t m_size{ -1 };
+    int64_t m_writeHead;
+    int64_t m_readPosition;
+    bool m_sizeKnown{ false };
+    bool m_throttled{ false };
+    bool m_complete{ false };
+    bool m_closed{ false };
+};
@@ -0,0 +1,103 @@
+#include "SelectionSnapshot.h"
+#include "AIMPYouTube.h"
+#include "Tools.h"
+
+bool SelectionSnapshot::m_valid = false;
+std::vector<VideoId> SelectionSnapshot::m_ids;
+IAIMPPlaylist *SelectionSnapshot::m_playlist = nullptr;
+SelectionSnapshot::Watcher *SelectionSnapshot::m_watcher = nullptr;
+
+void WINAPI SelectionSnapshot::Watcher::Changed(DWORD Flags) {
+    if (Flags & (AIMP_PLAYLIST_NOTIFY_SELECTION | AIMP_PLAYLIST_NOTIFY_CONTENT))
+        SelectionSnapshot::Invalidate();
+}
+
+void WINAPI SelectionSnapshot::Watcher::Removed() {
+    SelectionSnapshot::Invalidate();
+    SelectionSnapshot::Watch(nullptr);
+}
+
+void SelectionSnapshot::Deinit() {
+    Invalidate();
+    Watch(nullptr);
+    if (m_watcher) {
+        m_watcher->Release();
+        m_watcher = nullptr;
+    }
+}
+
+void SelectionSnapshot::Invalidate() {
+    m_valid = false;
+    m_ids.clear();
+}
+
+void SelectionSnapshot::Watch(IAIMPPlaylist *pl) {
+    if (pl && pl == m_playlist) {
+        pl->Release();
+        return;
+    }
+
+    if (m_playlist) {
+        m_playlist->ListenerRemove(m_watcher);
+        m_playlist->Release();
+    }
+    m_playlist = pl;
+    if (m_playlist) {
+        if (!m_watcher) {
+            m_watcher = new Watcher();
+            m_watcher->AddRef();
+        }
+        m_playlist->ListenerAdd(m_watcher);
+    }
+}
+
+void SelectionSnapshot::Take() {
+    Invalidate();
+
+    IAIMPPlaylist *pl = Plugin::instance()->GetCurrentPlaylist();
+    if (!pl)
+        return;
+
+    for (int i = 0, n = pl->GetItemCount(); i < n; ++i) {
+        IAIMPPlaylistItem *item = nullptr;
+        if (FAILED(pl->GetItem(i, IID_IAIMPPlaylistItem, reinterpret_cast<void **>(&item))))
+            continue;
+
+        int isSelected = 0;
+        if (SUCCEEDED(item->GetValueAsInt32(AIMP_PLAYLISTITEM_PROPID_SELECTED, &isSelected)) && isSelected) {
+            IAIMPString *url = nullptr;
+            if (SUCCEEDED(item->GetValueAsObject(AIMP_PLAYLISTITEM_PROPID_FILENAME, IID_IAIMPString, reinterpret_cast<void **>(&url)))) {
+                VideoId id = Tools::VideoIdFromUrl(url->GetData());
+                url->Release();
+                if (!id.Empty())
+                    m_ids.push_back(id);
+            }
+        }
+        item->Release();
+    }
+
+    Watch(pl);
+    m_valid = true;
+}
+
+const std::vector<VideoId> &SelectionSnapshot::Ids() {
+    if (!m_valid)
+        Take();
+    return m_ids;
+}
+
+bool SelectionSnapshot::InUserPlaylist() {
+    for (const auto &x : Ids()) {
+        if (!Config::UserPlaylistsWith(x).empty())
+            return true;
+    }
+    return false;
+}
+
+bool SelectionSnapshot::In(const Config::Playlist &playlist) {
+    for (const auto &x : Ids()) {
+        if (playlist.Items.count(x))
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "SDK/apiPlaylists.h"
+#include "IUnknownInterfaceImpl.h"
+#include "Config.h"
+#include <vector>
+
+// Ids of the selected YouTube tracks in the active playlist. Taken once when the context menu asks
+// for it and shared by all visibility callbacks until the selection, the content or the active
+// playlist changes. Playlist memberships are looked up on every call, they change on their own.
+class SelectionSnapshot {
+public:
+    static void Deinit();
+    static void Invalidate();
+
+    static const std::vector<VideoId> &Ids();
+    static bool InUserPlaylist();
+    static bool In(const Config::Playlist &playlist);
+
+private:
+    class Watcher : public IUnknownInterfaceImpl<IAIMPPlaylistListener> {
+    public:
+        virtual HRESULT WINAPI QueryInterface(REFIID riid, LPVOID *ppvObj) {
+            if (!ppvObj) return E_POINTER;
+            if (riid == IID_IAIMPPlaylistListener) {
+                *ppvObj = this;
+                AddRef();
+                return S_OK;
+            }
+            return E_NOINTERFACE;
+        }
+
+        virtual void WINAPI Activated() { }
+        virtual void WINAPI Changed(DWORD Flags);
+        virtual void WINAPI Removed();
+    };
+
+    static void Take();
+    static void Watch(IAIMPPlaylist *pl);
+
+    SelectionSnapshot();
+    SelectionSnapshot(const SelectionSnapshot &);
+    SelectionSnapshot &operator=(const SelectionSnapshot &);
+
+    static bool m_valid;
+    static std::vector<VideoId> m_ids;
+    static IAIMPPlaylist *m_playlist;
+    static Watcher *m_watcher;
+};
@@ -0,0 +1,462 @@
+#include "StreamCache.h"
+#include "Config.h"
+#include <windows.h>
+#include <share.h>
+#include <ctime>
+#include <algorithm>
+#include "rapidjson/document.h"
+#include "rapidjson/writer.h"
+#include "rapidjson/filereadstream.h"
+#include "rapidjson/filewritestream.h"
+
+std::mutex StreamCache::m_mutex;
+std::wstring StreamCache::m_folder;
+std::unordered_map<std::wstring, std::vector<StreamCache::Entry>> StreamCache::m_entries;
+std::unordered_map<std::wstring, std::weak_ptr<StreamCache::File>> StreamCache::m_open;
+std::thread StreamCache::m_checker;
+std::condition_variable StreamCache::m_checkCv;
+std::deque<StreamCache::Check> StreamCache::m_checks;
+std::atomic<bool> StreamCache::m_stop(false);
+
+StreamCache::File::File(const std::wstring &id, int itag, const std::wstring &path, const Entry &entry, int64_t contentLength)
+    : m_id(id), m_itag(itag), m_path(path), m_expectedSize(entry.Complete ? -1 : entry.Size), m_hash(HashSeed) {
+    if (!(m_file = _wfsopen(m_path.c_str(), L"a+b", _SH_DENYWR)))
+        return;
+
+    _fseeki64(m_file, 0, SEEK_END);
+    m_size = _ftelli64(m_file);
+    int64_t size, modified;
+    if (m_size > 0 && (m_expectedSize < 0 || m_size > m_expectedSize || (contentLength >= 0 && contentLength != m_expectedSize))) {
+        // Without a matching total size the prefix may belong to a different version of the stream
+        Restart();
+    } else if (m_size > 0) {
+        // The hash of the prefix is resumed from when it was written, a prefix changed since then is dropped
+        if (m_size == entry.Length && FileInfo(m_path, &size, &modified) && modified == entry.Modified) {
+            m_hash = entry.Hash;
+        } else {
+            Restart();
+        }
+    }
+    if (contentLength >= 0)
+        m_expectedSize = contentLength;
+}
+
+StreamCache::File::~File() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_file)
+        fclose(m_file);
+    bool committed = m_committed;
+    int64_t expectedSize = m_expectedSize;
+    int64_t size = m_file ? m_size : 0;
+    uint64_t hash = m_hash;
+    lock.unlock();
+
+    if (!committed)
+        StreamCache::Finished(m_id, m_itag, expectedSize, false, hash, m_path, size);
+}
+
+int64_t StreamCache::File::Size() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_size;
+}
+
+int StreamCache::File::Read(int64_t position, unsigned char *buffer, unsigned int count) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_file || position >= m_size)
+        return 0;
+
+    _fseeki64(m_file, position, SEEK_SET);
+    return int(fread(buffer, 1, std::size_t((std::min)(int64_t(count), m_size - position)), m_file));
+}
+
+void StreamCache::File::Append(int64_t position, const unsigned char *data, unsigned int count) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_file || m_committed || position > m_size || position + count <= m_size)
+        return; // Only a contiguous prefix of the stream is cached
+
+    // A shared file may already have part of the data from the other transfer
+    data += m_size - position;
+    count -= unsigned(m_size - position);
+    if (m_expectedSize >= 0 && m_size + count > m_expectedSize)
+        return;
+
+    _fseeki64(m_file, 0, SEEK_END);
+    std::size_t written = fwrite(data, 1, count, m_file);
+    m_hash = Hash(m_hash, data, written);
+    m_size += written;
+}
+
+void StreamCache::File::SetTotalSize(int64_t totalSize) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_file || m_committed || totalSize < 0)
+        return;
+
+    if (m_expectedSize >= 0 && m_expectedSize != totalSize)
+        Restart(); // Stream changed since the partial file was started
+    m_expectedSize = totalSize;
+}
+
+void StreamCache::File::Commit(int64_t totalSize) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_file || m_committed)
+        return;
+
+    if (m_expectedSize >= 0 && m_expectedSize != totalSize)
+        Restart();
+    m_expectedSize = totalSize;
+    if (m_size != totalSize)
+        return;
+
+    fclose(m_file);
+    std::wstring complete = StreamCache::FileName(m_id, m_itag, true);
+    if (MoveFileEx(m_path.c_str(), complete.c_str(), MOVEFILE_REPLACE_EXISTING)) {
+        m_path = complete;
+        m_committed = true;
+    }
+    m_file = _wfsopen(m_path.c_str(), m_committed ? L"rb" : L"a+b", _SH_DENYWR);
+    if (!m_committed)
+        return;
+
+    int64_t size = m_size;
+    uint64_t hash = m_hash;
+    lock.unlock();
+    StreamCache::Finished(m_id, m_itag, size, true, hash, m_path, size);
+}
+
+void StreamCache::File::Restart() {
+    fclose(m_file);
+    m_file = _wfsopen(m_path.c_str(), L"w+b", _SH_DENYWR);
+    m_size = 0;
+    m_hash = HashSeed;
+}
+
+void StreamCache::Init() {
+    m_folder = Config::PluginConfigFolder() + L"StreamCache\\";
+    CreateDirectory(m_folder.c_str(), NULL);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    LoadIndex();
+
+    // Once per start the index is matched with what is on disk, from then on it keeps track of the sizes
+    for (auto &x : m_entries) {
+        for (auto &e : x.second) {
+            int64_t size, modified;
+            if (!FileInfo(FileName(x.first, e.Itag, e.Complete), &size, &modified)) {
+                if (e.Complete)
+                    e.Size = -1;
+                e.Complete = false;
+                e.Length = 0;
+            } else if (e.Complete && e.Modified == 0) {
+                // Recorded before write times were, its content is checked before the time is trusted
+                e.Length = size;
+                e.Modified = modified;
+            } else {
+                e.Length = size;
+            }
+        }
+    }
+    Evict();
+
+    m_stop = false;
+    m_checker = std::thread(Checker);
+}
+
+void StreamCache::Deinit() {
+    if (m_folder.empty())
+        return;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stop = true;
+    m_checks.clear();
+    m_checkCv.notify_all();
+    lock.unlock();
+    if (m_checker.joinable())
+        m_checker.join();
+
+    lock.lock();
+    SaveIndex();
+}
+
+std::wstring StreamCache::FileName(const std::wstring &id, int itag, bool complete) {
+    return m_folder + id + L"_" + std::to_wstring(itag) + (complete ? L".cache" : L".part");
+}
+
+uint64_t StreamCache::Hash(uint64_t hash, const unsigned char *data, std::size_t size) {
+    // FNV-1a
+    for (std::size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool StreamCache::ContentHash(const std::wstring &path, uint64_t *hash) {
+    FILE *file = nullptr;
+    if (!(file = _wfsopen(path.c_str(), L"rb", _SH_DENYNO)))
+        return false;
+
+    *hash = HashSeed;
+    unsigned char buffer[65536];
+    while (std::size_t n = fread(buffer, 1, sizeof(buffer), file)) {
+        if (m_stop)
+            break;
+        *hash = Hash(*hash, buffer, n);
+    }
+    bool read = !ferror(file) && feof(file);
+    fclose(file);
+    return read && !m_stop;
+}
+
+bool StreamCache::FileInfo(const std::wstring &path, int64_t *size, int64_t *modified) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+        return false;
+
+    *size = (int64_t(data.nFileSizeHigh) << 32) | data.nFileSizeLow;
+    *modified = (int64_t(data.ftLastWriteTime.dwHighDateTime) << 32) | data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+StreamCache::Entry *StreamCache::Find(const std::wstring &id, int itag, bool create) {
+    auto it = m_entries.find(id);
+    if (it == m_entries.end() && !create)
+        return nullptr;
+
+    auto &entries = create ? m_entries[id] : it->second;
+    auto entry = std::find_if(entries.begin(), entries.end(), [itag](const Entry &e) { return e.Itag == itag; });
+    if (entry != entries.end())
+        return &*entry;
+    if (!create)
+        return nullptr;
+
+    Entry e = { itag, -1, 0, 0, false, 0, 0, false };
+    entries.push_back(e);
+    return &entries.back();
+}
+
+std::wstring StreamCache::Lookup(const std::wstring &id) {
+    if (!Config::GetInt32(L"StreamCacheEnabled", 1))
+        return std::wstring();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(id);
+    if (it == m_entries.end())
+        return std::wstring();
+    std::vector<Entry> complete;
+    for (const auto &x : it->second) {
+        if (x.Complete)
+            complete.push_back(x);
+    }
+    lock.unlock();
+
+    // Only the size and write time are looked at before playback, the content is checked in the background
+    for (const auto &x : complete) {
+        std::wstring path = FileName(id, x.Itag, true);
+        int64_t size, modified;
+        bool valid = FileInfo(path, &size, &modified) && size == x.Size && modified == x.Modified;
+
+        lock.lock();
+        Entry *entry = Find(id, x.Itag, false);
+        if (entry && entry->Complete) {
+            if (valid) {
+                entry->LastAccess = std::time(nullptr);
+                if (!entry->Checked) {
+                    entry->Checked = true;
+                    Check check = { id, entry->Itag, entry->Modified };
+                    m_checks.push_back(check);
+                    m_checkCv.notify_one();
+                }
+                return path;
+            }
+
+            // Changed or removed behind our back, fetch it again
+            DeleteFile(path.c_str());
+            entry->Complete = false;
+            entry->Size = -1;
+            entry->Length = 0;
+        }
+        lock.unlock();
+    }
+    return std::wstring();
+}
+
+void StreamCache::Checker() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;) {
+        m_checkCv.wait(lock, [] { return m_stop || !m_checks.empty(); });
+        if (m_stop)
+            return;
+
+        Check check = m_checks.front();
+        m_checks.pop_front();
+        lock.unlock();
+        std::wstring path = FileName(check.Id, check.Itag, true);
+        uint64_t hash = 0;
+        bool hashed = ContentHash(path, &hash);
+        lock.lock();
+
+        // A file that can't be read anymore is dropped by the next Lookup
+        Entry *entry = Find(check.Id, check.Itag, false);
+        if (!hashed || !entry || !entry->Complete || entry->Modified != check.Modified || hash == entry->Hash)
+            continue;
+
+        // Corrupted, it may be playing right now but isn't handed out again
+        DeleteFile(path.c_str());
+        entry->Complete = false;
+        entry->Size = -1;
+        entry->Length = 0;
+        SaveIndex();
+    }
+}
+
+std::shared_ptr<StreamCache::File> StreamCache::Open(const std::wstring &id, int itag, int64_t contentLength, bool shared) {
+    if (!Config::GetInt32(L"StreamCacheEnabled", 1))
+        return nullptr;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::wstring key = id + L"_" + std::to_wstring(itag);
+    auto open = m_open.find(key);
+    if (open != m_open.end()) {
+        if (auto file = open->second.lock())
+            return shared ? file : nullptr; // Already being downloaded by another stream
+    }
+
+    Entry *entry = Find(id, itag, true);
+    entry->LastAccess = std::time(nullptr);
+
+    auto file = std::make_shared<File>(id, itag, FileName(id, itag, false), *entry, contentLength);
+    m_open[key] = file;
+    return file;
+}
+
+void StreamCache::Finished(const std::wstring &id, int itag, int64_t size, bool complete, uint64_t hash, const std::wstring &path, int64_t length) {
+    // The write time the hash belongs to, a file that is missing is recorded as empty
+    int64_t onDisk = 0, modified = 0;
+    if (!FileInfo(path, &onDisk, &modified) || onDisk != length)
+        length = 0;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Entry *entry = Find(id, itag, true);
+    entry->Size = size;
+    entry->Complete = complete && length > 0;
+    entry->LastAccess = std::time(nullptr);
+    entry->Hash = hash;
+    entry->Length = length;
+    entry->Modified = modified;
+    entry->Checked = complete;
+
+    auto open = m_open.find(id + L"_" + std::to_wstring(itag));
+    if (open != m_open.end() && open->second.expired())
+        m_open.erase(open);
+
+    Evict();
+    SaveIndex();
+}
+
+void StreamCache::Evict() {
+    struct Candidate {
+        std::wstring Id;
+        int Itag;
+        int64_t LastAccess;
+        int64_t Size;
+    };
+    std::vector<Candidate> candidates;
+    int64_t total = 0;
+    for (const auto &x : m_entries) {
+        for (const auto &e : x.second) {
+            // Files being written are still growing, they are never evicted
+            auto open = m_open.find(x.first + L"_" + std::to_wstring(e.Itag));
+            std::shared_ptr<File> file = open != m_open.end() ? open->second.lock() : nullptr;
+            int64_t size = file ? file->Size() : e.Length;
+            total += size;
+            if (!file && size > 0)
+                candidates.push_back({ x.first, e.Itag, e.LastAccess, size });
+        }
+    }
+
+    int64_t limit = int64_t(Config::GetInt32(L"StreamCacheSize", 1024)) * 1024 * 1024;
+    if (total <= limit)
+        return;
+
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) { return a.LastAccess < b.LastAccess; });
+    for (const auto &c : candidates) {
+        if (total <= limit)
+            break;
+
+        auto &entries = m_entries[c.Id];
+        auto entry = std::find_if(entries.begin(), entries.end(), [&c](const Entry &e) { return e.Itag == c.Itag; });
+        DeleteFile(FileName(c.Id, c.Itag, entry->Complete).c_str());
+        entries.erase(entry);
+        if (entries.empty())
+            m_entries.erase(c.Id);
+        m_open.erase(c.Id + L"_" + std::to_wstring(c.Itag));
+
+        total -= c.Size;
+    }
+}
+
+void StreamCache::SaveIndex() {
+    std::wstring indexFile = m_folder + L"Index.json";
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, indexFile.c_str(), L"wb") == 0) {
+        using namespace rapidjson;
+        char writeBuffer[65536];
+
+        FileWriteStream stream(file, writeBuffer, sizeof(writeBuffer));
+        Writer<decltype(stream), UTF16<>> writer(stream);
+
+        writer.StartObject();
+        for (const auto &x : m_entries) {
+            writer.String(x.first.c_str(), x.first.size());
+            writer.StartArray();
+            for (const auto &e : x.second) {
+                writer.StartObject();
+                writer.String(L"I"); writer.Int(e.Itag);
+                writer.String(L"S"); writer.Int64(e.Size);
+                writer.String(L"T"); writer.Int64(e.LastAccess);
+                writer.String(L"H"); writer.Uint64(e.Hash);
+                writer.String(L"C"); writer.Bool(e.Complete);
+                writer.String(L"L"); writer.Int64(e.Length);
+                writer.String(L"M"); writer.Int64(e.Modified);
+                writer.EndObject();
+            }
+            writer.EndArray();
+        }
+        writer.EndObject();
+
+        fclose(file);
+    }
+}
+
+void StreamCache::LoadIndex() {
+    m_entries.clear();
+
+    std::wstring indexFile = m_folder + L"Index.json";
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, indexFile.c_str(), L"rb") == 0) {
+        using namespace rapidjson;
+        char buffer[65536];
+
+        FileReadStream stream(file, buffer, sizeof(buffer));
+        GenericDocument<UTF16<>> d;
+        d.ParseStream<0, UTF8<>, decltype(stream)>(stream);
+
+        if (d.IsObject()) {
+            for (auto x = d.MemberBegin(), e = d.MemberEnd(); x != e; x++) {
+                if (!(*x).value.IsArray())
+                    continue;
+
+                auto &entries = m_entries[(*x).name.GetString()];
+                for (auto v = (*x).value.Begin(), ve = (*x).value.End(); v != ve; v++) {
+                    if ((*v).IsObject() && (*v).HasMember(L"I") && (*v).HasMember(L"S") && (*v).HasMember(L"T") && (*v).HasMember(L"H") && (*v).HasMember(L"C")) {
+                        // L and M are missing in indexes written before they were recorded
+                        Entry e = { (*v)[L"I"].GetInt(), (*v)[L"S"].GetInt64(), (*v)[L"T"].GetInt64(), (*v)[L"H"].GetUint64(), (*v)[L"C"].GetBool(),
+                                    (*v).HasMember(L"L") ? (*v)[L"L"].GetInt64() : 0, (*v).HasMember(L"M") ? (*v)[L"M"].GetInt64() : 0, false };
+                        entries.push_back(e);
+                    }
+                }
+            }
+        }
+        fclose(file);
+    }
+}
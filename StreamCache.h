@@ -0,0 +1,104 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+
+// Disk cache of downloaded streams under <PluginConfigFolder>\StreamCache, keyed by video id + itag.
+// Partially downloaded files are resumed only while their recorded total size matches the stream, the total
+// size is capped by evicting least recently played entries. Complete files are played when their size and
+// last write time are the ones recorded on completion, a background thread checks their content against the
+// hash taken while they were written.
+class StreamCache {
+    struct Entry {
+        int Itag;
+        // Total size of the stream, -1 if unknown
+        int64_t Size;
+        int64_t LastAccess;
+        // Of the Length bytes on disk, taken while they were written
+        uint64_t Hash;
+        bool Complete;
+        int64_t Length;
+        // Last write time of the file when Hash was recorded
+        int64_t Modified;
+        // Content checked against Hash (or queued for it) in this session
+        bool Checked;
+    };
+
+public:
+    class File {
+    public:
+        // contentLength is the size of the stream if known, a prefix of a different size is dropped
+        File(const std::wstring &id, int itag, const std::wstring &path, const Entry &entry, int64_t contentLength);
+        ~File();
+
+        int64_t Size();
+        int Read(int64_t position, unsigned char *buffer, unsigned int count);
+        void Append(int64_t position, const unsigned char *data, unsigned int count);
+        // Records the size of the stream as soon as a response announces it
+        void SetTotalSize(int64_t totalSize);
+        void Commit(int64_t totalSize);
+
+    private:
+        void Restart();
+
+        std::mutex m_mutex;
+        FILE *m_file{ nullptr };
+        std::wstring m_id;
+        std::wstring m_path;
+        int m_itag;
+        int64_t m_size{ 0 };
+        int64_t m_expectedSize;
+        uint64_t m_hash;
+        bool m_committed{ false };
+    };
+
+    static void Init();
+    static void Deinit();
+
+    static std::wstring Lookup(const std::wstring &id);
+    // A file that is already open is shared, e.g. with a prefetch that is being cancelled, unless shared is false
+    static std::shared_ptr<File> Open(const std::wstring &id, int itag, int64_t contentLength = -1, bool shared = true);
+
+private:
+    struct Check {
+        std::wstring Id;
+        int Itag;
+        int64_t Modified;
+    };
+
+    static std::wstring FileName(const std::wstring &id, int itag, bool complete);
+    static const uint64_t HashSeed = 14695981039346656037ULL;
+    static uint64_t Hash(uint64_t hash, const unsigned char *data, std::size_t size);
+    // False when the file can't be read or Deinit interrupts it
+    static bool ContentHash(const std::wstring &path, uint64_t *hash);
+    static bool FileInfo(const std::wstring &path, int64_t *size, int64_t *modified);
+    static Entry *Find(const std::wstring &id, int itag, bool create);
+    static void Finished(const std::wstring &id, int itag, int64_t size, bool complete, uint64_t hash, const std::wstring &path, int64_t length);
+    static void Checker();
+    static void Evict();
+    static void SaveIndex();
+    static void LoadIndex();
+
+    StreamCache();
+    StreamCache(const StreamCache &);
+    StreamCache &operator=(const StreamCache &);
+
+    static std::mutex m_mutex;
+    static std::wstring m_folder;
+    static std::unordered_map<std::wstring, std::vector<Entry>> m_entries;
+    static std::unordered_map<std::wstring, std::weak_ptr<File>> m_open;
+
+    static std::thread m_checker;
+    static std::condition_variable m_checkCv;
+    static std::deque<Check> m_checks;
+    static std::atomic<bool> m_stop;
+};
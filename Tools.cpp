@@ -1,4 +1,6 @@
 #include "Tools.h"
+#include "AimpHTTP.h"
+#include "TrackInfoResolver.h"
 
 #include <windows.h>
 #include <locale>
@@ -6,6 +8,7 @@
 #include <iomanip>
 #include <codecvt>
 #include <cctype>
+#include <cstring>
 #include <string>
 #include <algorithm>
 
@@ -86,51 +89,47 @@ std::string Tools::UrlDecode(const std::string &input) {
     }
     return decoded;
 }
-std::wstring Tools::TrackIdFromUrl(const std::wstring &url) {
-    std::wstring id;
-    std::wstring::size_type pos, pos_end;
-    if (url.find(L"youtube.com") != std::wstring::npos) {
-        if ((pos = url.find(L"?v=")) != std::wstring::npos) {
-            id = url.c_str() + pos + 3;
-        } else if ((pos = url.find(L"&v=")) != std::wstring::npos) {
-            id = url.c_str() + pos + 3;
-        } else {
-            return id;
-        }
-        if ((pos = id.find(L'&')) != std::wstring::npos)
-            id.resize(pos);
+std::wstring Tools::TrackIdFromUrl(const wchar_t *url) {
+    const wchar_t *id;
+    std::size_t length;
+    if (!IsVideoUrl(ClassifyUrl(url, &id, &length)))
+        return std::wstring();
+    return std::wstring(id, length);
+}
 
-        return id;
-    } else if (url.find(L"youtu.be") != std::wstring::npos) {
-        if ((pos = url.find(L"/", 8)) != std::wstring::npos) {
-            id = url.c_str() + pos + 1;
-            if ((pos = id.find(L'?')) != std::wstring::npos)
-                id.resize(pos);
+VideoId Tools::VideoIdFromUrl(const wchar_t *url) {
+    const wchar_t *id;
+    std::size_t length;
+    if (!IsVideoUrl(ClassifyUrl(url, &id, &length)))
+        return VideoId();
+    return VideoId(id, length);
+}
 
-            if ((pos = id.find(L'&')) != std::wstring::npos)
-                id.resize(pos);
+bool Tools::ParseDuration(const rapidjson::Value &duration, double *seconds) {
+    return duration.IsString() && ParseDuration(duration.GetString(), duration.GetStringLength(), seconds);
+}
 
-            return id;
-        }
-    } else if (url.find(L"googleapis.com/youtube/v3") != std::wstring::npos) {
-        if ((pos = url.find(L"&id=")) != std::wstring::npos) {
-            id = url.c_str() + pos + 4;
-        } else if ((pos = url.find(L"?id=")) != std::wstring::npos) {
-            id = url.c_str() + pos + 4;
-        } else {
-            return id;
-        }
-        if ((pos = id.find(L'&')) != std::wstring::npos)
-            id.resize(pos);
-    } else if ((pos = url.find(L"youtube://")) != std::wstring::npos) {
-        pos += 10;
-        if ((pos_end = url.find(L"/", pos)) != std::wstring::npos) {
-            return url.substr(pos, pos_end - pos);
-        } else {
-            return url.substr(pos);
+bool Tools::HeaderValue(const wchar_t *headers, const wchar_t *name, std::wstring *value) {
+    std::size_t length = wcslen(name);
+    for (const wchar_t *line = headers; *line;) {
+        const wchar_t *end = wcschr(line, L'\n');
+        if (!end)
+            end = line + wcslen(line);
+
+        if (_wcsnicmp(line, name, length) == 0 && line[length] == L':') {
+            const wchar_t *start = line + length + 1;
+            while (start < end && (*start == L' ' || *start == L'\t'))
+                start++;
+            const wchar_t *last = end;
+            while (last > start && (last[-1] == L'\r' || last[-1] == L' ' || last[-1] == L'\t'))
+                last--;
+            if (value)
+                value->assign(start, last);
+            return true;
         }
+        line = *end ? end + 1 : end;
     }
-    return id;
+    return false;
 }
 
 void Tools::ReplaceString(const std::string &search, const std::string &replace, std::string &subject) {
@@ -159,17 +158,21 @@ std::string Tools::Trim(const std::string &s) {
     return (wsback <= wsfront ? std::string() : std::string(wsfront, wsback));
 }
 
-Config::TrackInfo *Tools::TrackInfo(const std::wstring &id) {
-    if (!id.empty()) {
-        if (Config::TrackInfos.find(id) == Config::TrackInfos.end()) {
-            if (!Config::ResolveTrackInfo(id))
-                return nullptr;
-        }
-        return &Config::TrackInfos[id];
+bool Tools::TrackInfo(const std::wstring &id, Config::TrackInfo *info) {
+    if (id.empty())
+        return false;
+
+    if (Config::FindTrackInfo(id, info))
+        return true;
+
+    if (AimpHTTP::OnCompletionThread()) {
+        // Never wait for the network on the main thread, the info is there next time
+        TrackInfoResolver::Resolve(id);
+        return false;
     }
-    return nullptr;
+    return TrackInfoResolver::ResolveNow(id, info);
 }
 
-Config::TrackInfo *Tools::TrackInfo(IAIMPString *FileName) {
-    return TrackInfo(Tools::TrackIdFromUrl(FileName->GetData()));
+bool Tools::TrackInfo(IAIMPString *FileName, Config::TrackInfo *info) {
+    return TrackInfo(Tools::TrackIdFromUrl(FileName->GetData()), info);
 }
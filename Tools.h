@@ -4,13 +4,14 @@
 #include <cinttypes>
 #include <functional>
 #include "Config.h"
+#include "ParseTools.h"
 #include "Strsafe.h"
 #include "rapidjson/document.h"
 
 #define DebugA(...) { char msg[2048]; sprintf_s(msg, __VA_ARGS__); OutputDebugStringA(msg); }
 #define DebugW(...) { wchar_t msg[2048]; StringCchPrintfW(msg, sizeof(msg), __VA_ARGS__); OutputDebugStringW(msg); }
 
-struct Tools {
+struct Tools : ParseTools {
     static std::wstring ToWString(const std::string &);
     static std::string ToString(const std::wstring &);
     static std::wstring ToWString(const char *);
@@ -20,9 +21,20 @@ struct Tools {
     static void SplitString(const std::string &string, const std::string &delimiter, std::function<void(const std::string &token)> callback);
     static  std::string Trim(const std::string &s);
 
-    static std::wstring TrackIdFromUrl(const std::wstring &);
-    static Config::TrackInfo *TrackInfo(const std::wstring &id);
-    static Config::TrackInfo *TrackInfo(IAIMPString *FileName);
+    static std::wstring TrackIdFromUrl(const wchar_t *url);
+    static std::wstring TrackIdFromUrl(const std::wstring &url) { return TrackIdFromUrl(url.c_str()); }
+    static VideoId VideoIdFromUrl(const wchar_t *url);
+    static std::wstring Permalink(const std::wstring &id) { return L"https://www.youtube.com/watch?v=" + id; }
+    // Blocks on a cache miss until the info is fetched, so it is meant for worker threads. The main
+    // thread only gets cached info and uses TrackInfoResolver::Resolve for the rest.
+    static bool TrackInfo(const std::wstring &id, Config::TrackInfo *info);
+    static bool TrackInfo(IAIMPString *FileName, Config::TrackInfo *info);
+
+    using ParseTools::ParseDuration;
+    static bool ParseDuration(const rapidjson::Value &duration, double *seconds);
+
+    // Value of a header in a CRLF separated header block, the name is matched case-insensitively
+    static bool HeaderValue(const wchar_t *headers, const wchar_t *name, std::wstring *value);
 
     static std::wstring UrlEncode(const std::wstring &);
     static std::string UrlDecode(const std::string &input);
@@ -0,0 +1,199 @@
+#include "TrackCache.h"
+#include <vector>
+#include <cstdio>
+#include <cstring>
+
+std::mutex TrackCache::m_mutex;
+HANDLE TrackCache::m_file = INVALID_HANDLE_VALUE;
+HANDLE TrackCache::m_mapping = NULL;
+const unsigned char *TrackCache::m_view = nullptr;
+const TrackCache::Header *TrackCache::m_header = nullptr;
+const TrackCache::Record *TrackCache::m_records = nullptr;
+const uint32_t *TrackCache::m_buckets = nullptr;
+const unsigned char *TrackCache::m_strings = nullptr;
+
+uint64_t TrackCache::Hash(const std::wstring &id) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (wchar_t c : id) {
+        hash ^= uint64_t(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool TrackCache::Open(const std::wstring &path) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Unmap();
+
+    m_file = CreateFile(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || uint64_t(size.QuadPart) < sizeof(Header)) {
+        Unmap();
+        return false;
+    }
+
+    m_mapping = CreateFileMapping(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mapping)
+        m_view = reinterpret_cast<const unsigned char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_view) {
+        Unmap();
+        return false;
+    }
+
+    // Reject anything that doesn't add up instead of reading past the mapping later
+    const Header *header = reinterpret_cast<const Header *>(m_view);
+    uint64_t expected = sizeof(Header) + uint64_t(header->Count) * sizeof(Record) + uint64_t(header->BucketCount) * sizeof(uint32_t) + header->StringsSize;
+    if (memcmp(header->Magic, "YTTC", 4) != 0 || header->Version != Version || header->BucketCount == 0 ||
+        (header->BucketCount & (header->BucketCount - 1)) != 0 || header->BucketCount < header->Count || expected != uint64_t(size.QuadPart)) {
+        Unmap();
+        return false;
+    }
+
+    m_header = header;
+    m_records = reinterpret_cast<const Record *>(m_view + sizeof(Header));
+    m_buckets = reinterpret_cast<const uint32_t *>(m_records + header->Count);
+    m_strings = reinterpret_cast<const unsigned char *>(m_buckets + header->BucketCount);
+    return true;
+}
+
+void TrackCache::Close() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Unmap();
+}
+
+void TrackCache::Unmap() {
+    if (m_view)
+        UnmapViewOfFile(m_view);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file != INVALID_HANDLE_VALUE)
+        CloseHandle(m_file);
+
+    m_file = INVALID_HANDLE_VALUE;
+    m_mapping = NULL;
+    m_view = nullptr;
+    m_header = nullptr;
+    m_records = nullptr;
+    m_buckets = nullptr;
+    m_strings = nullptr;
+}
+
+bool TrackCache::String(uint32_t offset, std::wstring &out) {
+    if (uint64_t(offset) + sizeof(uint32_t) > m_header->StringsSize)
+        return false;
+
+    uint32_t length = *reinterpret_cast<const uint32_t *>(m_strings + offset);
+    if (uint64_t(offset) + sizeof(uint32_t) + uint64_t(length) * sizeof(wchar_t) > m_header->StringsSize)
+        return false;
+
+    out.assign(reinterpret_cast<const wchar_t *>(m_strings + offset + sizeof(uint32_t)), length);
+    return true;
+}
+
+bool TrackCache::Read(const Record &record, Config::TrackInfo *info) {
+    if (!String(record.Id, info->Id) || !String(record.Name, info->Name) || !String(record.Permalink, info->Permalink) || !String(record.Artwork, info->Artwork))
+        return false;
+
+    info->Duration = record.Duration;
+    return true;
+}
+
+bool TrackCache::Find(const std::wstring &id, Config::TrackInfo *info) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_header || m_header->Count == 0)
+        return false;
+
+    uint64_t hash = Hash(id);
+    uint32_t mask = m_header->BucketCount - 1;
+    for (uint32_t i = uint32_t(hash) & mask, probes = 0; probes < m_header->BucketCount; i = (i + 1) & mask, ++probes) {
+        uint32_t index = m_buckets[i];
+        if (index == 0 || index > m_header->Count)
+            return false;
+
+        const Record &record = m_records[index - 1];
+        if (record.Hash != hash)
+            continue;
+
+        Config::TrackInfo ti;
+        if (Read(record, &ti) && ti.Id == id) {
+            *info = ti;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TrackCache::Save(const std::wstring &path, const std::unordered_map<VideoId, Config::TrackInfo> &infos) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    std::vector<Record> records;
+    std::vector<unsigned char> strings;
+    auto addString = [&strings](const std::wstring &s) -> uint32_t {
+        uint32_t offset = uint32_t(strings.size());
+        uint32_t length = uint32_t(s.size());
+        std::size_t bytes = sizeof(uint32_t) + s.size() * sizeof(wchar_t);
+        strings.resize(offset + ((bytes + 3) & ~std::size_t(3)));
+        memcpy(strings.data() + offset, &length, sizeof(uint32_t));
+        memcpy(strings.data() + offset + sizeof(uint32_t), s.data(), s.size() * sizeof(wchar_t));
+        return offset;
+    };
+    auto addRecord = [&](const std::wstring &id, const Config::TrackInfo &ti) {
+        Record r = { Hash(id), addString(id), addString(ti.Name), addString(ti.Permalink), addString(ti.Artwork), ti.Duration };
+        records.push_back(r);
+    };
+
+    // Entries still only in the old file keep their contents
+    if (m_header) {
+        for (uint32_t i = 0; i < m_header->Count; ++i) {
+            Config::TrackInfo ti;
+            if (Read(m_records[i], &ti) && infos.find(ti.Id) == infos.end())
+                addRecord(ti.Id, ti);
+        }
+    }
+    for (const auto &x : infos)
+        addRecord(x.first.ToString(), x.second);
+
+    // Load factor of at most 1/2 keeps the probes short
+    uint32_t bucketCount = 16;
+    while (bucketCount < records.size() * 2)
+        bucketCount <<= 1;
+
+    std::vector<uint32_t> buckets(bucketCount, 0);
+    for (uint32_t i = 0; i < records.size(); ++i) {
+        uint32_t b = uint32_t(records[i].Hash) & (bucketCount - 1);
+        while (buckets[b] != 0)
+            b = (b + 1) & (bucketCount - 1);
+        buckets[b] = i + 1;
+    }
+
+    Header header = { { 'Y', 'T', 'T', 'C' }, Version, uint32_t(records.size()), bucketCount, strings.size() };
+
+    // Lookups keep using the old file while the new one is written
+    lock.unlock();
+
+    std::wstring tempFile = path + L".tmp";
+    FILE *file = nullptr;
+    if (_wfopen_s(&file, tempFile.c_str(), L"wb") != 0)
+        return false;
+
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   (records.empty() || fwrite(records.data(), sizeof(Record), records.size(), file) == records.size()) &&
+                   fwrite(buckets.data(), sizeof(uint32_t), buckets.size(), file) == buckets.size() &&
+                   (strings.empty() || fwrite(strings.data(), 1, strings.size(), file) == strings.size());
+    written = fclose(file) == 0 && written;
+    if (!written) {
+        DeleteFile(tempFile.c_str());
+        return false;
+    }
+
+    // The mapped file can't be replaced while it is mapped
+    lock.lock();
+    Unmap();
+    bool moved = MoveFileEx(tempFile.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+    lock.unlock();
+
+    return Open(path) && moved;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <cstdint>
+#include "Config.h"
+
+// Track info cache file (Cache.bin), memory-mapped at startup and read lazily on lookup.
+// Layout: Header, Record[Count], uint32 Buckets[BucketCount], string table.
+// Buckets is an open addressing hash index of record index + 1 (0 = empty), strings are
+// a uint32 length followed by UTF-16 data, padded to 4 bytes.
+class TrackCache {
+public:
+    static bool Open(const std::wstring &path);
+    static void Close();
+
+    static bool Find(const std::wstring &id, Config::TrackInfo *info);
+    // Writes the mapped entries merged with (and overridden by) the given ones and maps the new file
+    static bool Save(const std::wstring &path, const std::unordered_map<VideoId, Config::TrackInfo> &infos);
+
+private:
+    struct Header {
+        char Magic[4];
+        uint32_t Version;
+        uint32_t Count;
+        uint32_t BucketCount;
+        uint64_t StringsSize;
+    };
+    struct Record {
+        uint64_t Hash;
+        uint32_t Id;
+        uint32_t Name;
+        uint32_t Permalink;
+        uint32_t Artwork;
+        double Duration;
+    };
+
+    static const uint32_t Version = 1;
+
+    static uint64_t Hash(const std::wstring &id);
+    static bool String(uint32_t offset, std::wstring &out);
+    static bool Read(const Record &record, Config::TrackInfo *info);
+    static void Unmap();
+
+    TrackCache();
+    TrackCache(const TrackCache &);
+    TrackCache &operator=(const TrackCache &);
+
+    static std::mutex m_mutex;
+    static HANDLE m_file;
+    static HANDLE m_mapping;
+    static const unsigned char *m_view;
+    static const Header *m_header;
+    static const Record *m_records;
+    static const uint32_t *m_buckets;
+    static const unsigned char *m_strings;
+};
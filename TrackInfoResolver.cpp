@@ -0,0 +1,177 @@
+#include "TrackInfoResolver.h"
+#include "AIMPYouTube.h"
+#include "AimpHTTP.h"
+#include "JsonResponse.h"
+#include "Timer.h"
+#include "Tools.h"
+#include <chrono>
+#include <memory>
+
+std::mutex TrackInfoResolver::m_mutex;
+std::condition_variable TrackInfoResolver::m_cv;
+std::unordered_map<std::wstring, std::vector<TrackInfoResolver::Callback>> TrackInfoResolver::m_waiters;
+std::deque<std::wstring> TrackInfoResolver::m_queue;
+int TrackInfoResolver::m_inFlight = 0;
+bool TrackInfoResolver::m_flushScheduled = false;
+
+bool TrackInfoResolver::Enqueue(const std::wstring &id, Callback callback) {
+    auto waiters = m_waiters.find(id);
+    bool queued = waiters == m_waiters.end();
+    if (queued) {
+        waiters = m_waiters.insert({ id, std::vector<Callback>() }).first;
+        m_queue.push_back(id);
+    }
+    if (callback)
+        waiters->second.push_back(callback);
+
+    bool schedule = queued && !m_flushScheduled;
+    if (schedule)
+        m_flushScheduled = true;
+    return schedule;
+}
+
+void TrackInfoResolver::Resolve(const std::wstring &id, Callback callback) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    bool schedule = Enqueue(id, callback);
+    lock.unlock();
+
+    if (schedule)
+        Timer::SingleShot(CoalesceWindow, Flush);
+}
+
+bool TrackInfoResolver::ResolveNow(const std::wstring &id, Config::TrackInfo *info) {
+    // The main thread copies the info into the result, Config::TrackInfos isn't read here
+    struct Result {
+        bool Done;
+        bool Found;
+        Config::TrackInfo Info;
+    };
+    auto result = std::make_shared<Result>();
+    result->Done = result->Found = false;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    bool schedule = Enqueue(id, [result](Config::TrackInfo *ti) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (ti)
+            result->Info = *ti;
+        result->Found = ti != nullptr;
+        result->Done = true;
+        m_cv.notify_all();
+    });
+    lock.unlock();
+
+    // The batch is started by a timer on the main thread like for Resolve, this thread only waits
+    if (schedule && !AimpHTTP::RunOnCompletionThread([] { Timer::SingleShot(CoalesceWindow, Flush); }))
+        return false;
+
+    lock.lock();
+    if (!m_cv.wait_for(lock, std::chrono::seconds(WaitTimeout), [result] { return result->Done; }) || !result->Found)
+        return false;
+    if (info)
+        *info = result->Info;
+    return true;
+}
+
+void TrackInfoResolver::Flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_flushScheduled = false;
+    while (!m_queue.empty() && m_inFlight < MaxInFlight) {
+        std::vector<std::wstring> batch;
+        while (!m_queue.empty() && batch.size() < BatchSize) {
+            batch.push_back(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_inFlight++;
+
+        lock.unlock();
+        Issue(batch);
+        lock.lock();
+    }
+}
+
+void TrackInfoResolver::Issue(const std::vector<std::wstring> &batch) {
+    std::wstring allIds;
+    for (const auto &x : batch)
+        allIds += x + L",";
+    allIds.resize(allIds.size() - 1); // Remove trailing comma
+
+    std::wstring url(L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails%2Csnippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + allIds);
+    url += L"&key=" TEXT(APP_KEY);
+    if (Plugin::instance()->isConnected())
+        url += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+
+    AimpHTTP::GetAsync(url)->Then([batch](unsigned char *data, int size) {
+        Completed(batch, data, size);
+    }, [batch] {
+        Dropped(batch);
+    });
+}
+
+void TrackInfoResolver::Dropped(const std::vector<std::wstring> &batch) {
+    // AimpHTTP is gone: neither this batch nor the queued ids will be answered, fail their waiters
+    // instead of leaving worker threads in ResolveNow() until WaitTimeout
+    std::vector<Callback> callbacks;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto take = [&callbacks](const std::wstring &id) {
+        auto it = m_waiters.find(id);
+        if (it != m_waiters.end()) {
+            for (auto &x : it->second)
+                callbacks.push_back(std::move(x));
+            m_waiters.erase(it);
+        }
+    };
+    for (const auto &x : batch)
+        take(x);
+    for (const auto &x : m_queue)
+        take(x);
+    m_queue.clear();
+    m_inFlight--;
+    lock.unlock();
+
+    for (auto &callback : callbacks)
+        callback(nullptr);
+}
+
+void TrackInfoResolver::Completed(const std::vector<std::wstring> &batch, unsigned char *data, int size) {
+    std::unordered_map<std::wstring, bool> results;
+
+    JsonResponse response(data, size);
+    rapidjson::Document &d = *response;
+    if (d.IsObject() && d.HasMember("items") && d["items"].IsArray()) {
+        for (auto x = d["items"].Begin(), e = d["items"].End(); x != e; x++) {
+            if ((*x).IsObject() && (*x).HasMember("id") && (*x)["id"].IsString()) {
+                std::wstring id = Tools::ToWString((*x)["id"]);
+                results[id] = Config::StoreTrackInfo(id, &(*x));
+            }
+        }
+
+        // Deleted and private videos are left out of the response
+        for (const auto &x : batch) {
+            if (results.find(x) == results.end())
+                results[x] = Config::StoreTrackInfo(x, nullptr);
+        }
+        Config::SaveCache();
+    }
+
+    std::vector<std::pair<std::wstring, std::vector<Callback>>> waiters;
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (const auto &x : batch) {
+        auto it = m_waiters.find(x);
+        if (it != m_waiters.end()) {
+            waiters.push_back({ x, std::move(it->second) });
+            m_waiters.erase(it);
+        }
+    }
+    m_inFlight--;
+    bool more = !m_queue.empty();
+    lock.unlock();
+
+    for (auto &x : waiters) {
+        Config::TrackInfo *ti = results[x.first] ? &Config::TrackInfos[x.first] : nullptr;
+        for (auto &callback : x.second)
+            callback(ti);
+    }
+
+    if (more)
+        Flush();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include "Config.h"
+
+// Coalesces TrackInfo cache misses into videos?id=a,b,c requests of up to 50 ids.
+// Misses arriving within CoalesceWindow share a batch, at most MaxInFlight batches run at once.
+class TrackInfoResolver {
+public:
+    typedef std::function<void(Config::TrackInfo *)> Callback;
+
+    // Main thread only, callback runs on the main thread (with nullptr if the track can't be resolved)
+    static void Resolve(const std::wstring &id, Callback callback = nullptr);
+    // Worker threads, blocks until the batch containing id is back (at most WaitTimeout) and copies the info
+    static bool ResolveNow(const std::wstring &id, Config::TrackInfo *info);
+
+private:
+    static bool Enqueue(const std::wstring &id, Callback callback);
+    static void Flush();
+    static void Issue(const std::vector<std::wstring> &batch);
+    static void Completed(const std::vector<std::wstring> &batch, unsigned char *data, int size);
+    // The request was dropped at shutdown, runs on whichever thread noticed
+    static void Dropped(const std::vector<std::wstring> &batch);
+
+    TrackInfoResolver();
+    TrackInfoResolver(const TrackInfoResolver &);
+    TrackInfoResolver &operator=(const TrackInfoResolver &);
+
+    static const std::size_t BatchSize = 50;
+    static const int CoalesceWindow = 50; // ms
+    static const int MaxInFlight = 4;
+    static const int WaitTimeout = 10; // s
+
+    static std::mutex m_mutex;
+    static std::condition_variable m_cv;
+    static std::unordered_map<std::wstring, std::vector<Callback>> m_waiters;
+    static std::deque<std::wstring> m_queue;
+    static int m_inFlight;
+    static bool m_flushScheduled;
+};
@@ -0,0 +1,73 @@
+#include "VideoId.h"
+
+static const wchar_t Alphabet[] = L"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+const std::wstring VideoId::m_empty;
+std::mutex VideoId::m_internMutex;
+std::unordered_set<std::wstring> VideoId::m_interned;
+
+static inline int Base64Index(wchar_t c) {
+    if (c >= L'A' && c <= L'Z') return c - L'A';
+    if (c >= L'a' && c <= L'z') return c - L'a' + 26;
+    if (c >= L'0' && c <= L'9') return c - L'0' + 52;
+    if (c == L'-') return 62;
+    if (c == L'_') return 63;
+    return -1;
+}
+
+bool VideoId::Pack(const wchar_t *id, std::size_t length, uint64_t *bits) {
+    if (length != 11)
+        return false;
+
+    uint64_t value = 0;
+    for (int i = 0; i < 10; ++i) {
+        int x = Base64Index(id[i]);
+        if (x < 0)
+            return false;
+        value = (value << 6) | uint64_t(x);
+    }
+
+    // Only every 4th character can end a standard id
+    int last = Base64Index(id[10]);
+    if (last < 0 || (last & 3) != 0)
+        return false;
+
+    *bits = (value << 4) | uint64_t(last >> 2);
+    return true;
+}
+
+void VideoId::Assign(const wchar_t *id, std::size_t length) {
+    if (length == 0) {
+        m_bits = 0;
+        m_other = &m_empty;
+        return;
+    }
+
+    if (Pack(id, length, &m_bits)) {
+        m_other = nullptr;
+        return;
+    }
+
+    m_bits = 14695981039346656037ULL;
+    for (std::size_t i = 0; i < length; ++i) {
+        m_bits ^= uint64_t(id[i]);
+        m_bits *= 1099511628211ULL;
+    }
+
+    // Set elements never move, the pointer stays valid for the lifetime of the plugin
+    std::unique_lock<std::mutex> lock(m_internMutex);
+    m_other = &*m_interned.insert(std::wstring(id, length)).first;
+}
+
+std::wstring VideoId::ToString() const {
+    if (m_other)
+        return *m_other;
+
+    std::wstring id(11, L'A');
+    id[10] = Alphabet[(m_bits & 0xF) << 2];
+    uint64_t value = m_bits >> 4;
+    for (int i = 9; i >= 0; --i, value >>= 6) {
+        id[i] = Alphabet[value & 0x3F];
+    }
+    return id;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <unordered_set>
+#include <mutex>
+#include <cstdint>
+#include <cwchar>
+
+// Video id as a 64-bit value. Standard ids are 11 base64url characters, the last of which only
+// carries 4 bits (10 * 6 + 4 = 64), so they pack exactly. Anything else is interned once and
+// referenced, with its hash in place of the packed bits.
+class VideoId {
+public:
+    VideoId() : m_bits(0), m_other(&m_empty) {}
+    VideoId(const std::wstring &id) { Assign(id.c_str(), id.size()); }
+    VideoId(const wchar_t *id) { Assign(id, wcslen(id)); }
+    VideoId(const wchar_t *id, std::size_t length) { Assign(id, length); }
+
+    std::wstring ToString() const;
+    bool Empty() const { return m_other == &m_empty; }
+    std::size_t Hash() const { return std::size_t(m_bits ^ (m_bits >> 32)); }
+
+    friend bool operator ==(const VideoId &a, const VideoId &b) { return a.m_bits == b.m_bits && a.m_other == b.m_other; }
+    friend bool operator !=(const VideoId &a, const VideoId &b) { return !(a == b); }
+
+private:
+    VideoId(uint64_t bits, const std::wstring *other) : m_bits(bits), m_other(other) {}
+    void Assign(const wchar_t *id, std::size_t length);
+    static bool Pack(const wchar_t *id, std::size_t length, uint64_t *bits);
+
+    uint64_t m_bits;
+    const std::wstring *m_other; // Interned id, nullptr when packed
+
+    static const std::wstring m_empty;
+    static std::mutex m_internMutex;
+    static std::unordered_set<std::wstring> m_interned;
+    friend class VideoIdSet;
+};
+
+namespace std {
+    template <>
+    struct hash<VideoId> {
+        std::size_t operator()(const VideoId &id) const { return id.Hash(); }
+    };
+}
@@ -0,0 +1,111 @@
+#include "VideoIdSet.h"
+
+std::size_t VideoIdSet::Slot(const VideoId &id) const {
+    if (m_state.empty())
+        return NotFound;
+
+    std::size_t mask = m_state.size() - 1;
+    for (std::size_t i = Home(id.m_bits);; i = (i + 1) & mask) {
+        if (m_state[i] == Empty)
+            return NotFound;
+        if (m_state[i] == Full && m_bits[i] == id.m_bits && m_other[i] == id.m_other)
+            return i;
+    }
+}
+
+std::size_t VideoIdSet::NextFull(std::size_t index) const {
+    while (index < m_state.size() && m_state[index] != Full)
+        ++index;
+    return index;
+}
+
+VideoIdSet::iterator VideoIdSet::find(const VideoId &id) const {
+    std::size_t slot = Slot(id);
+    return slot != NotFound ? iterator(this, slot) : end();
+}
+
+std::pair<VideoIdSet::iterator, bool> VideoIdSet::insert(const VideoId &id) {
+    std::size_t slot = Slot(id);
+    if (slot != NotFound)
+        return std::make_pair(iterator(this, slot), false);
+
+    // At most 3/4 of the slots in use, tombstones included
+    if ((m_size + m_deleted + 1) * 4 > m_state.size() * 3)
+        Rehash((m_size + 1) * 2);
+
+    std::size_t mask = m_state.size() - 1;
+    std::size_t i = Home(id.m_bits);
+    while (m_state[i] == Full)
+        i = (i + 1) & mask;
+
+    if (m_state[i] == Deleted)
+        m_deleted--;
+    m_state[i] = Full;
+    m_bits[i] = id.m_bits;
+    m_other[i] = id.m_other;
+    m_size++;
+    return std::make_pair(iterator(this, i), true);
+}
+
+std::size_t VideoIdSet::erase(const VideoId &id) {
+    std::size_t slot = Slot(id);
+    if (slot == NotFound)
+        return 0;
+
+    erase(iterator(this, slot));
+    return 1;
+}
+
+VideoIdSet::iterator VideoIdSet::erase(iterator it) {
+    m_state[it.m_index] = Deleted;
+    m_size--;
+    m_deleted++;
+    return iterator(this, NextFull(it.m_index + 1));
+}
+
+void VideoIdSet::reserve(std::size_t count) {
+    if (count * 4 > m_state.size() * 3)
+        Rehash(count);
+}
+
+void VideoIdSet::clear() {
+    m_state.clear();
+    m_bits.clear();
+    m_other.clear();
+    m_size = 0;
+    m_deleted = 0;
+    m_shift = 64;
+}
+
+void VideoIdSet::Rehash(std::size_t count) {
+    std::size_t capacity = 16;
+    int shift = 60;
+    while (capacity * 3 < count * 4) {
+        capacity <<= 1;
+        shift--;
+    }
+
+    std::vector<uint8_t> state(capacity, Empty);
+    std::vector<uint64_t> bits(capacity);
+    std::vector<const std::wstring *> other(capacity);
+    m_shift = shift;
+
+    std::size_t mask = capacity - 1;
+    for (std::size_t j = 0; j < m_state.size(); ++j) {
+        if (m_state[j] != Full)
+            continue;
+
+        std::size_t i = Home(m_bits[j]);
+        while (state[i] == Full)
+            i = (i + 1) & mask;
+
+        state[i] = Full;
+        bits[i] = m_bits[j];
+        other[i] = m_other[j];
+    }
+
+    m_state.swap(state);
+    m_bits.swap(bits);
+    m_other.swap(other);
+    m_deleted = 0;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include "VideoId.h"
+
+// Open addressing (linear probing) set of video ids for the hot membership checks.
+// Slots are kept as separate state/bits/interned arrays, so probing only walks two dense arrays
+// and there is no allocation per entry. Erased slots become tombstones until the next rehash,
+// which keeps iterators valid across erase().
+class VideoIdSet {
+public:
+    class const_iterator {
+    public:
+        const_iterator() : m_set(nullptr), m_index(0) {}
+
+        VideoId operator *() const { return m_set->At(m_index); }
+        const_iterator &operator ++() { m_index = m_set->NextFull(m_index + 1); return *this; }
+        const_iterator operator ++(int) { const_iterator it(*this); ++*this; return it; }
+
+        bool operator ==(const const_iterator &that) const { return m_index == that.m_index; }
+        bool operator !=(const const_iterator &that) const { return m_index != that.m_index; }
+
+    private:
+        const_iterator(const VideoIdSet *set, std::size_t index) : m_set(set), m_index(index) {}
+
+        const VideoIdSet *m_set;
+        std::size_t m_index;
+        friend class VideoIdSet;
+    };
+    typedef const_iterator iterator;
+
+    VideoIdSet() : m_size(0), m_deleted(0), m_shift(64) {}
+
+    std::pair<iterator, bool> insert(const VideoId &id);
+    std::size_t erase(const VideoId &id);
+    iterator erase(iterator it);
+    iterator find(const VideoId &id) const;
+    std::size_t count(const VideoId &id) const { return Slot(id) != NotFound ? 1 : 0; }
+
+    void reserve(std::size_t count);
+    void clear();
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    iterator begin() const { return iterator(this, NextFull(0)); }
+    iterator end() const { return iterator(this, m_state.size()); }
+
+private:
+    enum SlotState : uint8_t {
+        Empty = 0,
+        Full,
+        Deleted
+    };
+    static const std::size_t NotFound = std::size_t(-1);
+
+    std::size_t Home(uint64_t bits) const { return std::size_t((bits * 0x9E3779B97F4A7C15ULL) >> m_shift); }
+    std::size_t Slot(const VideoId &id) const;
+    std::size_t NextFull(std::size_t index) const;
+    VideoId At(std::size_t index) const { return VideoId(m_bits[index], m_other[index]); }
+    void Rehash(std::size_t capacity);
+
+    std::vector<uint8_t> m_state;
+    std::vector<uint64_t> m_bits;
+    std::vector<const std::wstring *> m_other;
+    std::size_t m_size;
+    std::size_t m_deleted;
+    int m_shift; // 64 - log2(capacity)
+};
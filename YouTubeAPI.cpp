@@ -2,21 +2,32 @@
 
 #include "AIMPYouTube.h"
 #include "AimpHTTP.h"
+#include "JsonResponse.h"
+#include "PageReader.h"
 #include "SDK/apiFileManager.h"
 #include "SDK/apiPlaylists.h"
 #include "AIMPString.h"
 #include "DurationResolver.h"
 #include "Tools.h"
 #include "Timer.h"
+#include "PlaylistIndex.h"
 #include <Strsafe.h>
 #include <string>
 #include <set>
 #include <map>
-#include <regex>
+#include <ctime>
+#include <algorithm>
 
 YouTubeAPI::DecoderMap YouTubeAPI::SigDecoder;
-
-void YouTubeAPI::AddFromJson(IAIMPPlaylist *playlist, const rapidjson::Value &d, std::shared_ptr<LoadingState> state) {
+std::mutex YouTubeAPI::m_streamUrlMutex;
+std::unordered_map<std::wstring, YouTubeAPI::StreamUrl> YouTubeAPI::m_streamUrls;
+std::unordered_map<std::wstring, std::shared_future<YouTubeAPI::StreamUrl>> YouTubeAPI::m_pendingStreamUrls;
+std::mutex YouTubeAPI::m_fetchMutex;
+int YouTubeAPI::m_activeFetches = 0;
+std::deque<std::pair<std::wstring, std::function<void()>>> YouTubeAPI::m_waitingFetches;
+std::unordered_map<std::wstring, DWORD> YouTubeAPI::m_nextFetchTime;
+
+void YouTubeAPI::AddItems(IAIMPPlaylist *playlist, const std::vector<PageReader::Item> &items, std::shared_ptr<LoadingState> state) {
     if (!playlist || !state || !Plugin::instance()->core())
         return;
 
@@ -24,23 +35,20 @@ void YouTubeAPI::AddFromJson(IAIMPPlaylist *playlist, const rapidjson::Value &d,
     if (insertAt >= 0)
         insertAt += state->AdditionalPos;
 
+    PlaylistIndex::Insertion insertion(playlist);
     IAIMPFileInfo *file_info = nullptr;
     if (Plugin::instance()->core()->CreateObject(IID_IAIMPFileInfo, reinterpret_cast<void **>(&file_info)) == S_OK) {
-        auto processItem = [&](const std::wstring &pid, const rapidjson::Value &item, const rapidjson::Value &contentDetails) {
-            if (!item.HasMember("title"))
-                return;
+        for (const auto &item : items) {
+            if (!item.HasTitle)
+                continue;
 
-            std::wstring final_title = Tools::ToWString(item["title"]);
+            const std::wstring &final_title = item.Title;
             if (final_title == L"Deleted video" || final_title == L"Private video")
-                return;
+                continue;
 
-            std::wstring trackId;
-            if (item.HasMember("resourceId")) {
-                trackId = Tools::ToWString(item["resourceId"]["videoId"]);
-            } else {
-                trackId = pid;
-            }
-            if (state->TrackIds.find(trackId) != state->TrackIds.end()) {
+            const std::wstring &trackId = item.VideoId;
+            VideoId videoId(trackId);
+            if (state->TrackIds.count(videoId)) {
                 // Already added earlier
                 if (insertAt >= 0 && !(state->Flags & LoadingState::IgnoreExistingPosition)) {
                     insertAt++;
@@ -48,15 +56,15 @@ void YouTubeAPI::AddFromJson(IAIMPPlaylist *playlist, const rapidjson::Value &d,
                     if (state->Flags & LoadingState::UpdateAdditionalPos)
                         state->AdditionalPos++;
                 }
-                return;
+                continue;
             }
 
-            if (Config::TrackExclusions.find(trackId) != Config::TrackExclusions.end())
-                return; // Track excluded
+            if (Config::TrackExclusions.count(videoId))
+                continue; // Track excluded
 
-            state->TrackIds.insert(trackId);
+            state->TrackIds.insert(videoId);
             if (state->PlaylistToUpdate) {
-                state->PlaylistToUpdate->Items.insert(trackId);
+                Config::AddUserPlaylistItem(*state->PlaylistToUpdate, videoId);
             }
 
             std::wstring filename(L"youtube://");
@@ -68,40 +76,26 @@ void YouTubeAPI::AddFromJson(IAIMPPlaylist *playlist, const rapidjson::Value &d,
             if (!state->ReferenceName.empty()) {
                 file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_ALBUM, AIMPString(state->ReferenceName));
             }
-            if (item.HasMember("channelTitle") && (state->Flags & LoadingState::AddChannelTitle)) {
-                file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_ARTIST, AIMPString(item["channelTitle"]));
+            if (item.HasChannelTitle && (state->Flags & LoadingState::AddChannelTitle)) {
+                file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_ARTIST, AIMPString(item.ChannelTitle));
             }
 
-            int64_t videoDuration = 0;
-            if (contentDetails.IsObject() && contentDetails.HasMember("duration")) {
-                std::wstring duration = Tools::ToWString(contentDetails["duration"]);
-
-                std::wregex re(L"PT(?:([0-9]+)H)?(?:([0-9]+)M)?(?:([0-9]+)S)?");
-                std::wsmatch match;
-                if (std::regex_match(duration, match, re)) {
-                    auto h = match[1].matched ? std::stoll(match[1].str()) : 0;
-                    auto m = match[2].matched ? std::stoll(match[2].str()) : 0;
-                    auto s = match[3].matched ? std::stoll(match[3].str()) : 0;
-                    videoDuration = h * 3600 + m * 60 + s;
-
-                    file_info->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, videoDuration);
-                }
+            double videoDuration = 0;
+            if (item.Duration >= 0) {
+                videoDuration = item.Duration;
+                file_info->SetValueAsFloat(AIMP_FILEINFO_PROPID_DURATION, videoDuration);
             }
 
             AIMPString title(final_title);
             file_info->SetValueAsObject(AIMP_FILEINFO_PROPID_TITLE, title);
 
-            std::wstring artwork;
-            if (item.HasMember("thumbnails") && item["thumbnails"].IsObject() && item["thumbnails"].HasMember("high") && item["thumbnails"]["high"].HasMember("url")) {
-                artwork = Tools::ToWString(item["thumbnails"]["high"]["url"]);
-            }
-
             auto permalink = L"https://www.youtube.com/watch?v=" + trackId;
 
-            Config::TrackInfos[trackId] = Config::TrackInfo(final_title, trackId, permalink, artwork, videoDuration);
+            Config::SetTrackInfo(videoId, Config::TrackInfo(final_title, trackId, permalink, item.Artwork, videoDuration));
 
             const DWORD flags = AIMP_PLAYLIST_ADD_FLAGS_FILEINFO | AIMP_PLAYLIST_ADD_FLAGS_NOCHECKFORMAT | AIMP_PLAYLIST_ADD_FLAGS_NOEXPAND | AIMP_PLAYLIST_ADD_FLAGS_NOTHREADING;
             if (SUCCEEDED(playlist->Add(file_info, flags, insertAt))) {
+                insertion.Added(videoId, insertAt);
                 state->AddedItems++;
                 if (insertAt >= 0) {
                     insertAt++;
@@ -110,22 +104,6 @@ void YouTubeAPI::AddFromJson(IAIMPPlaylist *playlist, const rapidjson::Value &d,
                         state->AdditionalPos++;
                 }
             }
-        };
-
-        rapidjson::Value null;
-
-        if (d.IsArray()) {
-            for (auto x = d.Begin(), e = d.End(); x != e; x++) {
-                const rapidjson::Value *px = &(*x);
-                if (!px->IsObject() || !px->HasMember("snippet"))
-                    continue;
-
-                processItem((*px).HasMember("id") ? Tools::ToWString((*px)["id"]) : L"", (*px)["snippet"], px->HasMember("contentDetails")? (*px)["contentDetails"] : null);
-            }
-        } else if (d.IsObject() && d.HasMember("snippet")) {
-            processItem(d.HasMember("id")? Tools::ToWString(d["id"]) : L"", d["snippet"], d.HasMember("contentDetails") ? d["contentDetails"] : null);
-        } else if (d.IsObject()) {
-            processItem(L"", d, null);
         }
         file_info->Release();
     }
@@ -135,6 +113,29 @@ void YouTubeAPI::LoadFromUrl(std::wstring url, IAIMPPlaylist *playlist, std::sha
     if (!playlist || !state)
         return;
 
+    auto loader = std::make_shared<Loader>();
+    loader->Playlist = playlist;
+    loader->State = state;
+    loader->FinishCallback = finishCallback;
+    loader->Current = 0;
+
+    // The url itself, then every pending url. All of them are fetched concurrently, but added in this order
+    int flags = state->Flags;
+    loader->Chains.push_back({ { std::wstring(), url, -3 }, false, flags, true, false, false });
+    while (!state->PendingUrls.empty()) {
+        const LoadingState::PendingUrl &pl = state->PendingUrls.front();
+        if (pl.PlaylistPosition > -3) // -3 = don't change
+            flags = LoadingState::UpdateAdditionalPos | LoadingState::IgnoreExistingPosition;
+
+        loader->Chains.push_back({ pl, true, flags, true, false, false });
+        state->PendingUrls.pop();
+    }
+
+    for (std::size_t i = 0; i < loader->Chains.size(); ++i)
+        Fetch(loader, i, loader->Chains[i].Source.Url);
+}
+
+void YouTubeAPI::Fetch(LoaderPtr loader, std::size_t chain, const std::wstring &url) {
     std::wstring reqUrl(url);
     if (reqUrl.find(L'?') == std::wstring::npos) {
         reqUrl += L'?';
@@ -144,76 +145,212 @@ void YouTubeAPI::LoadFromUrl(std::wstring url, IAIMPPlaylist *playlist, std::sha
     reqUrl += L"key=" TEXT(APP_KEY);
     if (Plugin::instance()->isConnected())
         reqUrl += L"\r\nAuthorization: Bearer " + Plugin::instance()->getAccessToken();
+    if (!loader->State->ETag.empty() && IsFirstPlaylistPage(url))
+        reqUrl += L"\r\nIf-None-Match: " + loader->State->ETag;
+
+    auto fetch = [loader, chain, url, reqUrl] {
+        auto request = AimpHTTP::GetAsync(reqUrl);
+        request->Then([loader, chain, url, request](unsigned char *, int) {
+            FetchDone();
+            Fetched(loader, chain, url, request);
+        }, FetchDropped);
+    };
+
+    std::wstring host(url);
+    std::size_t pos = host.find(L"://");
+    if (pos != std::wstring::npos)
+        host.erase(0, pos + 3);
+    if ((pos = host.find(L'/')) != std::wstring::npos)
+        host.resize(pos);
+
+    std::unique_lock<std::mutex> lock(m_fetchMutex);
+    if (m_activeFetches >= (std::max)(1, Config::GetInt32(L"MaxConcurrentRequests", 4))) {
+        m_waitingFetches.push_back({ host, fetch });
+        return;
+    }
+    m_activeFetches++;
+    lock.unlock();
 
-    AimpHTTP::Get(reqUrl, [playlist, state, finishCallback, url](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
-
-        playlist->BeginUpdate();
-        if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0 && d["items"][0].HasMember("contentDetails") && d["items"][0]["contentDetails"].HasMember("relatedPlaylists")) {
-            const rapidjson::Value &i = d["items"][0]["contentDetails"]["relatedPlaylists"];
-            std::wstring uploads = Tools::ToWString(i["uploads"]);
-            /*std::wstring favorites = Tools::ToWString(i["favorites"]);
-            std::wstring likes = Tools::ToWString(i["likes"]);
-            std::wstring watchLater = Tools::ToWString(i["watchLater"]);*/
-            std::wstring userName = Tools::ToWString(d["items"][0]["snippet"]["localized"]["title"]);
-            IAIMPPropertyList *plProp = nullptr;
-            if (SUCCEEDED(playlist->QueryInterface(IID_IAIMPPropertyList, reinterpret_cast<void **>(&plProp)))) {
-                plProp->SetValueAsObject(AIMP_PLAYLIST_PROPID_NAME, AIMPString(userName));
-                plProp->Release();
-            }
-            state->ReferenceName = userName;
+    StartFetch(host, fetch);
+}
 
-            LoadFromUrl(L"https://content.googleapis.com/youtube/v3/playlistItems?part=contentDetails%2Csnippet&maxResults=50&playlistId=" + uploads +
-                        L"&fields=items%2Fsnippet%2Ckind%2CnextPageToken%2CpageInfo%2CtokenPagination", playlist, state, finishCallback);
+void YouTubeAPI::StartFetch(const std::wstring &host, std::function<void()> fetch) {
+    DWORD interval = 1000 / (std::max)(1, Config::GetInt32(L"RequestsPerSecond", 10));
+
+    // Reserve the next free slot of the host, the tick count may wrap around
+    std::unique_lock<std::mutex> lock(m_fetchMutex);
+    DWORD now = GetTickCount();
+    DWORD wait = 0;
+    auto next = m_nextFetchTime.find(host);
+    if (next != m_nextFetchTime.end() && int32_t(next->second - now) > 0)
+        wait = next->second - now;
+    m_nextFetchTime[host] = now + wait + interval;
+    lock.unlock();
+
+    if (wait == 0) {
+        fetch();
+    } else if (AimpHTTP::OnCompletionThread()) {
+        Timer::SingleShot(wait, fetch);
+    } else {
+        Sleep(wait);
+        fetch();
+    }
+}
 
-            playlist->EndUpdate();
-            return;
-        } else if (d.IsObject() && d.HasMember("items")) {
-            AddFromJson(playlist, d["items"], state);
-        } else {
-            AddFromJson(playlist, d, state);
-        }
-        playlist->EndUpdate();
+void YouTubeAPI::FetchDone() {
+    std::unique_lock<std::mutex> lock(m_fetchMutex);
+    if (m_waitingFetches.empty()) {
+        m_activeFetches--;
+        return;
+    }
+
+    // Hand the slot over to the oldest waiting request
+    auto fetch = m_waitingFetches.front();
+    m_waitingFetches.pop_front();
+    lock.unlock();
+
+    StartFetch(fetch.first, fetch.second);
+}
+
+void YouTubeAPI::FetchDropped() {
+    // AimpHTTP is gone, so are the loads waiting for a slot. The slot is free for the next Init.
+    std::unique_lock<std::mutex> lock(m_fetchMutex);
+    m_activeFetches--;
+    m_waitingFetches.clear();
+}
+
+bool YouTubeAPI::IsFirstPlaylistPage(const std::wstring &url) {
+    return url.find(L"/playlistItems?") != std::wstring::npos && url.find(L"&pageToken=") == std::wstring::npos;
+}
+
+void YouTubeAPI::Fetched(LoaderPtr loader, std::size_t chain, const std::wstring &url, AimpHTTP::RequestPtr request) {
+    auto state = loader->State;
+    PageChain &c = loader->Chains[chain];
+    bool firstPage = IsFirstPlaylistPage(url);
+    if (firstPage && !state->ETag.empty() && request->Status() == 304) {
+        // Nothing changed since the last sweep
+        state->NotModified = true;
+        c.Fetching = false;
+        Drain(loader);
+        return;
+    }
+
+    // Read straight from the response buffer into item records, no document is built
+    auto page = std::make_shared<PageReader::Page>();
+    if (request->Size() > 0)
+        PageReader::Read(reinterpret_cast<char *>(request->Data()), page.get());
+    if (!page->Valid) {
+        state->FailedRequests++;
+    } else if (firstPage) {
+        state->NewETag = request->Header(L"ETag");
+    }
+
+    bool reachedKnown = false;
+    for (const auto &x : page->Items) {
+        if (x.PublishedAt.empty())
+            continue;
+
+        const std::wstring &publishedAt = x.PublishedAt;
+        if (publishedAt > state->NewestPublishedAt)
+            state->NewestPublishedAt = publishedAt; // ISO 8601 in UTC, compares as a string
+        if (!state->KnownPublishedAt.empty() && publishedAt <= state->KnownPublishedAt)
+            reachedKnown = true;
+    }
+    // Uploads (UU...) are listed newest first, once a page reaches known items the rest is known too
+    bool last = c.Stopped || (reachedKnown && url.find(L"playlistId=UU") != std::wstring::npos);
 
-        bool processNextPage = d.IsObject() && d.HasMember("nextPageToken");
+    // Ask for the next page before this one is added, so the playlist update overlaps the round trip
+    std::wstring next = last ? std::wstring() : NextPageUrl(loader, chain, url, *page);
+    c.Pages.push_back(page);
+    c.Fetching = !next.empty();
+    if (c.Fetching)
+        Fetch(loader, chain, next);
 
-        if ((state->Flags & LoadingState::IgnoreNextPage) ||
-            (Config::GetInt32(L"LimitUserStream", 0) && state->AddedItems >= Config::GetInt32(L"LimitUserStreamValue", 5000))) {
-            processNextPage = false;
+    Drain(loader);
+}
+
+std::wstring YouTubeAPI::NextPageUrl(LoaderPtr loader, std::size_t chain, const std::wstring &url, const PageReader::Page &page) {
+    if (page.IsChannel) {
+        // Channel, its uploads playlist holds the videos
+        return L"https://content.googleapis.com/youtube/v3/playlistItems?part=contentDetails%2Csnippet&maxResults=50&playlistId=" + page.Uploads +
+               L"&fields=items%2Fsnippet%2Ckind%2CnextPageToken%2CpageInfo%2CtokenPagination";
+    }
+
+    if (page.NextPageToken.empty() || (loader->Chains[chain].Flags & LoadingState::IgnoreNextPage) || LimitReached(*loader->State))
+        return std::wstring();
+
+    std::wstring next_url(url);
+    std::size_t pos = 0;
+    if ((pos = next_url.find(L"&pageToken")) != std::wstring::npos)
+        next_url = next_url.substr(0, pos);
+
+    return next_url + L"&pageToken=" + page.NextPageToken;
+}
+
+bool YouTubeAPI::LimitReached(const LoadingState &state) {
+    return Config::GetInt32(L"LimitUserStream", 0) && state.AddedItems >= Config::GetInt32(L"LimitUserStreamValue", 5000);
+}
+
+void YouTubeAPI::Drain(LoaderPtr loader) {
+    auto state = loader->State;
+    while (loader->Current < loader->Chains.size()) {
+        PageChain &c = loader->Chains[loader->Current];
+        if (!c.Pages.empty()) {
+            auto d = c.Pages.front();
+            c.Pages.pop_front();
+
+            // The limit is checked after every page, pages fetched ahead past it are dropped
+            if (c.Started && LimitReached(*state))
+                c.Stopped = true;
+            if (!c.Stopped)
+                AddPage(loader, *d);
+            c.Started = true;
+            continue;
         }
+        if (c.Fetching)
+            return; // Waiting for the next page of this url
 
-        if (processNextPage) {
-            std::wstring next_url(url);
-            std::size_t pos = 0;
-            if ((pos = next_url.find(L"&pageToken")) != std::wstring::npos)
-                next_url = next_url.substr(0, pos);
-
-            LoadFromUrl(next_url + L"&pageToken=" + Tools::ToWString(d["nextPageToken"]), playlist, state, finishCallback);
-        } else if (!state->PendingUrls.empty()) {
-            const LoadingState::PendingUrl &pl = state->PendingUrls.front();
-            if (!pl.Title.empty()) {
-                state->ReferenceName = pl.Title;
+        if (++loader->Current < loader->Chains.size()) {
+            const PageChain &pending = loader->Chains[loader->Current];
+            if (!pending.Source.Title.empty()) {
+                state->ReferenceName = pending.Source.Title;
             }
-            if (pl.PlaylistPosition > -3) { // -3 = don't change
-                state->InsertPos = pl.PlaylistPosition;
-                state->Flags = LoadingState::UpdateAdditionalPos | LoadingState::IgnoreExistingPosition;
+            if (pending.Source.PlaylistPosition > -3) { // -3 = don't change
+                state->InsertPos = pending.Source.PlaylistPosition;
+                state->Flags = pending.Flags;
             }
+        }
+    }
 
-            LoadFromUrl(pl.Url, playlist, state, finishCallback);
-            state->PendingUrls.pop();
-        } else {
-            // Finished
-            Config::SaveExtendedConfig();
+    // Finished
+    Config::SaveExtendedConfig();
+
+    DurationResolver::AddPlaylist(loader->Playlist);
+    DurationResolver::Resolve();
+
+    loader->Playlist->Release();
+    if (loader->FinishCallback)
+        loader->FinishCallback();
+}
 
-            DurationResolver::AddPlaylist(playlist);
-            DurationResolver::Resolve();
+void YouTubeAPI::AddPage(LoaderPtr loader, const PageReader::Page &page) {
+    IAIMPPlaylist *playlist = loader->Playlist;
+    auto state = loader->State;
 
-            playlist->Release();
-            if (finishCallback)
-                finishCallback();
+    // Covers the notification of EndUpdate() too
+    PlaylistIndex::Insertion insertion(playlist);
+    playlist->BeginUpdate();
+    if (page.IsChannel) {
+        IAIMPPropertyList *plProp = nullptr;
+        if (SUCCEEDED(playlist->QueryInterface(IID_IAIMPPropertyList, reinterpret_cast<void **>(&plProp)))) {
+            plProp->SetValueAsObject(AIMP_PLAYLIST_PROPID_NAME, AIMPString(page.ChannelName));
+            plProp->Release();
         }
-    });
+        state->ReferenceName = page.ChannelName;
+    } else {
+        AddItems(playlist, page.Items, state);
+    }
+    playlist->EndUpdate();
 }
 
 void YouTubeAPI::LoadUserPlaylist(Config::Playlist &playlist) {
@@ -246,12 +383,17 @@ void YouTubeAPI::LoadUserPlaylist(Config::Playlist &playlist) {
         }
         plProp->Release();
     }
-    playlist.AIMPPlaylistId = plId;
+    if (playlist.AIMPPlaylistId != plId) {
+        playlist.AIMPPlaylistId = plId;
+        Config::UserPlaylistChanged(playlist);
+        Config::SaveExtendedConfig();
+    }
 
     if (Config::GetInt32(L"MonitorUserPlaylists", 1)) {
         auto find = [&](const Config::MonitorUrl &p) -> bool { return p.PlaylistID == plId && p.URL == url; };
         if (std::find_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), find) == Config::MonitorUrls.end()) {
             Config::MonitorUrls.push_back({ url, plId, state->Flags, groupName });
+            Config::MonitorUrlsChanged();
         }
         Config::SaveExtendedConfig();
     }
@@ -263,19 +405,14 @@ void YouTubeAPI::GetExistingTrackIds(IAIMPPlaylist *pl, std::shared_ptr<LoadingS
     if (!pl || !state)
         return;
 
-    // Fetch current track ids from playlist
-    Plugin::instance()->ForEveryItem(pl, [&](IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &id) -> int {
-        if (!id.empty()) {
-            state->TrackIds.insert(id);
-        }
-        return 0;
-    });
+    // Track ids already in the playlist, the index only rescans it after its content changed
+    PlaylistIndex::TrackIds(pl, state->TrackIds);
 }
 
 void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlistTitle, bool createPlaylist) {
     if (url.find(L"youtube.com") != std::wstring::npos || url.find(L"youtu.be") != std::wstring::npos) {
         std::wstring finalUrl;
-        rapidjson::Value *addDirectly = nullptr;
+        std::shared_ptr<PageReader::Page> addDirectly;
         std::wstring plName;
         bool monitor = true;
         auto state = std::make_shared<LoadingState>();
@@ -360,8 +497,8 @@ void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlis
         }
         if (!ytPlaylistId.empty()) {
             AimpHTTP::Get(L"https://www.googleapis.com/youtube/v3/playlists?part=snippet&hl=" + Plugin::instance()->Lang(L"YouTube\\YouTubeLang") + L"&id=" + ytPlaylistId + L"&key=" TEXT(APP_KEY), [pl](unsigned char *data, int size) {
-                rapidjson::Document d;
-                d.Parse(reinterpret_cast<const char *>(data));
+                JsonResponse response(data, size);
+                rapidjson::Document &d = *response;
                 if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0 && d["items"][0].HasMember("snippet")) {
                     rapidjson::Value &val = d["items"][0]["snippet"];
                     std::wstring channelName = Tools::ToWString(val["channelTitle"]);
@@ -380,7 +517,7 @@ void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlis
         GetExistingTrackIds(pl, state);
 
         if (addDirectly) {
-            AddFromJson(pl, *addDirectly, state);
+            AddItems(pl, addDirectly->Items, state);
         } else {
             LoadFromUrl(finalUrl, pl, state);
         }
@@ -391,6 +528,7 @@ void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlis
                 auto find = [&](const Config::MonitorUrl &p) -> bool { return p.PlaylistID == playlistId && p.URL == x; };
                 if (std::find_if(Config::MonitorUrls.begin(), Config::MonitorUrls.end(), find) == Config::MonitorUrls.end()) {
                     Config::MonitorUrls.push_back({ x, playlistId, state->Flags, plName });
+                    Config::MonitorUrlsChanged();
                 }
             }
             Config::SaveExtendedConfig();
@@ -401,8 +539,64 @@ void YouTubeAPI::ResolveUrl(const std::wstring &url, const std::wstring &playlis
     MessageBox(Plugin::instance()->GetMainWindowHandle(), Plugin::instance()->Lang(L"YouTube.Messages\\CantResolve").c_str(), Plugin::instance()->Lang(L"YouTube.Messages\\Error").c_str(), MB_OK | MB_ICONERROR);
 }
 
-std::wstring YouTubeAPI::GetStreamUrl(const std::wstring &id) {
+std::wstring YouTubeAPI::GetStreamUrl(const std::wstring &id, int *itag, int64_t *contentLength) {
+    std::unique_lock<std::mutex> lock(m_streamUrlMutex);
+    int64_t now = std::time(nullptr);
+    auto cached = m_streamUrls.find(id);
+    if (cached != m_streamUrls.end() && cached->second.Expires - StreamUrlExpiryMargin > now) {
+        if (itag)
+            *itag = cached->second.Itag;
+        if (contentLength)
+            *contentLength = cached->second.ContentLength;
+        return cached->second.Url;
+    }
+
+    // Concurrent requests for the same id wait for the one already in flight
+    std::shared_future<StreamUrl> pending;
+    auto inFlight = m_pendingStreamUrls.find(id);
+    if (inFlight != m_pendingStreamUrls.end()) {
+        pending = inFlight->second;
+        lock.unlock();
+    } else {
+        std::promise<StreamUrl> promise;
+        pending = promise.get_future().share();
+        m_pendingStreamUrls[id] = pending;
+        lock.unlock();
+
+        StreamUrl resolved = ResolveStreamUrl(id);
+
+        lock.lock();
+        m_pendingStreamUrls.erase(id);
+        for (auto it = m_streamUrls.begin(); it != m_streamUrls.end();) {
+            if (it->second.Expires - StreamUrlExpiryMargin <= now) {
+                it = m_streamUrls.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (!resolved.Url.empty())
+            m_streamUrls[id] = resolved;
+        lock.unlock();
+
+        promise.set_value(resolved);
+    }
+
+    const StreamUrl &result = pending.get();
+    if (itag)
+        *itag = result.Itag;
+    if (contentLength)
+        *contentLength = result.ContentLength;
+    return result.Url;
+}
+
+void YouTubeAPI::InvalidateStreamUrl(const std::wstring &id) {
+    std::unique_lock<std::mutex> lock(m_streamUrlMutex);
+    m_streamUrls.erase(id);
+}
+
+YouTubeAPI::StreamUrl YouTubeAPI::ResolveStreamUrl(const std::wstring &id) {
     std::wstring stream_url;
+    int chosen = 0;
     std::wstring url2(L"http://www.youtube.com/get_video_info?video_id=" + id + L"&el=detailpage&sts=16511");
     AimpHTTP::Get(url2, [&](unsigned char *data, int size) {
         if (char *streams = strstr((char *)data, "url_encoded_fmt_stream_map=")) {
@@ -472,6 +666,7 @@ std::wstring YouTubeAPI::GetStreamUrl(const std::wstring &id) {
             for (auto x : streamPriority) {
                 if (urls.find(x) != urls.end()) {
                     stream_url = urls[x];
+                    chosen = x;
                     break;
                 }
             }
@@ -483,10 +678,22 @@ std::wstring YouTubeAPI::GetStreamUrl(const std::wstring &id) {
             // If none of preferred streams are available, get the first one
             if (stream_url.empty() && urls.size() > 0) {
                 stream_url = urls.begin()->second;
+                chosen = urls.begin()->first;
             }
         }
     }, true);
-    return stream_url;
+
+    int64_t expires = QueryInt64(stream_url, L"expire", std::time(nullptr) + StreamUrlDefaultLifetime);
+    return { stream_url, chosen, expires, QueryInt64(stream_url, L"clen", -1) };
+}
+
+int64_t YouTubeAPI::QueryInt64(const std::wstring &url, const wchar_t *name, int64_t defaultValue) {
+    std::wstring key = std::wstring(name) + L"=";
+    for (std::size_t pos = url.find(key); pos != std::wstring::npos; pos = url.find(key, pos + 1)) {
+        if (pos > 0 && (url[pos - 1] == L'?' || url[pos - 1] == L'&'))
+            return _wtoi64(url.c_str() + pos + key.size());
+    }
+    return defaultValue;
 }
 
 void YouTubeAPI::LoadSignatureDecoder() {
@@ -592,7 +799,7 @@ void YouTubeAPI::AddToPlaylist(Config::Playlist &pl, const std::wstring &trackId
 
     AimpHTTP::Post(L"https://www.googleapis.com/youtube/v3/playlistItems?part=snippet" + headers, postData, [&pl, trackId](unsigned char *data, int size) {
         if (strstr(reinterpret_cast<char *>(data), "youtube#playlistItem")) {
-            pl.Items.insert(trackId);
+            Config::AddUserPlaylistItem(pl, trackId);
             Config::SaveExtendedConfig();
 
             Timer::SingleShot(0, Plugin::MonitorCallback);
@@ -609,8 +816,8 @@ void YouTubeAPI::RemoveFromPlaylist(Config::Playlist &pl, const std::wstring &tr
 
     AimpHTTP::Get(L"https://content.googleapis.com/youtube/v3/playlistItems?part=id&videoId=" + trackId + L"&playlistId=" + pl.ID +
                   L"&fields=items%2Fid" + headers, [&pl, trackId, headers](unsigned char *data, int size) {
-        rapidjson::Document d;
-        d.Parse(reinterpret_cast<const char *>(data));
+        JsonResponse response(data, size);
+        rapidjson::Document &d = *response;
 
         if (d.IsObject() && d.HasMember("items") && d["items"].IsArray() && d["items"].Size() > 0) {
             std::wstring url(L"https://www.googleapis.com/youtube/v3/playlistItems?id=" + Tools::ToWString(d["items"][0]["id"]));
@@ -621,16 +828,11 @@ void YouTubeAPI::RemoveFromPlaylist(Config::Playlist &pl, const std::wstring &tr
             AimpHTTP::Post(url, std::string(), [&pl, trackId](unsigned char *data, int size) {
                 if (strlen(reinterpret_cast<char *>(data)) == 0) {
                     // removed correctly
-                    pl.Items.erase(trackId);
+                    Config::RemoveUserPlaylistItem(pl, trackId);
                     Config::SaveExtendedConfig();
 
                     if (IAIMPPlaylist *playlist = Plugin::instance()->GetPlaylistById(pl.AIMPPlaylistId)) {
-                        Plugin::instance()->ForEveryItem(playlist, [&trackId](IAIMPPlaylistItem *, IAIMPFileInfo *, const std::wstring &id) {
-                            if (!id.empty() && id == trackId) {
-                                return Plugin::FLAG_DELETE_ITEM | Plugin::FLAG_STOP_LOOP;
-                            }
-                            return 0;
-                        });
+                        PlaylistIndex::Remove(playlist, trackId);
                         playlist->Release();
                     }
                 }
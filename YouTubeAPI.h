@@ -7,7 +7,14 @@
 #include <functional>
 #include <windows.h>
 #include "Config.h"
+#include "AimpHTTP.h"
+#include "PageReader.h"
 #include <memory>
+#include <mutex>
+#include <future>
+#include <unordered_map>
+#include <deque>
+#include <vector>
 
 class IAIMPPlaylist;
 class IAIMPPlaylistItem;
@@ -28,7 +35,7 @@ public:
             IgnoreExistingPosition = 0x04,
             IgnoreNextPage         = 0x08
         };
-        std::unordered_set<std::wstring> TrackIds;
+        VideoIdSet TrackIds;
         std::queue<PendingUrl> PendingUrls;
         std::wstring ReferenceName;
         Config::Playlist *PlaylistToUpdate;
@@ -36,11 +43,23 @@ public:
         int InsertPos;
         int Offset;
         int AddedItems;
+        int FailedRequests;
         int Flags;
-        LoadingState() : AdditionalPos(0), InsertPos(0), Offset(0), AddedItems(0), PlaylistToUpdate(nullptr), Flags(None) {}
+
+        // Monitoring: sent as If-None-Match with the first playlistItems page, NewETag is the one returned
+        std::wstring ETag;
+        std::wstring NewETag;
+        bool NotModified;
+        // Monitoring: paging of uploads playlists stops at the first page reaching items this old
+        std::wstring KnownPublishedAt;
+        std::wstring NewestPublishedAt;
+
+        LoadingState() : AdditionalPos(0), InsertPos(0), Offset(0), AddedItems(0), FailedRequests(0), PlaylistToUpdate(nullptr), Flags(None), NotModified(false) {}
     };
 
-    static std::wstring GetStreamUrl(const std::wstring &id);
+    // contentLength is the size of the stream announced by the url (clen), -1 if it has none
+    static std::wstring GetStreamUrl(const std::wstring &id, int *itag = nullptr, int64_t *contentLength = nullptr);
+    static void InvalidateStreamUrl(const std::wstring &id);
 
     static void LoadSignatureDecoder();
     static void DecodeSignature(std::string &sig) {
@@ -64,11 +83,67 @@ public:
     static void GetExistingTrackIds(IAIMPPlaylist *pl, std::shared_ptr<LoadingState> state);
 
 private:
-    static void AddFromJson(IAIMPPlaylist *, const rapidjson::Value &, std::shared_ptr<LoadingState> state);
+    struct StreamUrl {
+        std::wstring Url;
+        int Itag;
+        int64_t Expires;
+        int64_t ContentLength;
+    };
+    static int64_t QueryInt64(const std::wstring &url, const wchar_t *name, int64_t defaultValue);
+    static StreamUrl ResolveStreamUrl(const std::wstring &id);
+
+    // Pages of one url of a load, fetched ahead of the ones being added to the playlist
+    struct PageChain {
+        LoadingState::PendingUrl Source;
+        bool Pending;
+        int Flags;
+        bool Fetching;
+        bool Started;
+        bool Stopped;
+        std::deque<std::shared_ptr<PageReader::Page>> Pages;
+    };
+    struct Loader {
+        IAIMPPlaylist *Playlist;
+        std::shared_ptr<LoadingState> State;
+        std::function<void()> FinishCallback;
+        std::vector<PageChain> Chains;
+        std::size_t Current;
+    };
+    typedef std::shared_ptr<Loader> LoaderPtr;
+
+    static void Fetch(LoaderPtr loader, std::size_t chain, const std::wstring &url);
+    static void StartFetch(const std::wstring &host, std::function<void()> fetch);
+    static void FetchDone();
+    // The page request outlived AimpHTTP, its Fetched continuation won't run
+    static void FetchDropped();
+    static void Fetched(LoaderPtr loader, std::size_t chain, const std::wstring &url, AimpHTTP::RequestPtr request);
+    static bool IsFirstPlaylistPage(const std::wstring &url);
+    static std::wstring NextPageUrl(LoaderPtr loader, std::size_t chain, const std::wstring &url, const PageReader::Page &page);
+    static void Drain(LoaderPtr loader);
+    static void AddPage(LoaderPtr loader, const PageReader::Page &page);
+    static bool LimitReached(const LoadingState &state);
+
+    static void AddItems(IAIMPPlaylist *, const std::vector<PageReader::Item> &items, std::shared_ptr<LoadingState> state);
 
     YouTubeAPI();
     YouTubeAPI(const YouTubeAPI &);
     YouTubeAPI &operator=(const YouTubeAPI &);
 
     static DecoderMap SigDecoder;
+
+    // Resolved urls are served until this many seconds before their expire= time
+    static const int StreamUrlExpiryMargin = 5 * 60;
+    // Used when the url carries no expire= parameter
+    static const int StreamUrlDefaultLifetime = 60 * 60;
+
+    static std::mutex m_streamUrlMutex;
+    static std::unordered_map<std::wstring, StreamUrl> m_streamUrls;
+    static std::unordered_map<std::wstring, std::shared_future<StreamUrl>> m_pendingStreamUrls;
+
+    // Page requests of all loads share MaxConcurrentRequests slots,
+    // and are spaced to at most RequestsPerSecond per host
+    static std::mutex m_fetchMutex;
+    static int m_activeFetches;
+    static std::deque<std::pair<std::wstring, std::function<void()>>> m_waitingFetches;
+    static std::unordered_map<std::wstring, DWORD> m_nextFetchTime;
 };
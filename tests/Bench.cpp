@@ -0,0 +1,315 @@
+#include "HttpResponseParser.h"
+#include "JsonResponse.h"
+#include "PageReader.h"
+#include "ParseTools.h"
+#include "VideoIdSet.h"
+#include "rapidjson/document.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <regex>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#ifdef __GLIBC__
+// Counts every heap allocation: rapidjson's CrtAllocator calls malloc directly, and operator new ends up there too
+extern "C" void *__libc_malloc(std::size_t size);
+extern "C" void *__libc_calloc(std::size_t count, std::size_t size);
+extern "C" void *__libc_realloc(void *ptr, std::size_t size);
+
+static std::size_t allocations = 0;
+static std::size_t allocatedBytes = 0;
+
+extern "C" void *malloc(std::size_t size) noexcept {
+    ++allocations;
+    allocatedBytes += size;
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(std::size_t count, std::size_t size) noexcept {
+    ++allocations;
+    allocatedBytes += count * size;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void *realloc(void *ptr, std::size_t size) noexcept {
+    ++allocations;
+    allocatedBytes += size;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+namespace {
+
+// Allocations made by one call of func, and their total size
+void CountAllocations(std::function<void()> func, std::size_t &count, std::size_t &bytes) {
+#ifdef __GLIBC__
+    std::size_t startCount = allocations, startBytes = allocatedBytes;
+    func();
+    count = allocations - startCount;
+    bytes = allocatedBytes - startBytes;
+#else
+    func();
+    count = bytes = 0;
+#endif
+}
+
+// Best of a few runs of func, in ms
+double Measure(std::function<void()> func, int runs = 5) {
+    double best = 1e300;
+    for (int i = 0; i < runs; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        func();
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        best = (std::min)(best, elapsed.count());
+    }
+    return best;
+}
+
+void BenchHttpResponseParser() {
+    std::string chunked = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nTransfer-Encoding: chunked\r\n\r\n";
+    for (int i = 0; i < 1024; ++i)
+        chunked += "400\r\n" + std::string(1024, 'x') + "\r\n";
+    chunked += "0\r\n\r\n";
+    std::string plain = "HTTP/1.1 200 OK\r\nContent-Length: 1048576\r\n\r\n" + std::string(1024 * 1024, 'x');
+
+    const int repeat = 64;
+    for (int step : { 1460, 16384 }) {
+        std::size_t received = 0;
+        double ms = Measure([&] {
+            for (int i = 0; i < repeat; ++i) {
+                HttpResponseParser parser([&received](const char *, std::size_t size) { received += size; });
+                for (std::size_t pos = 0; pos < chunked.size(); pos += step)
+                    parser.Feed(chunked.data() + pos, (std::min)(std::size_t(step), chunked.size() - pos));
+            }
+        });
+        std::printf("HttpResponseParser chunked, %5d byte reads: %8.1f MB/s\n", step, repeat * chunked.size() / 1048576.0 / (ms / 1000));
+    }
+
+    // Content-Length bodies copied straight into the destination
+    std::string destination(1024 * 1024, 0);
+    double ms = Measure([&] {
+        for (int i = 0; i < repeat; ++i) {
+            HttpResponseParser parser;
+            std::size_t headers = plain.find("\r\n\r\n") + 4, pos = 0;
+            parser.Feed(plain.data(), headers);
+            while (std::size_t n = (std::min)(parser.Direct(), std::size_t(16384))) {
+                memcpy(&destination[pos], plain.data() + headers + pos, n);
+                parser.Advance(n);
+                pos += n;
+            }
+        }
+    });
+    std::printf("HttpResponseParser Direct(), 16384 byte reads: %8.1f MB/s\n", repeat * plain.size() / 1048576.0 / (ms / 1000));
+}
+
+// Inserts n ids, then looks up n present and n absent ones
+template <typename Set, typename Key>
+double BenchSet(const std::vector<Key> &present, const std::vector<Key> &absent, std::size_t *found) {
+    return Measure([&] {
+        Set set;
+        for (const auto &x : present)
+            set.insert(x);
+        for (const auto &x : present)
+            *found += set.count(x);
+        for (const auto &x : absent)
+            *found += set.count(x);
+    }, 3);
+}
+
+void BenchVideoIdSet() {
+    static const wchar_t alphabet[] = L"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    std::mt19937 random(3);
+    for (std::size_t n : { 10000, 100000, 1000000 }) {
+        std::vector<std::wstring> present, absent;
+        for (std::size_t i = 0; i < 2 * n; ++i) {
+            std::wstring id;
+            for (int j = 0; j < 11; ++j)
+                id += alphabet[random() % 64];
+            (i < n ? present : absent).push_back(id);
+        }
+        std::vector<VideoId> presentIds(present.begin(), present.end()), absentIds(absent.begin(), absent.end());
+
+        std::size_t found = 0;
+        double strings = BenchSet<std::unordered_set<std::wstring>>(present, absent, &found);
+        double ids = BenchSet<std::unordered_set<VideoId>>(presentIds, absentIds, &found);
+        double flat = BenchSet<VideoIdSet>(presentIds, absentIds, &found);
+        std::printf("%7u ids: unordered_set<wstring> %8.2f ms, unordered_set<VideoId> %8.2f ms, VideoIdSet %8.2f ms\n",
+                    unsigned(n), strings, ids, flat);
+    }
+}
+
+void BenchClassifyUrl() {
+    static const wchar_t *shapes[] = {
+        L"https://www.youtube.com/watch?v=", L"https://youtu.be/", L"youtube://", L"https://www.youtube.com/playlist?list=PL",
+        L"https://www.googleapis.com/youtube/v3/videos?part=contentDetails&id=", L"C:\\Music\\Album\\Track "
+    };
+    std::mt19937 random(5);
+    std::vector<std::wstring> urls;
+    for (int i = 0; i < 1000000; ++i)
+        urls.push_back(shapes[random() % 6] + std::to_wstring(random()) + L"&feature=share");
+
+    std::size_t total = 0;
+    double ms = Measure([&] {
+        for (const auto &x : urls) {
+            const wchar_t *id;
+            std::size_t length;
+            ParseTools::ClassifyUrl(x.c_str(), &id, &length);
+            total += length;
+        }
+    });
+    std::printf("ClassifyUrl: %u urls in %.2f ms, %.1f ns per url\n", unsigned(urls.size()), ms, ms * 1e6 / urls.size());
+}
+
+void BenchParseDuration() {
+    std::mt19937 random(6);
+    std::vector<std::string> durations;
+    for (int i = 0; i < 100000; ++i)
+        durations.push_back("PT" + std::to_string(random() % 3) + "H" + std::to_string(random() % 60) + "M" + std::to_string(random() % 60) + "S");
+
+    double total = 0;
+    double parser = Measure([&] {
+        for (const auto &x : durations) {
+            double seconds;
+            if (ParseTools::ParseDuration(x.data(), x.size(), &seconds))
+                total += seconds;
+        }
+    });
+
+    // What the loaders did before: a regex constructed for every item, too slow for all of them
+    const std::size_t sample = durations.size() / 100;
+    double regex = Measure([&] {
+        for (std::size_t i = 0; i < sample; ++i) {
+            const std::string &x = durations[i];
+            std::regex re("PT(?:(\\d+)H)?(?:(\\d+)M)?(?:(\\d+)S)?");
+            std::smatch match;
+            if (std::regex_match(x, match, re))
+                total += atoi(match[1].str().c_str()) * 3600 + atoi(match[2].str().c_str()) * 60 + atoi(match[3].str().c_str());
+        }
+    }, 1);
+    std::printf("ParseDuration: %.1f ns per duration, std::regex per item %.1f ns\n", parser * 1e6 / durations.size(), regex * 1e6 / sample);
+}
+
+std::wstring Convert(const rapidjson::Value &value) {
+    return ParseTools::Utf8ToWString(value.GetString(), value.GetStringLength());
+}
+
+// A playlistItems page of 50 items, like the loaders request
+std::string PlaylistItemsPage() {
+    std::string page = "{\"kind\":\"youtube#playlistItemListResponse\",\"nextPageToken\":\"CDIQAA\",\"items\":[";
+    for (int i = 0; i < 50; ++i) {
+        std::string id = std::to_string(1000000000 + i);
+        page += std::string(i ? "," : "") + "{\"kind\":\"youtube#playlistItem\",\"id\":\"UExy" + id + "\",\"snippet\":{"
+            "\"publishedAt\":\"2015-03-04T12:00:00.000Z\",\"channelId\":\"UCuAXFkgsw1L7xaCfnd5JJOw\",\"title\":\"Title " + id + "\","
+            "\"description\":\"" + std::string(400, 'd') + "\",\"thumbnails\":{"
+            "\"default\":{\"url\":\"https://i.ytimg.com/vi/" + id + "/default.jpg\",\"width\":120,\"height\":90},"
+            "\"high\":{\"url\":\"https://i.ytimg.com/vi/" + id + "/hqdefault.jpg\",\"width\":480,\"height\":360}},"
+            "\"channelTitle\":\"Channel\",\"position\":" + std::to_string(i) + ",\"resourceId\":{\"kind\":\"youtube#video\",\"videoId\":\"v" + id + "\"}},"
+            "\"contentDetails\":{\"videoId\":\"v" + id + "\",\"duration\":\"PT4M13S\"}}";
+    }
+    return page + "]}";
+}
+
+void BenchPageReader() {
+    const std::string page = PlaylistItemsPage();
+    const int repeat = 2000;
+    std::vector<char> buffer(page.size() + 1);
+    std::size_t items = 0;
+
+    double reader = Measure([&] {
+        for (int i = 0; i < repeat; ++i) {
+            memcpy(buffer.data(), page.c_str(), buffer.size());
+            PageReader::Page result;
+            PageReader::Read(buffer.data(), &result);
+            items += result.Items.size();
+        }
+    });
+    // The tokenizer alone, what's left of PageReader is its handler and the string conversions
+    double tokenizer = Measure([&] {
+        for (int i = 0; i < repeat; ++i) {
+            memcpy(buffer.data(), page.c_str(), buffer.size());
+            rapidjson::BaseReaderHandler<> handler;
+            rapidjson::InsituStringStream stream(buffer.data());
+            rapidjson::Reader reader;
+            reader.Parse<rapidjson::kParseInsituFlag>(stream, handler);
+        }
+    });
+    // A document of the whole page, then the same fields taken from it
+    double document = Measure([&] {
+        for (int i = 0; i < repeat; ++i) {
+            memcpy(buffer.data(), page.c_str(), buffer.size());
+            rapidjson::Document d;
+            d.ParseInsitu(buffer.data());
+            std::vector<PageReader::Item> result;
+            const rapidjson::Value &list = d["items"];
+            for (auto x = list.Begin(); x != list.End(); ++x) {
+                const rapidjson::Value &snippet = (*x)["snippet"];
+                PageReader::Item item;
+                item.Id = Convert((*x)["id"]);
+                item.Title = Convert(snippet["title"]);
+                item.ChannelTitle = Convert(snippet["channelTitle"]);
+                item.PublishedAt = Convert(snippet["publishedAt"]);
+                item.Artwork = Convert(snippet["thumbnails"]["high"]["url"]);
+                item.VideoId = Convert(snippet["resourceId"]["videoId"]);
+                const rapidjson::Value &duration = (*x)["contentDetails"]["duration"];
+                ParseTools::ParseDuration(duration.GetString(), duration.GetStringLength(), &item.Duration);
+                result.push_back(item);
+            }
+            items += result.size();
+        }
+    });
+    std::printf("playlistItems page of %u bytes: PageReader %.1f us (tokenizer alone %.1f us), Document %.1f us\n",
+                unsigned(page.size()), reader * 1000 / repeat, tokenizer * 1000 / repeat, document * 1000 / repeat);
+}
+
+// The same page as a DOM, with a fresh allocator each time and with JsonResponse's pooled arena
+void BenchJsonResponse() {
+    const std::string page = PlaylistItemsPage();
+    const int repeat = 2000;
+    std::vector<char> buffer(page.size() + 1);
+    std::size_t members = 0;
+
+    auto document = [&] {
+        memcpy(buffer.data(), page.c_str(), buffer.size());
+        rapidjson::Document d;
+        d.ParseInsitu(buffer.data());
+        members += d["items"].Size();
+    };
+    auto response = [&] {
+        memcpy(buffer.data(), page.c_str(), buffer.size());
+        JsonResponse r(reinterpret_cast<unsigned char *>(buffer.data()), int(page.size()));
+        members += (*r)["items"].Size();
+    };
+
+    double fresh = Measure([&] {
+        for (int i = 0; i < repeat; ++i)
+            document();
+    });
+    double pooled = Measure([&] {
+        for (int i = 0; i < repeat; ++i)
+            response();
+    });
+    // Both are warm by now, so this is the steady state of a page
+    std::size_t freshCount, freshBytes, pooledCount, pooledBytes;
+    CountAllocations(document, freshCount, freshBytes);
+    CountAllocations(response, pooledCount, pooledBytes);
+    std::printf("playlistItems page as a DOM: Document %.1f us, JsonResponse %.1f us\n", fresh * 1000 / repeat, pooled * 1000 / repeat);
+    std::printf("  allocations per page: Document %u (%u bytes), JsonResponse %u (%u bytes)\n",
+        unsigned(freshCount), unsigned(freshBytes), unsigned(pooledCount), unsigned(pooledBytes));
+}
+
+}
+
+int main() {
+    BenchHttpResponseParser();
+    BenchVideoIdSet();
+    BenchClassifyUrl();
+    BenchParseDuration();
+    BenchPageReader();
+    BenchJsonResponse();
+    return 0;
+}
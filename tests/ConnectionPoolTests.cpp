@@ -0,0 +1,289 @@
+#include "Test.h"
+#include "ConnectionPool.h"
+#include "LoopbackNet.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// HTTP server on 127.0.0.1 that answers each request with its path
+class Server {
+public:
+    enum Mode {
+        KeepAlive,
+        // Connection: close
+        Close,
+        // Announces keep-alive but closes the connection after the response, like a server's idle timeout
+        DropIdle,
+        // Reads requests and never answers
+        Silent
+    };
+
+    explicit Server(Mode mode) : m_mode(mode) {
+        m_listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        bind(m_listener, reinterpret_cast<struct sockaddr *>(&address), length);
+        listen(m_listener, 16);
+        getsockname(m_listener, reinterpret_cast<struct sockaddr *>(&address), &length);
+        m_port = ntohs(address.sin_port);
+        m_acceptor = std::thread([this] { Accept(); });
+    }
+
+    ~Server() {
+        shutdown(m_listener, SHUT_RDWR);
+        m_acceptor.join();
+        close(m_listener);
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (int x : m_open)
+            shutdown(x, SHUT_RDWR);
+        std::vector<std::thread> connections;
+        connections.swap(m_connections);
+        lock.unlock();
+        for (auto &x : connections)
+            x.join();
+    }
+
+    unsigned short Port() const { return m_port; }
+
+    std::atomic<int> Accepted{ 0 };
+    std::atomic<int> Requests{ 0 };
+    std::atomic<int> Closed{ 0 };
+
+private:
+    void Accept() {
+        for (;;) {
+            int s = accept(m_listener, nullptr, nullptr);
+            if (s < 0)
+                return;
+
+            Accepted++;
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_open.push_back(s);
+            m_connections.push_back(std::thread([this, s] { Serve(s); }));
+        }
+    }
+
+    void Serve(int s) {
+        std::string received;
+        for (bool open = true; open;) {
+            std::size_t end;
+            while (open && (end = received.find("\r\n\r\n")) == std::string::npos) {
+                char buffer[4096];
+                ssize_t n = recv(s, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                    open = false;
+                else
+                    received.append(buffer, n);
+            }
+            if (!open)
+                break;
+
+            // "GET /path HTTP/1.1"
+            std::size_t path = received.find(' ') + 1;
+            std::string body = received.substr(path, received.find(' ', path) - path);
+            received.erase(0, end + 4);
+            Requests++;
+            if (m_mode == Silent)
+                continue;
+
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" +
+                                   (m_mode == Close ? "Connection: close\r\n" : "") + "\r\n" + body;
+            send(s, response.data(), response.size(), MSG_NOSIGNAL);
+            open = m_mode == KeepAlive;
+        }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (auto it = m_open.begin(); it != m_open.end(); ++it) {
+            if (*it == s) {
+                m_open.erase(it);
+                break;
+            }
+        }
+        close(s);
+        Closed++;
+    }
+
+    Mode m_mode;
+    int m_listener;
+    unsigned short m_port;
+    std::thread m_acceptor;
+    std::mutex m_mutex;
+    std::vector<int> m_open;
+    std::vector<std::thread> m_connections;
+};
+
+bool WaitFor(std::function<bool()> condition) {
+    for (int i = 0; i < 500; ++i) {
+        if (condition())
+            return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+struct Response {
+    std::mutex Mutex;
+    std::condition_variable Done;
+    bool Received{ false };
+    bool Failed{ false };
+    std::string Body;
+};
+
+// Body of the response, empty if there is none within timeout. failed is set when the request called back with nullptr.
+std::string Fetch(unsigned short port, const std::string &path, const std::string &host = "localhost", int timeout = 5000, bool *failed = nullptr) {
+    auto response = std::make_shared<Response>();
+    std::string request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nContent-Length: 0\r\n\r\n";
+    bool submitted = ConnectionPool::Submit(host, port, request, [response](unsigned char *data, int size) {
+        std::unique_lock<std::mutex> lock(response->Mutex);
+        if (data)
+            response->Body.assign(reinterpret_cast<char *>(data), size);
+        response->Failed = !data;
+        response->Received = true;
+        response->Done.notify_all();
+    });
+    if (!submitted)
+        return std::string();
+
+    std::unique_lock<std::mutex> lock(response->Mutex);
+    response->Done.wait_for(lock, std::chrono::milliseconds(timeout), [&response] { return response->Received; });
+    if (failed)
+        *failed = response->Failed;
+    return response->Body;
+}
+
+// One worker, so jobs run in the order they are submitted
+void Start() {
+    ConnectionPool::Init(1);
+    LoopbackNet::Resolves = 0;
+    LoopbackNet::Connects = 0;
+}
+
+}
+
+TEST(ConnectionPoolReusesConnections) {
+    Start();
+    Server server(Server::KeepAlive);
+    CHECK(Fetch(server.Port(), "/1") == "/1");
+    CHECK(Fetch(server.Port(), "/2") == "/2");
+    CHECK(Fetch(server.Port(), "/3") == "/3");
+    CHECK(server.Accepted == 1 && server.Requests == 3);
+    CHECK(LoopbackNet::Resolves == 1 && LoopbackNet::Connects == 1);
+
+    // Other ports are other pools
+    Server other(Server::KeepAlive);
+    CHECK(Fetch(other.Port(), "/4") == "/4");
+    CHECK(Fetch(server.Port(), "/5") == "/5");
+    CHECK(server.Accepted == 1 && other.Accepted == 1);
+    ConnectionPool::Deinit();
+}
+
+TEST(ConnectionPoolRetriesStaleConnection) {
+    Start();
+    Server server(Server::DropIdle);
+    CHECK(Fetch(server.Port(), "/1") == "/1");
+    CHECK(WaitFor([&server] { return server.Closed == 1; }));
+
+    // The pooled connection is dead by now, the request goes out once more on a new one
+    CHECK(Fetch(server.Port(), "/2") == "/2");
+    CHECK(server.Accepted == 2 && server.Requests == 2);
+    ConnectionPool::Deinit();
+}
+
+TEST(ConnectionPoolClosesIdleConnections) {
+    Start();
+    Server server(Server::KeepAlive);
+    CHECK(Fetch(server.Port(), "/1") == "/1");
+    LoopbackNet::Now += 29 * 1000;
+    CHECK(Fetch(server.Port(), "/2") == "/2");
+    CHECK(server.Accepted == 1);
+
+    // Idle for longer than IdleTimeout, the connection isn't used anymore
+    LoopbackNet::Now += 30 * 1000;
+    CHECK(Fetch(server.Port(), "/3") == "/3");
+    CHECK(server.Accepted == 2);
+    CHECK(WaitFor([&server] { return server.Closed == 1; }));
+
+    // Connection: close isn't pooled at all
+    Server closing(Server::Close);
+    CHECK(Fetch(closing.Port(), "/4") == "/4");
+    CHECK(Fetch(closing.Port(), "/5") == "/5");
+    CHECK(closing.Accepted == 2);
+    ConnectionPool::Deinit();
+}
+
+TEST(ConnectionPoolCachesAddresses) {
+    Start();
+    Server server(Server::Close);
+    CHECK(Fetch(server.Port(), "/1") == "/1");
+    CHECK(Fetch(server.Port(), "/2") == "/2");
+    CHECK(LoopbackNet::Resolves == 1 && LoopbackNet::Connects == 2);
+
+    // Expired after DnsTtl
+    LoopbackNet::Now += 5 * 60 * 1000;
+    CHECK(Fetch(server.Port(), "/3") == "/3");
+    CHECK(LoopbackNet::Resolves == 2);
+
+    // Failures aren't cached, and call back with nullptr
+    bool failed = false;
+    CHECK(Fetch(server.Port(), "/4", "unresolvable", 5000, &failed).empty() && failed);
+    failed = false;
+    CHECK(Fetch(server.Port(), "/5", "unresolvable", 5000, &failed).empty() && failed);
+    CHECK(LoopbackNet::Resolves == 4);
+    ConnectionPool::Deinit();
+}
+
+TEST(ConnectionPoolForgetsAddressOnConnectFailure) {
+    Start();
+    unsigned short port;
+    {
+        Server server(Server::Close);
+        port = server.Port();
+        CHECK(Fetch(port, "/1") == "/1");
+    }
+    CHECK(LoopbackNet::Resolves == 1);
+
+    // Nothing listens anymore, the address may be stale and is resolved again next time
+    bool failed = false;
+    CHECK(Fetch(port, "/2", "localhost", 5000, &failed).empty() && failed);
+    CHECK(LoopbackNet::Resolves == 1);
+    CHECK(Fetch(port, "/3", "localhost", 200).empty());
+    CHECK(WaitFor([] { return LoopbackNet::Resolves == 2; }));
+    ConnectionPool::Deinit();
+}
+
+TEST(ConnectionPoolDeinitUnblocksWorkers) {
+    Start();
+    Server server(Server::Silent);
+    auto called = std::make_shared<std::atomic<bool>>(false);
+    std::string request = "GET /1 HTTP/1.1\r\nHost: localhost\r\nContent-Length: 0\r\n\r\n";
+    CHECK(ConnectionPool::Submit("localhost", server.Port(), request, [called](unsigned char *, int) { *called = true; }));
+    CHECK(WaitFor([&server] { return server.Requests == 1; }));
+
+    // The worker waits for a response that never comes, Deinit shuts its socket down and it doesn't call back
+    auto start = std::chrono::steady_clock::now();
+    ConnectionPool::Deinit();
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    CHECK(!*called);
+
+    // And the pool starts again on the next Submit
+    Server next(Server::KeepAlive);
+    CHECK(Fetch(next.Port(), "/2") == "/2");
+    ConnectionPool::Deinit();
+}
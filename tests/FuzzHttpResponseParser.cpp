@@ -0,0 +1,79 @@
+#include "HttpResponseParser.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+// The same bytes fed whole, byte by byte and through Direct()/Advance() have to end the same way,
+// whatever they are
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, std::size_t size) {
+    const char *bytes = reinterpret_cast<const char *>(data);
+
+    std::string wholeBody;
+    HttpResponseParser whole([&wholeBody](const char *p, std::size_t n) { wholeBody.append(p, n); });
+    bool wholeFed = whole.Feed(bytes, size);
+
+    std::string splitBody;
+    HttpResponseParser split([&splitBody](const char *p, std::size_t n) { splitBody.append(p, n); });
+    bool splitFed = true;
+    for (std::size_t i = 0; i < size && splitFed; ++i)
+        splitFed = split.Feed(bytes + i, 1);
+
+    std::string directBody;
+    HttpResponseParser direct([&directBody](const char *p, std::size_t n) { directBody.append(p, n); });
+    bool directFed = true;
+    for (std::size_t pos = 0; pos < size && directFed;) {
+        if (std::size_t n = (std::min)(direct.Direct(), size - pos)) {
+            directBody.append(bytes + pos, n);
+            direct.Advance(n);
+            pos += n;
+        } else {
+            directFed = direct.Feed(bytes + pos, 1);
+            pos++;
+        }
+    }
+
+    if (wholeFed != splitFed || wholeFed != directFed || whole.Done() != split.Done() || whole.Done() != direct.Done() ||
+        (wholeFed && (wholeBody != splitBody || wholeBody != directBody || whole.Status() != split.Status())))
+        abort();
+
+    whole.Finish();
+    split.Finish();
+    if (whole.Done() != split.Done() || whole.KeepAlive())
+        abort();
+    return 0;
+}
+
+#ifndef FUZZ_ENGINE
+// Random mutations of valid responses, argv[1] of them
+int main(int argc, char **argv) {
+    static const char *seeds[] = {
+        "HTTP/1.1 200 OK\r\nContent-Length: 5\r\n\r\nhello",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n5;x=y\r\nhello\r\n0\r\nT: 1\r\n\r\n",
+        "HTTP/1.0 206 Partial Content\r\nConnection: keep-alive\r\nContent-Range: bytes 0-3/9\r\nContent-Length: 4\r\n\r\nabcd",
+        "HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 304 Not Modified\r\n\r\n",
+        "HTTP/1.1 200 OK\nX-Folded: a\n b\n\nuntil close",
+    };
+    static const char alphabet[] = "HTTP/1.0 \r\n:;,0123456789abcdefChunkedContent-Length";
+
+    long iterations = argc > 1 ? atol(argv[1]) : 100000;
+    std::mt19937 random(12345);
+    for (long i = 0; i < iterations; ++i) {
+        std::string input = seeds[random() % (sizeof(seeds) / sizeof(seeds[0]))];
+        for (int edits = random() % 8; edits > 0; --edits) {
+            std::size_t pos = input.empty() ? 0 : random() % input.size();
+            switch (random() % 4) {
+                case 0: if (!input.empty()) input.erase(pos, 1 + random() % 4); break;
+                case 1: input.insert(pos, 1, alphabet[random() % (sizeof(alphabet) - 1)]); break;
+                case 2: if (!input.empty()) input[pos] = char(random()); break;
+                case 3: input.insert(pos, input.substr(pos, random() % 16)); break;
+            }
+        }
+        LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()), input.size());
+    }
+    std::printf("%ld inputs\n", iterations);
+    return 0;
+}
+#endif
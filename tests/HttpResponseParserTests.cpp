@@ -0,0 +1,144 @@
+#include "Test.h"
+#include "HttpResponseParser.h"
+#include <string>
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+struct Result {
+    bool Fed;
+    bool Done;
+    bool KeepAlive;
+    int Status;
+    std::string Body;
+};
+
+// Feeds the response in pieces of step bytes, finishing it like a closed connection if close is set
+Result Parse(const std::string &response, std::size_t step, bool close = false) {
+    Result result = Result();
+    HttpResponseParser parser([&result](const char *data, std::size_t size) { result.Body.append(data, size); });
+    result.Fed = true;
+    for (std::size_t pos = 0; pos < response.size() && result.Fed; pos += step)
+        result.Fed = parser.Feed(response.data() + pos, (std::min)(step, response.size() - pos));
+    if (close)
+        parser.Finish();
+
+    result.Done = parser.Done();
+    result.KeepAlive = parser.KeepAlive();
+    result.Status = parser.Status();
+    return result;
+}
+
+}
+
+TEST(ContentLengthInAnyPieces) {
+    std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: 11\r\n\r\nhello world";
+    for (std::size_t step = 1; step <= response.size(); ++step) {
+        Result r = Parse(response, step);
+        CHECK(r.Fed && r.Done);
+        CHECK(r.Status == 200);
+        CHECK(r.Body == "hello world");
+        CHECK(r.KeepAlive);
+    }
+}
+
+TEST(ChunkedWithExtensionsAndTrailer) {
+    std::string response = "HTTP/1.1 200 OK\r\nTransfer-Encoding: gzip, chunked\r\n\r\n"
+                           "5;name=value\r\nhello\r\n6\r\n world\r\n0\r\nX-Trailer: 1\r\n\r\n";
+    for (std::size_t step = 1; step <= response.size(); ++step) {
+        Result r = Parse(response, step);
+        CHECK(r.Fed && r.Done);
+        CHECK(r.Body == "hello world");
+    }
+}
+
+TEST(HeaderNamesIgnoreCase) {
+    HttpResponseParser parser;
+    std::string response = "HTTP/1.1 206 Partial Content\r\ncontent-length: 2\r\nCONTENT-RANGE: bytes 0-1/10\r\nConnection: Keep-Alive, CLOSE\r\n\r\nab";
+    CHECK(parser.Feed(response.data(), response.size()));
+    CHECK(parser.Done());
+    CHECK(parser.Status() == 206);
+    CHECK(parser.Header("Content-Range") == "bytes 0-1/10");
+    CHECK(parser.Header("content-range") == "bytes 0-1/10");
+    CHECK(parser.Header("Content-Rang").empty());
+    CHECK(!parser.KeepAlive());
+
+    Result r = Parse("HTTP/1.1 200 OK\r\nTRANSFER-ENCODING: Chunked\r\n\r\n1\r\nx\r\n0\r\n\r\n", 3);
+    CHECK(r.Done && r.Body == "x");
+}
+
+TEST(Http10KeepsAliveOnlyWhenAsked) {
+    CHECK(!Parse("HTTP/1.0 200 OK\r\nContent-Length: 0\r\n\r\n", 64).KeepAlive);
+    CHECK(Parse("HTTP/1.0 200 OK\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n", 64).KeepAlive);
+}
+
+TEST(InterimAndBodylessResponses) {
+    Result r = Parse("HTTP/1.1 100 Continue\r\n\r\nHTTP/1.1 204 No Content\r\n\r\n", 5);
+    CHECK(r.Done && r.Status == 204 && r.Body.empty());
+
+    r = Parse("HTTP/1.1 304 Not Modified\r\nContent-Length: 100\r\n\r\n", 7);
+    CHECK(r.Done && r.Body.empty());
+}
+
+TEST(BodyUntilClose) {
+    std::string response = "HTTP/1.1 200 OK\n\nbare newlines, read until closed";
+    Result r = Parse(response, 4);
+    CHECK(r.Fed && !r.Done);
+
+    r = Parse(response, 4, true);
+    CHECK(r.Done && !r.KeepAlive);
+    CHECK(r.Body == "bare newlines, read until closed");
+
+    // Closed before Content-Length bytes arrived
+    r = Parse("HTTP/1.1 200 OK\r\nContent-Length: 10\r\n\r\nshort", 4, true);
+    CHECK(!r.Done);
+}
+
+TEST(DirectReceivesIntoCallerBuffer) {
+    HttpResponseParser parser([](const char *, std::size_t) { CHECK(false); });
+    std::string headers = "HTTP/1.1 200 OK\r\nContent-Length: 8\r\n\r\n";
+    CHECK(parser.Feed(headers.data(), headers.size()));
+    CHECK(parser.HeadersDone());
+    CHECK(parser.Direct() == 8);
+
+    char buffer[8];
+    memcpy(buffer, "abcd", 4);
+    parser.Advance(4);
+    CHECK(parser.Direct() == 4);
+    memcpy(buffer + 4, "efgh", 4);
+    parser.Advance(4);
+    CHECK(parser.Direct() == 0);
+    CHECK(parser.Done());
+}
+
+TEST(MalformedResponsesFail) {
+    const char *responses[] = {
+        "HTTP/2 200 OK\r\n\r\n",
+        "HTTP/1.1 20 OK\r\n\r\n",
+        "HTTP/1.1 200OK\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nNo colon\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nBad name: x\r\n\r\n",
+        "HTTP/1.1 200 OK\r\n continued\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\nab",
+        "HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\nzz\r\n",
+        "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n1\r\nab\r\n",
+    };
+    for (auto x : responses) {
+        Result r = Parse(x, 1);
+        CHECK(!r.Fed && !r.Done);
+    }
+
+    // Lines are bounded
+    HttpResponseParser parser;
+    std::string line = "HTTP/1.1 200 OK\r\nX: " + std::string(16 * 1024, 'x');
+    CHECK(!parser.Feed(line.data(), line.size()));
+    CHECK(parser.Failed());
+}
+
+TEST(TrailingBytesEndKeepAlive) {
+    Result r = Parse("HTTP/1.1 200 OK\r\nContent-Length: 1\r\n\r\nxy", 64);
+    CHECK(r.Done && r.Body == "x");
+    CHECK(!r.KeepAlive);
+}
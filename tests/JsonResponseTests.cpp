@@ -0,0 +1,49 @@
+#include "Test.h"
+#include "JsonResponse.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+const char *PlaylistItemsPage = R"({
+ "nextPageToken": "CAUQAA",
+ "items": [
+  { "id": "UExy1", "snippet": { "title": "Café \"live\"", "resourceId": { "videoId": "dQw4w9WgXcQ" } } },
+  { "id": "UExy2", "snippet": { "title": "Deleted video", "resourceId": { "videoId": "9bZkp7q19f0" } } }
+ ]
+})";
+
+std::vector<char> Buffer(const char *json) {
+    return std::vector<char>(json, json + strlen(json) + 1);
+}
+
+}
+
+TEST(JsonResponseParsesInPlace) {
+    std::vector<char> buffer = Buffer(PlaylistItemsPage);
+    {
+        JsonResponse response(reinterpret_cast<unsigned char *>(buffer.data()), int(buffer.size() - 1));
+        rapidjson::Document &document = *response;
+        CHECK(!document.HasParseError() && document.IsObject());
+        CHECK(document["items"].Size() == 2);
+        const rapidjson::Value &title = document["items"][0]["snippet"]["title"];
+        CHECK(std::string(title.GetString(), title.GetStringLength()) == "Caf\xc3\xa9 \"live\"");
+        // Strings aren't copied, they point into the buffer
+        const char *token = document["nextPageToken"].GetString();
+        CHECK(token >= buffer.data() && token < buffer.data() + buffer.size());
+    }
+
+    // The pooled arenas are reused, a response parsed after another one sees only its own document
+    for (int i = 0; i < 10; ++i) {
+        std::vector<char> next = Buffer(i % 2 ? PlaylistItemsPage : R"({"items":[]})");
+        JsonResponse response(reinterpret_cast<unsigned char *>(next.data()), int(next.size() - 1));
+        CHECK(response->IsObject() && (*response)["items"].Size() == (i % 2 ? 2u : 0u));
+    }
+
+    std::vector<char> invalid = Buffer("{\"items\": [");
+    JsonResponse broken(reinterpret_cast<unsigned char *>(invalid.data()), int(invalid.size() - 1));
+    CHECK(broken->HasParseError());
+    JsonResponse empty(nullptr, 0);
+    CHECK(empty->IsNull());
+}
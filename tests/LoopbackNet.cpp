@@ -0,0 +1,76 @@
+#include "Net.h"
+#include "LoopbackNet.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cstring>
+
+std::atomic<uint32_t> LoopbackNet::Now(1000);
+std::atomic<int> LoopbackNet::Resolves(0);
+std::atomic<int> LoopbackNet::Connects(0);
+
+bool Net::Startup() {
+    return true;
+}
+
+void Net::Cleanup() {
+}
+
+bool Net::Resolve(const std::string &host, uint32_t *ip) {
+    LoopbackNet::Resolves++;
+    if (host == "unresolvable")
+        return false;
+    *ip = htonl(INADDR_LOOPBACK);
+    return true;
+}
+
+Net::Socket Net::Connect(uint32_t ip, unsigned short port, int timeout) {
+    int s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s < 0)
+        return Invalid;
+
+    struct timeval tv = { timeout / 1000, (timeout % 1000) * 1000 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    int noDelay = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = ip;
+    address.sin_port = htons(port);
+    if (connect(s, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0) {
+        close(s);
+        return Invalid;
+    }
+    LoopbackNet::Connects++;
+    return Socket(s);
+}
+
+int Net::Send(Socket s, const char *data, int size) {
+    // A pooled connection the server has closed must fail, not raise SIGPIPE
+    return int(send(int(s), data, size, MSG_NOSIGNAL));
+}
+
+int Net::Receive(Socket s, char *data, int size) {
+    return int(recv(int(s), data, size, 0));
+}
+
+void Net::Shutdown(Socket s) {
+    shutdown(int(s), SHUT_RDWR);
+}
+
+void Net::Close(Socket s) {
+    close(int(s));
+}
+
+uint32_t Net::Ticks() {
+    return LoopbackNet::Now;
+}
+
+void Net::Trace(const std::string &) {
+}
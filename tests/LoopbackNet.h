@@ -0,0 +1,12 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Controls of the Net implementation tests/ links instead of Net.cpp: every host but "unresolvable"
+// resolves to 127.0.0.1, and the clock only moves when a test moves it
+struct LoopbackNet {
+    static std::atomic<uint32_t> Now;
+    static std::atomic<int> Resolves;
+    static std::atomic<int> Connects;
+};
@@ -0,0 +1,19 @@
+#include "Test.h"
+#include <cstring>
+
+int main(int argc, char **argv) {
+    // An argument only runs the tests whose name contains it
+    int ran = 0;
+    for (auto test : Test::All()) {
+        if (argc > 1 && !strstr(test->Name, argv[1]))
+            continue;
+
+        int failures = Test::Failures();
+        test->Run();
+        std::printf("%-40s %s\n", test->Name, Test::Failures() == failures ? "ok" : "FAILED");
+        ++ran;
+    }
+
+    std::printf("%d tests, %d failed checks\n", ran, Test::Failures());
+    return Test::Failures() == 0 && ran > 0 ? 0 : 1;
+}
@@ -0,0 +1,135 @@
+#include "Test.h"
+#include "PageReader.h"
+#include "ParseTools.h"
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Trimmed playlistItems?part=snippet,contentDetails page as the API sends it
+const char *PlaylistItemsPage = R"({
+ "kind": "youtube#playlistItemListResponse",
+ "etag": "\"XI7nbFXulYBIpL0ayR_gDh3eu1k/0\"",
+ "nextPageToken": "CAUQAA",
+ "pageInfo": { "totalResults": 42, "resultsPerPage": 2 },
+ "items": [
+  {
+   "kind": "youtube#playlistItem",
+   "id": "UExyQVhGa2dzdzFMN3hhQ2ZuZDVKSk93LjU2QjQ0RjZEMTA1NTdDQzY=",
+   "snippet": {
+    "publishedAt": "2015-03-04T12:00:00.000Z",
+    "channelId": "UCuAXFkgsw1L7xaCfnd5JJOw",
+    "title": "Café \"live\" 🎵",
+    "description": "{ \"title\": \"not this one\" }",
+    "thumbnails": {
+     "default": { "url": "https://i.ytimg.com/vi/dQw4w9WgXcQ/default.jpg", "width": 120, "height": 90 },
+     "high": { "url": "https://i.ytimg.com/vi/dQw4w9WgXcQ/hqdefault.jpg", "width": 480, "height": 360 }
+    },
+    "channelTitle": "Some Channel",
+    "playlistId": "PLrAXtmErZgOeiKm4sgNOknGvNjby9efdf",
+    "position": 0,
+    "resourceId": { "kind": "youtube#video", "videoId": "dQw4w9WgXcQ" }
+   },
+   "contentDetails": { "videoId": "dQw4w9WgXcQ", "duration": "PT4M13S" }
+  },
+  {
+   "kind": "youtube#playlistItem",
+   "id": "UExyQVhGa2dzdzFMN3hhQ2ZuZDVKSk93LjI4OUY0QTQ2REYwQTMwRDI=",
+   "snippet": {
+    "title": "Deleted video",
+    "resourceId": { "kind": "youtube#video", "videoId": "9bZkp7q19f0" }
+   }
+  }
+ ]
+})";
+
+std::wstring Title() {
+    return ParseTools::Utf8ToWString("Caf\xc3\xa9 \"live\" \xf0\x9f\x8e\xb5", 17);
+}
+
+std::vector<char> Buffer(const char *json) {
+    return std::vector<char>(json, json + strlen(json) + 1);
+}
+
+}
+
+TEST(PageReaderPlaylistItems) {
+    std::vector<char> buffer = Buffer(PlaylistItemsPage);
+    PageReader::Page page;
+    CHECK(PageReader::Read(buffer.data(), &page));
+    CHECK(page.Valid && !page.IsChannel);
+    CHECK(page.NextPageToken == L"CAUQAA");
+    CHECK(page.Items.size() == 2);
+    if (page.Items.size() != 2)
+        return;
+
+    const PageReader::Item &first = page.Items[0];
+    CHECK(first.Id == L"UExyQVhGa2dzdzFMN3hhQ2ZuZDVKSk93LjU2QjQ0RjZEMTA1NTdDQzY=");
+    CHECK(first.VideoId == L"dQw4w9WgXcQ");
+    CHECK(first.HasTitle && first.Title == Title());
+    CHECK(first.HasChannelTitle && first.ChannelTitle == L"Some Channel");
+    CHECK(first.Artwork == L"https://i.ytimg.com/vi/dQw4w9WgXcQ/hqdefault.jpg");
+    CHECK(first.PublishedAt == L"2015-03-04T12:00:00.000Z");
+    CHECK(first.Duration == 253);
+
+    const PageReader::Item &second = page.Items[1];
+    CHECK(second.VideoId == L"9bZkp7q19f0" && second.Title == L"Deleted video");
+    CHECK(!second.HasChannelTitle && second.Artwork.empty() && second.Duration == -1);
+}
+
+TEST(PageReaderVideosAndChannels) {
+    // Without a resourceId the item id is the video id
+    std::vector<char> videos = Buffer(R"({"items":[{"id":"dQw4w9WgXcQ","snippet":{"title":"a"},"contentDetails":{"duration":"P0D"}}]})");
+    PageReader::Page page;
+    CHECK(PageReader::Read(videos.data(), &page));
+    CHECK(page.Items.size() == 1 && page.Items[0].VideoId == L"dQw4w9WgXcQ" && page.Items[0].Duration == 0);
+    CHECK(page.NextPageToken.empty());
+
+    std::vector<char> channels = Buffer(R"({"items":[{"id":"UC1","snippet":{"title":"t","localized":{"title":"Name"}},
+        "contentDetails":{"relatedPlaylists":{"likes":"LL","uploads":"UU1"}}},
+        {"id":"UC2","snippet":{"localized":{"title":"Other"}},"contentDetails":{"relatedPlaylists":{"uploads":"UU2"}}}]})");
+    PageReader::Page channel;
+    CHECK(PageReader::Read(channels.data(), &channel));
+    CHECK(channel.IsChannel && channel.Uploads == L"UU1" && channel.ChannelName == L"Name");
+}
+
+TEST(PageReaderInvalid) {
+    std::vector<char> error = Buffer(R"({"error":{"code":403,"message":"quotaExceeded"},"items":[{"id":"x"}]})");
+    PageReader::Page page;
+    CHECK(!PageReader::Read(error.data(), &page) && !page.Valid);
+
+    // A truncated page leaves nothing behind, not even the items before the cut
+    std::string truncated(PlaylistItemsPage, strlen(PlaylistItemsPage) - 40);
+    std::vector<char> buffer = Buffer(truncated.c_str());
+    PageReader::Page cut;
+    CHECK(!PageReader::Read(buffer.data(), &cut));
+    CHECK(!cut.Valid && cut.Items.empty() && cut.NextPageToken.empty());
+
+    std::vector<char> array = Buffer("[1, 2]");
+    PageReader::Page notObject;
+    CHECK(!PageReader::Read(array.data(), &notObject));
+
+    // Nesting deeper than the reader tracks is skipped, not misattributed
+    std::vector<char> deep = Buffer(R"({"items":[{"id":"a","x":{"y":{"z":{"w":{"v":{"u":{"id":"b","title":"c"}}}}}}}]})");
+    PageReader::Page nested;
+    CHECK(PageReader::Read(deep.data(), &nested));
+    CHECK(nested.Items.size() == 1 && nested.Items[0].Id == L"a" && !nested.Items[0].HasTitle);
+}
+
+TEST(Utf8ToWString) {
+    CHECK(ParseTools::Utf8ToWString("abc", 3) == L"abc");
+    CHECK(ParseTools::Utf8ToWString("a\0b", 3) == std::wstring(L"a\0b", 3));
+    CHECK(ParseTools::Utf8ToWString("\xc3\xa9\xe2\x82\xac", 5) == L"\xE9\x20AC");
+    std::wstring note = ParseTools::Utf8ToWString("\xf0\x9f\x8e\xb5", 4);
+    CHECK(sizeof(wchar_t) == 2 ? note.size() == 2 && note[0] == 0xD83C && note[1] == 0xDFB5 : note.size() == 1 && note[0] == 0x1F3B5);
+
+    // Stray continuation, overlong, surrogate, out of range and truncated sequences
+    CHECK(ParseTools::Utf8ToWString("\x80x", 2) == L"\xFFFDx");
+    CHECK(ParseTools::Utf8ToWString("\xc0\xafx", 3) == L"\xFFFD\xFFFDx");
+    CHECK(ParseTools::Utf8ToWString("\xe0\x80\xaf", 3) == L"\xFFFD");
+    CHECK(ParseTools::Utf8ToWString("\xed\xa0\x80", 3) == L"\xFFFD");
+    CHECK(ParseTools::Utf8ToWString("\xf4\x90\x80\x80", 4) == L"\xFFFD");
+    CHECK(ParseTools::Utf8ToWString("\xe2\x82", 2) == L"\xFFFD");
+    CHECK(ParseTools::Utf8ToWString("\xe2\x82x", 3) == L"\xFFFDx");
+}
@@ -0,0 +1,147 @@
+#include "Test.h"
+#include "ParseTools.h"
+#include <cmath>
+#include <cwchar>
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace {
+
+bool Classifies(const wchar_t *url, ParseTools::UrlKind kind, const wchar_t *expectedId) {
+    const wchar_t *id;
+    std::size_t length;
+    if (ParseTools::ClassifyUrl(url, &id, &length) != kind)
+        return false;
+    if (!expectedId)
+        return id == nullptr && length == 0;
+    return id && std::wstring(id, length) == expectedId;
+}
+
+}
+
+TEST(ClassifyUrlKinds) {
+    CHECK(Classifies(L"https://www.youtube.com/watch?v=dQw4w9WgXcQ", ParseTools::UrlWatch, L"dQw4w9WgXcQ"));
+    CHECK(Classifies(L"https://youtu.be/dQw4w9WgXcQ", ParseTools::UrlShortLink, L"dQw4w9WgXcQ"));
+    CHECK(Classifies(L"youtube://dQw4w9WgXcQ/", ParseTools::UrlInternal, L"dQw4w9WgXcQ"));
+    CHECK(Classifies(L"https://www.googleapis.com/youtube/v3/videos?part=snippet&id=dQw4w9WgXcQ", ParseTools::UrlApi, L"dQw4w9WgXcQ"));
+    CHECK(Classifies(L"https://www.youtube.com/playlist?list=PLx0sYbCqOb8TBPRdmBHs5Iftvv9TPboYG", ParseTools::UrlPlaylist, L"PLx0sYbCqOb8TBPRdmBHs5Iftvv9TPboYG"));
+    CHECK(Classifies(L"https://www.youtube.com/channel/UCuAXFkgsw1L7xaCfnd5JJOw/videos", ParseTools::UrlChannel, L"UCuAXFkgsw1L7xaCfnd5JJOw"));
+    CHECK(Classifies(L"https://www.youtube.com/user/someone/playlists", ParseTools::UrlUser, L"someone"));
+
+    CHECK(ParseTools::IsVideoUrl(ParseTools::UrlWatch) && ParseTools::IsVideoUrl(ParseTools::UrlApi));
+    CHECK(!ParseTools::IsVideoUrl(ParseTools::UrlPlaylist) && !ParseTools::IsVideoUrl(ParseTools::UrlOther));
+}
+
+TEST(ClassifyUrlPrecedence) {
+    // A video beats the playlist it is played from, wherever the parameters are
+    CHECK(Classifies(L"https://www.youtube.com/watch?v=dQw4w9WgXcQ&list=PL123&index=2", ParseTools::UrlWatch, L"dQw4w9WgXcQ"));
+    CHECK(Classifies(L"https://www.youtube.com/watch?list=PL123&v=dQw4w9WgXcQ", ParseTools::UrlWatch, L"dQw4w9WgXcQ"));
+    CHECK(Classifies(L"https://www.youtube.com/watch?feature=share&v=dQw4w9WgXcQ", ParseTools::UrlWatch, L"dQw4w9WgXcQ"));
+    // ?v= comes before &v=
+    CHECK(Classifies(L"https://www.youtube.com/watch?v=aaaaaaaaaaa&v=bbbbbbbbbbb", ParseTools::UrlWatch, L"aaaaaaaaaaa"));
+    // A user beats a channel, both beat a playlist
+    CHECK(Classifies(L"https://www.youtube.com/user/someone/channel/UC1?list=PL1", ParseTools::UrlUser, L"someone"));
+    CHECK(Classifies(L"https://www.youtube.com/channel/UC1?list=PL1", ParseTools::UrlChannel, L"UC1"));
+    // &id= beats ?id= for the API
+    CHECK(Classifies(L"https://www.googleapis.com/youtube/v3/videos?id=first&key=k&id=second", ParseTools::UrlApi, L"second"));
+    // youtube.com is looked at before youtu.be, a link to one inside the other doesn't count
+    CHECK(Classifies(L"https://www.youtube.com/redirect?q=https://youtu.be/dQw4w9WgXcQ", ParseTools::UrlOther, nullptr));
+    CHECK(Classifies(L"https://youtu.be/dQw4w9WgXcQ?t=42&list=PL1", ParseTools::UrlShortLink, L"dQw4w9WgXcQ"));
+    // Parameters count only after ? or &
+    CHECK(Classifies(L"https://www.youtube.com/results?search_query=v=abc", ParseTools::UrlOther, nullptr));
+}
+
+TEST(ClassifyUrlOthers) {
+    CHECK(Classifies(nullptr, ParseTools::UrlOther, nullptr));
+    CHECK(Classifies(L"", ParseTools::UrlOther, nullptr));
+    CHECK(Classifies(L"http://example.com/watch?v=dQw4w9WgXcQ", ParseTools::UrlOther, nullptr));
+    CHECK(Classifies(L"https://www.googleapis.com/youtube/v3/playlistItems?playlistId=PL1", ParseTools::UrlOther, nullptr));
+    CHECK(Classifies(L"C:\\Music\\youtube.mp3", ParseTools::UrlOther, nullptr));
+    CHECK(Classifies(L"https://www.youtube.com/watch?v=", ParseTools::UrlWatch, L""));
+}
+
+TEST(ClassifyUrlFuzz) {
+    // Fragments glued at random: the id always lies within the url and stops at a separator or its end
+    static const wchar_t *fragments[] = {
+        L"https://", L"www.", L"youtube.com", L"youtu.be", L"youtube://", L"googleapis.com/youtube/v3", L"/watch",
+        L"?v=", L"&v=", L"?id=", L"&id=", L"?list=", L"&list=", L"/user/", L"/channel/", L"/", L"?", L"&", L"=",
+        L"dQw4w9WgXcQ", L"x", L"y", L"g"
+    };
+    std::mt19937 random(4);
+    for (int i = 0; i < 100000; ++i) {
+        std::wstring url;
+        for (int n = random() % 10; n > 0; --n)
+            url += fragments[random() % (sizeof(fragments) / sizeof(fragments[0]))];
+
+        const wchar_t *id;
+        std::size_t length;
+        ParseTools::UrlKind kind = ParseTools::ClassifyUrl(url.c_str(), &id, &length);
+        if (kind == ParseTools::UrlOther) {
+            CHECK(id == nullptr && length == 0);
+            continue;
+        }
+        CHECK(id >= url.c_str() && id + length <= url.c_str() + url.size());
+        if (kind != ParseTools::UrlInternal)
+            CHECK(std::wstring(id, length).find(L'&') == std::wstring::npos);
+    }
+}
+
+namespace {
+
+bool Duration(const char *text, double expected) {
+    double seconds = -1;
+    return ParseTools::ParseDuration(text, strlen(text), &seconds) && std::fabs(seconds - expected) <= 1e-9 * (1 + expected);
+}
+
+bool Invalid(const char *text) {
+    double seconds = -1;
+    return !ParseTools::ParseDuration(text, strlen(text), &seconds) && seconds == -1;
+}
+
+}
+
+TEST(ParseDurationTimes) {
+    CHECK(Duration("PT0S", 0));
+    CHECK(Duration("PT15S", 15));
+    CHECK(Duration("PT4M13S", 253));
+    CHECK(Duration("PT1H", 3600));
+    CHECK(Duration("PT1H2S", 3602));
+    CHECK(Duration("PT10H59M59S", 39599));
+}
+
+TEST(ParseDurationLiveAndDates) {
+    // Live streams
+    CHECK(Duration("P0D", 0));
+    CHECK(Duration("P1D", 86400));
+    CHECK(Duration("P1DT2H3M4S", 86400 + 7384));
+    CHECK(Duration("P2W", 14 * 86400));
+    CHECK(Duration("P1Y2M", 365 * 86400 + 60 * 86400));
+    CHECK(Duration("P1Y2M3W4DT5H6M7S", 365 * 86400 + 60 * 86400 + 21 * 86400 + 4 * 86400 + 5 * 3600 + 6 * 60 + 7));
+}
+
+TEST(ParseDurationFractions) {
+    CHECK(Duration("PT1.5S", 1.5));
+    CHECK(Duration("PT1,25S", 1.25));
+    CHECK(Duration("PT2M0.125S", 120.125));
+    CHECK(Duration("PT0.5H", 1800));
+    CHECK(Duration("P0.5D", 43200));
+    CHECK(Duration("PT.5S", 0.5));
+    // Only the last value may have a fraction
+    CHECK(Invalid("PT1.5M30S"));
+    CHECK(Invalid("P1.5DT1H"));
+}
+
+TEST(ParseDurationInvalid) {
+    const char *invalid[] = {
+        "", "P", "PT", "T1S", "1S", "pt1s", "P1DT", "PT1", "PT1X", "PTS", "PT-1S", "PT1H1H", "PT1S1M", "P1D1Y",
+        "P1H", "PT1D", "PT1W", "P1DT1HT1M", "PT.S"
+    };
+    for (auto x : invalid)
+        CHECK(Invalid(x));
+
+    // Only the given length is parsed
+    double seconds = 0;
+    CHECK(ParseTools::ParseDuration("PT15S", 4, &seconds) == false);
+    CHECK(ParseTools::ParseDuration("PT15Sxyz", 5, &seconds) && seconds == 15);
+}
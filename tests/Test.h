@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdio>
+#include <vector>
+
+// Minimal test registry, TEST(Name) { CHECK(...); } in any file linked into Tests
+struct Test {
+    typedef void (*Func)();
+
+    Test(const char *name, Func func) { All().push_back(this); Name = name; Run = func; }
+
+    static std::vector<Test *> &All() {
+        static std::vector<Test *> tests;
+        return tests;
+    }
+    static int &Failures() {
+        static int failures = 0;
+        return failures;
+    }
+
+    const char *Name;
+    Func Run;
+};
+
+#define TEST(name) \
+    static void name(); \
+    static Test name##Test(#name, name); \
+    static void name()
+
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+            Test::Failures()++; \
+        } \
+    } while (0)
@@ -0,0 +1,119 @@
+#include "Test.h"
+#include "VideoIdSet.h"
+#include <random>
+#include <string>
+#include <unordered_set>
+
+namespace {
+
+std::wstring RandomId(std::mt19937 &random, std::size_t length = 11) {
+    static const wchar_t alphabet[] = L"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    std::wstring id;
+    for (std::size_t i = 0; i < length; ++i)
+        id += alphabet[random() % 64];
+    return id;
+}
+
+}
+
+TEST(VideoIdPacksStandardIds) {
+    VideoId a(L"dQw4w9WgXcQ"), b(std::wstring(L"dQw4w9WgXcQ")), c(L"dQw4w9WgXcR");
+    CHECK(a == b);
+    CHECK(a != c);
+    CHECK(a.ToString() == L"dQw4w9WgXcQ");
+
+    // Anything else is interned, and still compares by value
+    VideoId d(L"PLrAXtmErZgOeiKm4sgNOknGvNjby9efdf"), e(L"PLrAXtmErZgOeiKm4sgNOknGvNjby9efdf");
+    CHECK(d == e);
+    CHECK(d.ToString() == L"PLrAXtmErZgOeiKm4sgNOknGvNjby9efdf");
+    CHECK(VideoId().Empty() && VideoId(L"").Empty());
+    CHECK(!a.Empty());
+}
+
+TEST(VideoIdSetInsertAndErase) {
+    VideoIdSet set;
+    CHECK(set.empty());
+    CHECK(set.count(L"dQw4w9WgXcQ") == 0);
+    CHECK(set.erase(L"dQw4w9WgXcQ") == 0);
+
+    CHECK(set.insert(L"dQw4w9WgXcQ").second);
+    CHECK(!set.insert(L"dQw4w9WgXcQ").second);
+    CHECK(set.insert(L"not a standard id").second);
+    CHECK(set.size() == 2);
+    CHECK(set.count(L"dQw4w9WgXcQ") == 1 && set.count(L"not a standard id") == 1);
+    CHECK(*set.find(L"dQw4w9WgXcQ") == VideoId(L"dQw4w9WgXcQ"));
+    CHECK(set.find(L"xxxxxxxxxxx") == set.end());
+
+    CHECK(set.erase(L"dQw4w9WgXcQ") == 1);
+    CHECK(set.erase(L"dQw4w9WgXcQ") == 0);
+    CHECK(set.count(L"dQw4w9WgXcQ") == 0);
+    CHECK(set.size() == 1);
+
+    // The tombstone is reused
+    CHECK(set.insert(L"dQw4w9WgXcQ").second);
+    CHECK(set.size() == 2);
+
+    set.clear();
+    CHECK(set.empty() && set.begin() == set.end() && set.count(L"not a standard id") == 0);
+}
+
+TEST(VideoIdSetTombstonesDontFillTheTable) {
+    // Every round leaves only tombstones behind, lookups of missing ids have to keep terminating
+    std::mt19937 random(1);
+    VideoIdSet set;
+    for (int round = 0; round < 50; ++round) {
+        std::vector<std::wstring> ids;
+        for (int i = 0; i < 100; ++i) {
+            ids.push_back(RandomId(random));
+            set.insert(ids.back());
+        }
+        for (const auto &x : ids)
+            set.erase(x);
+        CHECK(set.empty());
+        CHECK(set.count(RandomId(random)) == 0);
+    }
+}
+
+TEST(VideoIdSetEraseWhileIterating) {
+    VideoIdSet set;
+    for (int i = 0; i < 1000; ++i)
+        set.insert(std::to_wstring(i));
+
+    std::size_t visited = 0;
+    for (auto it = set.begin(); it != set.end();) {
+        ++visited;
+        it = std::stoi((*it).ToString()) % 2 ? set.erase(it) : ++it;
+    }
+    CHECK(visited == 1000);
+    CHECK(set.size() == 500);
+    for (int i = 0; i < 1000; ++i)
+        CHECK(set.count(std::to_wstring(i)) == (i % 2 ? 0u : 1u));
+}
+
+TEST(VideoIdSetMatchesUnorderedSet) {
+    std::mt19937 random(2);
+    std::vector<std::wstring> pool;
+    for (int i = 0; i < 2000; ++i)
+        pool.push_back(RandomId(random, i % 10 ? 11 : 5 + random() % 20));
+
+    VideoIdSet set;
+    std::unordered_set<VideoId> reference;
+    for (int i = 0; i < 100000; ++i) {
+        VideoId id(pool[random() % pool.size()]);
+        switch (random() % 3) {
+            case 0: CHECK(set.insert(id).second == reference.insert(id).second); break;
+            case 1: CHECK(set.erase(id) == reference.erase(id)); break;
+            case 2: CHECK(set.count(id) == reference.count(id)); break;
+        }
+        if (i % 25000 == 0)
+            set.reserve(set.size() * 2);
+    }
+    CHECK(set.size() == reference.size());
+
+    std::size_t iterated = 0;
+    for (auto x : set) {
+        CHECK(reference.count(x) == 1);
+        ++iterated;
+    }
+    CHECK(iterated == reference.size());
+}